@@ -0,0 +1,414 @@
+// Micro-benchmarks for the MathCore kernels.
+//
+// Sizes and seeds are fixed so numbers are comparable between versions.
+// Each case runs once to warm up and then reports the best of --repeat runs
+// as ns per element and GB/s of the bytes the kernel has to touch.
+//
+//   MathBench [--repeat N] [filter]
+
+#include "math/Covariance.h"
+#include "math/Distributions.h"
+#include "math/EigenSolvers.h"
+#include "math/ImagePCA.h"
+#include "math/KMeans.h"
+#include "math/KernelDensity.h"
+#include "math/LineFit.h"
+#include "math/PcaCodec.h"
+#include "math/PointIndex.h"
+#include "math/PointSet.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace
+{
+    const unsigned int Seed = 42;
+
+    int g_repeat = 5;
+    std::string g_filter;
+
+    // Keeps results observable so the compiler cannot drop the work.
+    volatile float g_sink = 0;
+
+    template<typename Fn>
+    void run(const char* name, size_t elements, size_t bytes, Fn fn)
+    {
+        if (!g_filter.empty() && std::string(name).find(g_filter) == std::string::npos)
+            return;
+
+        fn();
+        double best = 1e30;
+        for (int i = 0; i < g_repeat; i++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            fn();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (seconds < best)
+                best = seconds;
+        }
+        std::printf("%-24s %12zu %12.3f %12.3f %10.3f\n", name, elements,
+            best * 1e3, best * 1e9 / elements, bytes / best / 1e9);
+    }
+
+    PointSet makePoints(size_t count)
+    {
+        std::mt19937 rng(Seed);
+        std::normal_distribution<float> normal(0, 1);
+        PointSet points;
+        points.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            float u = normal(rng);
+            float v = normal(rng);
+            points.append(3 + 2 * u + 0.5f * v, -1 + 0.5f * u + v);
+        }
+        return points;
+    }
+
+    // Points scattered across a diagonal segment, with the given fraction
+    // replaced by uniform outliers around it.
+    PointSet makeLinePoints(size_t count, float outliers)
+    {
+        std::mt19937 rng(Seed);
+        std::uniform_real_distribution<float> uniform(0, 1);
+        PointSet points;
+        points.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (uniform(rng) < outliers)
+            {
+                points.append(-9 + 18 * uniform(rng), -9 + 18 * uniform(rng));
+                continue;
+            }
+            float t = -9 + 18 * uniform(rng);
+            float r = 0.2f * (2 * uniform(rng) - 1);
+            points.append(t - 0.7071f * r, t + 0.7071f * r);
+        }
+        return points;
+    }
+
+    // Peak signal to noise ratio of decoded against original, in dB; infinite
+    // when they are equal.
+    double psnr(const uint8_t* original, const uint8_t* decoded, size_t count)
+    {
+        double error = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            double d = double(original[i]) - decoded[i];
+            error += d * d;
+        }
+        if (error == 0)
+            return std::numeric_limits<double>::infinity();
+        return 10 * std::log10(255.0 * 255.0 * count / error);
+    }
+
+    void printSize(const char* name, size_t bytes, size_t pixels, double quality)
+    {
+        if (!g_filter.empty() && std::string(name).find(g_filter) == std::string::npos)
+            return;
+        std::printf("%-24s %12zu bytes %8.3f bits/pixel %8.2f dB PSNR\n", name, bytes, bytes * 8.0 / pixels, quality);
+    }
+
+    std::vector<Eigen::Matrix2f> makeMatrices2(size_t count, bool symmetric)
+    {
+        std::mt19937 rng(Seed);
+        std::normal_distribution<float> normal(0, 1);
+        std::vector<Eigen::Matrix2f> matrices(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            Eigen::Matrix2f a;
+            a << normal(rng), normal(rng), normal(rng), normal(rng);
+            matrices[i] = symmetric ? Eigen::Matrix2f(a * a.transpose()) : a;
+        }
+        return matrices;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            g_repeat = std::max(1, std::atoi(argv[++i]));
+        else
+            g_filter = argv[i];
+    }
+
+    std::printf("%-24s %12s %12s %12s %10s\n", "benchmark", "elements", "ms", "ns/element", "GB/s");
+
+    {
+        const size_t count = 16 * 1024 * 1024;
+        PointSet points = makePoints(count);
+        run("covariance/reduce", count, count * 2 * sizeof(float), [&]()
+        {
+            PointStatistics statistics = computePointStatistics(points);
+            g_sink = statistics.covariance(0, 1);
+        });
+    }
+
+    {
+        const size_t count = 1024 * 1024;
+        std::vector<Eigen::Matrix2f> symmetric = makeMatrices2(count, true);
+        std::vector<Eigen::Matrix2f> general = makeMatrices2(count, false);
+        run("eigen/symmetric2x2", count, count * sizeof(Eigen::Matrix2f), [&]()
+        {
+            Eigen::Vector2f values;
+            Eigen::Matrix2f vectors;
+            float sum = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                symmetricEigen2(symmetric[i], values, vectors);
+                sum += values.x() + vectors(0, 0);
+            }
+            g_sink = sum;
+        });
+        std::vector<float> xx(count), xy(count), yy(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            xx[i] = symmetric[i](0, 0);
+            xy[i] = symmetric[i](0, 1);
+            yy[i] = symmetric[i](1, 1);
+        }
+        std::vector<float> major(count), minor(count), cos2(count), sin2(count);
+        run("eigen/symmetric2x2batch", count, count * 7 * sizeof(float), [&]()
+        {
+            symmetricEigen2Batch(xx.data(), xy.data(), yy.data(), count,
+                major.data(), minor.data(), cos2.data(), sin2.data());
+            g_sink = major[count / 2] + cos2[count / 2];
+        });
+        run("eigen/general2x2", count, count * sizeof(Eigen::Matrix2f), [&]()
+        {
+            Eigen::Vector2f values;
+            Eigen::Matrix2f vectors;
+            float sum = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                eigen2(general[i], values, vectors);
+                sum += values.x() + vectors(0, 0);
+            }
+            g_sink = sum;
+        });
+    }
+
+    {
+        const size_t count = 1024 * 1024;
+        std::mt19937 rng(Seed);
+        std::normal_distribution<float> normal(0, 1);
+        std::vector<Eigen::Matrix3f> matrices(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            Eigen::Matrix3f a;
+            for (int j = 0; j < 9; j++)
+                a(j / 3, j % 3) = normal(rng);
+            matrices[i] = a * a.transpose();
+        }
+        run("eigen/symmetric3x3", count, count * sizeof(Eigen::Matrix3f), [&]()
+        {
+            Eigen::Vector3f values;
+            Eigen::Matrix3f vectors;
+            float sum = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                symmetricEigen3(matrices[i], values, vectors);
+                sum += values.x() + vectors(0, 0);
+            }
+            g_sink = sum;
+        });
+    }
+
+    {
+        // 12 MP RGB image with smooth colour gradients plus noise.
+        const int width = 4000;
+        const int height = 3000;
+        const size_t pixels = size_t(width) * height;
+        std::mt19937 rng(Seed);
+        std::uniform_int_distribution<int> noise(-20, 20);
+        std::vector<uint8_t> rgb(pixels * 3);
+        for (int i = 0; i < height; i++)
+        {
+            for (int j = 0; j < width; j++)
+            {
+                uint8_t* p = rgb.data() + (size_t(i) * width + j) * 3;
+                p[0] = uint8_t(std::min(255, std::max(0, j * 255 / width + noise(rng))));
+                p[1] = uint8_t(std::min(255, std::max(0, i * 255 / height + noise(rng))));
+                p[2] = uint8_t(std::min(255, std::max(0, (i + j) * 127 / (width + height) + 64 + noise(rng))));
+            }
+        }
+        std::vector<float> projection(pixels);
+        std::vector<uint8_t> gray(pixels);
+        std::vector<uint8_t> decoded(pixels * 3);
+        ImagePCA pca;
+        run("pca/basis", pixels, pixels * 3, [&]()
+        {
+            pca.computeBasis(rgb.data(), width, height, width * 3);
+            g_sink = pca.axis().x();
+        });
+        run("pca/encode", pixels, pixels * (3 + sizeof(float) + 1), [&]()
+        {
+            pca.encode(rgb.data(), width, height, width * 3, projection.data(), gray.data(), width);
+            g_sink = projection[pixels / 2];
+        });
+        run("pca/decode", pixels, pixels * (sizeof(float) + 3), [&]()
+        {
+            pca.decode(projection.data(), width, height, decoded.data(), width * 3);
+            g_sink = decoded[pixels / 2];
+        });
+
+        // Encoded size and decode throughput of the .pcai container next to
+        // PNG and JPEG on the same image; OpenCV takes the pixels as BGR,
+        // which changes neither. PSNR is measured against the original.
+        const int codecComponents[] = {1, 2, 3};
+        for (int i = 0; i < 3; i++)
+        {
+            for (int compression = 0; compression < 2; compression++)
+            {
+                PcaImageEncoder encoder;
+                encoder.setComponentCount(codecComponents[i]);
+                encoder.setCompression(static_cast<PcaImageEncoder::Compression>(compression));
+                encoder.encode(rgb.data(), width, height, width * 3);
+                std::vector<uint8_t> data = encoder.data();
+                size_t bytes = data.size();
+                std::string name = std::string("codec/pcai") + char('0' + codecComponents[i]) + (compression ? "-huffman" : "-raw");
+
+                PcaImageDecoder decoder;
+                decoder.open(data);
+                decoder.decode(decoded.data(), width * 3);
+                printSize((name + "-size").c_str(), bytes, pixels, psnr(rgb.data(), decoded.data(), pixels * 3));
+                run((name + "-decode").c_str(), pixels, pixels * 3, [&]()
+                {
+                    decoder.decode(decoded.data(), width * 3);
+                    g_sink = decoded[pixels / 2];
+                });
+            }
+        }
+
+        cv::Mat image(height, width, CV_8UC3, rgb.data());
+        const char* formats[] = {".png", ".jpg"};
+        const char* names[] = {"codec/png", "codec/jpeg95"};
+        for (int i = 0; i < 2; i++)
+        {
+            std::vector<uint8_t> data;
+            std::vector<int> parameters;
+            if (i == 1)
+            {
+                parameters.push_back(cv::IMWRITE_JPEG_QUALITY);
+                parameters.push_back(95);
+            }
+            cv::imencode(formats[i], image, data, parameters);
+
+            cv::Mat encoded(1, int(data.size()), CV_8UC1, data.data());
+            cv::Mat reference = cv::imdecode(encoded, cv::IMREAD_COLOR);
+            double quality = reference.isContinuous() && reference.total() == pixels && reference.type() == CV_8UC3
+                ? psnr(rgb.data(), reference.data, pixels * 3) : 0;
+            printSize((std::string(names[i]) + "-size").c_str(), data.size(), pixels, quality);
+            run((std::string(names[i]) + "-decode").c_str(), pixels, pixels * 3, [&]()
+            {
+                cv::Mat result = cv::imdecode(encoded, cv::IMREAD_COLOR);
+                g_sink = result.empty() ? 0 : result.data[0];
+            });
+        }
+    }
+
+    {
+        const int size = 4096;
+        const size_t nodes = size_t(size) * size;
+        std::vector<float> density(nodes);
+        Eigen::Matrix2f covariance;
+        covariance << 1.0f, 0.3f, 0.3f, 0.5f;
+        run("pdf/normal2d", nodes, nodes * sizeof(float), [&]()
+        {
+            evaluateNormal2D(Eigen::Vector2f(0.1f, -0.2f), covariance, -4, -4, 8.0f / size, size, size, density.data());
+            g_sink = density[nodes / 2];
+        });
+    }
+
+    {
+        const size_t count = 4 * 1024 * 1024;
+        PointSet points = makePoints(count);
+        KernelDensity kde;
+        run("kde/estimate", count, count * 2 * sizeof(float), [&]()
+        {
+            kde.estimate(points);
+            g_sink = kde.maxDensity();
+        });
+
+        PointIndex index;
+        run("index/build", count, count * 2 * sizeof(float), [&]()
+        {
+            index.build(points);
+            g_sink = float(index.size());
+        });
+
+        // Queries scattered over the bulk of the distribution.
+        const size_t queries = 4096;
+        std::vector<float> qx(queries), qy(queries);
+        std::mt19937 queryRng(Seed);
+        std::uniform_real_distribution<float> uniform(-4, 8);
+        for (size_t i = 0; i < queries; i++)
+        {
+            qx[i] = uniform(queryRng);
+            qy[i] = uniform(queryRng) * 0.5f - 1;
+        }
+        run("index/nearest", queries, queries * 2 * sizeof(float), [&]()
+        {
+            long long sum = 0;
+            for (size_t i = 0; i < queries; i++)
+                sum += index.nearest(qx[i], qy[i], 0.1f);
+            g_sink = float(sum);
+        });
+
+        const int k = 64;
+        std::vector<float> mx(k), my(k), cc(k);
+        std::mt19937 rng(Seed);
+        std::normal_distribution<float> normal(0, 2);
+        for (int c = 0; c < k; c++)
+        {
+            float x = normal(rng);
+            float y = normal(rng);
+            mx[c] = -2 * x;
+            my[c] = -2 * y;
+            cc[c] = x * x + y * y;
+        }
+        std::vector<int> labels(count);
+        std::vector<float> distances(count);
+        run("kmeans/assign64", count, count * (2 * sizeof(float) + sizeof(int) + sizeof(float)), [&]()
+        {
+            nearestCentroids(points.x.data(), points.y.data(), int(count), mx.data(), my.data(), cc.data(), k,
+                labels.data(), distances.data());
+            g_sink = distances[count / 2];
+        });
+    }
+
+    {
+        const size_t count = 10 * 1000 * 1000;
+        PointSet points = makeLinePoints(count, 0.3f);
+        run("linefit/count", count, count * 2 * sizeof(float), [&]()
+        {
+            g_sink = float(countLineInliers(points.x.data(), points.y.data(), count, -0.7071f, 0.7071f, 0, 0.5f));
+        });
+        run("linefit/tls", count, count * 2 * sizeof(float), [&]()
+        {
+            FittedLine line = fitLineTls(computePointStatistics(points));
+            line.threshold = 0.5f;
+            g_sink = float(countLineInliers(points, line));
+        });
+        run("linefit/ransac", count, count * 2 * sizeof(float), [&]()
+        {
+            LineRansac ransac;
+            ransac.setThreshold(0.5f);
+            ransac.fit(points);
+            g_sink = float(ransac.line().inliers);
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,344 @@
+// Headless render-performance harness for CanvasView.
+//
+// Runs every tool (and every distribution of the probability tool) under the
+// offscreen Qt platform, drives the same scripted zoom / pan / drag sequence
+// against each, times every repaint and reports frame-time percentiles. The
+// last frame of each scenario can be saved as a golden image, or compared
+// against previously saved goldens to catch visual regressions.
+//
+//   RenderBench [--points N] [--rows N] [--image WxH] [--frames N] [--size WxH]
+//               [--filter NAME] [--save-golden DIR] [--check-golden DIR]
+//               [--tolerance N]
+
+#include "ui/CanvasView.h"
+#include "math/Distributions.h"
+#include "math/ImagePCA.h"
+#include "math/PointIndex.h"
+#include "math/PointSet.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMouseEvent>
+#include <QScrollBar>
+#include <QtMath>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const unsigned int Seed = 42;
+
+    struct Scenario
+    {
+        QString name;
+        ToolType tool;
+        DistributionType distribution;
+        bool kde;
+    };
+
+    void quietMessageHandler(QtMsgType type, const QMessageLogContext&, const QString& message)
+    {
+        if (type != QtDebugMsg && type != QtInfoMsg)
+            std::fprintf(stderr, "%s\n", qPrintable(message));
+    }
+
+    QSize parseSize(const QString& text, const QSize& fallback)
+    {
+        QStringList parts = text.split('x');
+        if (parts.size() != 2)
+            return fallback;
+        return QSize(parts[0].toInt(), parts[1].toInt());
+    }
+
+    PointSet makePoints(int count)
+    {
+        std::mt19937 rng(Seed);
+        std::normal_distribution<float> normal(0, 1);
+        PointSet points;
+        points.reserve(count);
+        for (int i = 0; i < count; i++)
+        {
+            float u = normal(rng);
+            float v = normal(rng);
+            points.append(1 + 3 * u + v, -2 + u + 1.5f * v);
+        }
+        return points;
+    }
+
+    QImage makeImage(const QSize& size)
+    {
+        std::mt19937 rng(Seed);
+        std::uniform_int_distribution<int> noise(-16, 16);
+        QImage image(size, QImage::Format_RGB888);
+        for (int i = 0; i < size.height(); i++)
+        {
+            uchar* p = image.scanLine(i);
+            for (int j = 0; j < size.width(); j++, p += 3)
+            {
+                p[0] = uchar(qBound(0, j * 255 / size.width() + noise(rng), 255));
+                p[1] = uchar(qBound(0, i * 255 / size.height() + noise(rng), 255));
+                p[2] = uchar(qBound(0, 128 + noise(rng) * 4, 255));
+            }
+        }
+        return image;
+    }
+
+    void setupScenario(CanvasView& view, const Scenario& scenario, const PointSet& points,
+        const QSharedPointer<const PointSet>& rows, const QSharedPointer<const PointIndex>& rowIndex, const QImage& image)
+    {
+        view.resetTransform();
+        view.horizontalScrollBar()->setValue(0);
+        view.verticalScrollBar()->setValue(0);
+        view.setKdeOptions(false, 0, KM_Heat);
+        view.setPoints(PointSet());
+        view.updateToolType(scenario.tool);
+        view.updateDistributionType(scenario.distribution);
+
+        if (scenario.tool == TT_CovMatrix)
+        {
+            view.setPoints(points);
+            view.setKdeOptions(scenario.kde, 0, KM_HeatContour);
+        }
+        else if (scenario.tool == TT_DataPCA)
+        {
+            view.setDataProjection(rows, rowIndex, 1, 0.25);
+        }
+        else if (scenario.tool == TT_PCA)
+        {
+            ImagePCA pca;
+            pca.computeBasis(image.constBits(), image.width(), image.height(), image.bytesPerLine());
+            QImage encoded(image.size(), QImage::Format_Grayscale8);
+            QImage decoded(image.size(), QImage::Format_RGB888);
+            std::vector<float> projection(size_t(image.width()) * image.height());
+            pca.encode(image.constBits(), image.width(), image.height(), image.bytesPerLine(),
+                projection.data(), encoded.bits(), encoded.bytesPerLine());
+            pca.decode(projection.data(), image.width(), image.height(), decoded.bits(), decoded.bytesPerLine());
+            view.setImageRaw(image, buildImageLevels(image));
+            view.setEncodered(encoded, buildImageLevels(encoded));
+            view.setDecodered(decoded, buildImageLevels(decoded));
+        }
+        else if (scenario.tool == TT_Probability)
+        {
+            QSharedPointer<DistributionSnapshot> snapshot(new DistributionSnapshot);
+            DistributionSamples result;
+            result.avg = result.var = result.std = 0;
+            if (scenario.distribution == DT_BERNOULLI)
+                result = bernoulliSamples(0.3, 20);
+            else if (scenario.distribution == DT_NORMAL)
+                result = normalSamples(0, 1, 0.05);
+            for (size_t i = 0; i < result.samples.size(); i++)
+                snapshot->samples.append(QVector2D(result.samples[i].x(), result.samples[i].y()));
+            if (scenario.distribution == DT_NORMAL2D)
+            {
+                std::vector<Eigen::Vector3f> grid = normal2DGrid(1, 0.05);
+                for (size_t i = 0; i < grid.size(); i++)
+                    snapshot->samples3D.append(QVector3D(grid[i].x(), grid[i].y(), grid[i].z()));
+            }
+            snapshot->avg = result.avg;
+            snapshot->var = result.var;
+            snapshot->std = result.std;
+            view.publishDistribution(snapshot);
+        }
+    }
+
+    // Frame script: the first third zooms in and back out around the centre,
+    // the second third pans across the scene, the last third drags the mouse
+    // around a circle.
+    void scriptStep(CanvasView& view, int frame, int frames)
+    {
+        QWidget* viewport = view.viewport();
+        QPointF centre(viewport->width() / 2.0, viewport->height() / 2.0);
+        int phaseLength = qMax(1, frames / 3);
+        int phase = qMin(2, frame / phaseLength);
+        int step = frame - phase * phaseLength;
+        qreal t = qreal(step) / phaseLength;
+
+        if (phase == 0)
+        {
+            int delta = step < phaseLength / 2 ? 120 : -120;
+            QWheelEvent event(centre, delta, Qt::NoButton, Qt::ControlModifier);
+            QCoreApplication::sendEvent(viewport, &event);
+        }
+        else if (phase == 1)
+        {
+            qreal wave = 0.5 - 0.5 * std::cos(2 * M_PI * t);
+            QScrollBar* h = view.horizontalScrollBar();
+            QScrollBar* v = view.verticalScrollBar();
+            h->setValue(h->minimum() + qRound((h->maximum() - h->minimum()) * wave));
+            v->setValue(v->minimum() + qRound((v->maximum() - v->minimum()) * (1 - wave)));
+        }
+        else
+        {
+            qreal radius = qMin(viewport->width(), viewport->height()) / 4.0;
+            QPointF pos = centre + QPointF(radius * std::cos(2 * M_PI * t), radius * std::sin(2 * M_PI * t));
+            QEvent::Type type = step == 0 ? QEvent::MouseButtonPress
+                : frame == frames - 1 ? QEvent::MouseButtonRelease : QEvent::MouseMove;
+            Qt::MouseButtons buttons = type == QEvent::MouseButtonRelease ? Qt::NoButton : Qt::LeftButton;
+            QMouseEvent event(type, pos, Qt::LeftButton, buttons, Qt::NoModifier);
+            QCoreApplication::sendEvent(viewport, &event);
+        }
+    }
+
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0;
+        size_t rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    // Returns the number of pixels whose channels differ by more than tolerance.
+    qint64 compareImages(const QImage& a, const QImage& b, int tolerance)
+    {
+        if (a.size() != b.size())
+            return qint64(qMax(a.width(), b.width())) * qMax(a.height(), b.height());
+        QImage x = a.convertToFormat(QImage::Format_ARGB32);
+        QImage y = b.convertToFormat(QImage::Format_ARGB32);
+        qint64 different = 0;
+        for (int i = 0; i < x.height(); i++)
+        {
+            const QRgb* p = reinterpret_cast<const QRgb*>(x.constScanLine(i));
+            const QRgb* q = reinterpret_cast<const QRgb*>(y.constScanLine(i));
+            for (int j = 0; j < x.width(); j++)
+            {
+                if (qAbs(qRed(p[j]) - qRed(q[j])) > tolerance || qAbs(qGreen(p[j]) - qGreen(q[j])) > tolerance
+                    || qAbs(qBlue(p[j]) - qBlue(q[j])) > tolerance || qAbs(qAlpha(p[j]) - qAlpha(q[j])) > tolerance)
+                    different++;
+            }
+        }
+        return different;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("CanvasView render-performance harness");
+    parser.addHelpOption();
+    QCommandLineOption pointsOption("points", "Points for the covariance tool.", "N", "100000");
+    QCommandLineOption rowsOption("rows", "Projected rows for the data PCA tool.", "N", "1000000");
+    QCommandLineOption imageOption("image", "Image size for the PCA tool.", "WxH", "2000x1500");
+    QCommandLineOption framesOption("frames", "Frames per scenario.", "N", "120");
+    QCommandLineOption sizeOption("size", "Viewport size.", "WxH", "1024x768");
+    QCommandLineOption filterOption("filter", "Only run scenarios containing NAME.", "NAME");
+    QCommandLineOption saveOption("save-golden", "Save the last frame of each scenario to DIR.", "DIR");
+    QCommandLineOption checkOption("check-golden", "Compare the last frame of each scenario with DIR.", "DIR");
+    QCommandLineOption toleranceOption("tolerance", "Per-channel tolerance for golden checks.", "N", "2");
+    QCommandLineOption verboseOption("verbose", "Keep the canvas' own debug output.");
+    parser.addOptions({ pointsOption, rowsOption, imageOption, framesOption, sizeOption, filterOption,
+        saveOption, checkOption, toleranceOption, verboseOption });
+    parser.process(app);
+
+    // The canvas logs heavily while painting; that would dominate the timings.
+    if (!parser.isSet(verboseOption))
+    {
+        qInstallMessageHandler(quietMessageHandler);
+        std::cout.setstate(std::ios::badbit);
+    }
+
+    const int pointCount = parser.value(pointsOption).toInt();
+    const int rowCount = parser.value(rowsOption).toInt();
+    const int frames = qMax(3, parser.value(framesOption).toInt());
+    const QSize viewSize = parseSize(parser.value(sizeOption), QSize(1024, 768));
+    const QSize imageSize = parseSize(parser.value(imageOption), QSize(2000, 1500));
+    const int tolerance = parser.value(toleranceOption).toInt();
+
+    const Scenario scenarios[] = {
+        { "eigen", TT_EigenMatrix, DT_BERNOULLI, false },
+        { "cov", TT_CovMatrix, DT_BERNOULLI, false },
+        { "cov-kde", TT_CovMatrix, DT_BERNOULLI, true },
+        { "pca", TT_PCA, DT_BERNOULLI, false },
+        { "data-pca", TT_DataPCA, DT_BERNOULLI, false },
+        { "probability-bernoulli", TT_Probability, DT_BERNOULLI, false },
+        { "probability-normal", TT_Probability, DT_NORMAL, false },
+        { "probability-normal2d", TT_Probability, DT_NORMAL2D, false },
+    };
+
+    PointSet points = makePoints(pointCount);
+    QImage image = makeImage(imageSize);
+    // Stands in for the rows of a data set projected on two components.
+    QSharedPointer<PointSet> rows(new PointSet(makePoints(rowCount)));
+    QSharedPointer<PointIndex> rowIndex(new PointIndex);
+    rowIndex->build(*rows);
+
+    CanvasView view;
+    view.resize(viewSize);
+    view.show();
+    QApplication::processEvents();
+
+    std::printf("%-24s %8s %10s %10s %10s %10s %10s  %s\n",
+        "scenario", "frames", "mean ms", "p50 ms", "p95 ms", "p99 ms", "max ms", "golden");
+
+    int failures = 0;
+    for (const Scenario& scenario : scenarios)
+    {
+        if (parser.isSet(filterOption) && !scenario.name.contains(parser.value(filterOption)))
+            continue;
+
+        setupScenario(view, scenario, points, rows, rowIndex, image);
+        view.viewport()->repaint();
+
+        std::vector<double> times;
+        times.reserve(frames);
+        QElapsedTimer timer;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            scriptStep(view, frame, frames);
+            timer.start();
+            view.viewport()->repaint();
+            times.push_back(timer.nsecsElapsed() / 1e6);
+        }
+
+        double mean = 0;
+        for (double t : times)
+            mean += t;
+        mean /= times.size();
+        std::sort(times.begin(), times.end());
+
+        QString golden = "-";
+        QImage frame = view.viewport()->grab().toImage();
+        QString fileName = scenario.name + ".png";
+        if (parser.isSet(saveOption))
+        {
+            QDir dir(parser.value(saveOption));
+            dir.mkpath(".");
+            golden = frame.save(dir.filePath(fileName)) ? "saved" : "save failed";
+        }
+        if (parser.isSet(checkOption))
+        {
+            QImage expected(QDir(parser.value(checkOption)).filePath(fileName));
+            if (expected.isNull())
+            {
+                golden = "missing";
+                failures++;
+            }
+            else
+            {
+                qint64 different = compareImages(frame, expected, tolerance);
+                golden = different == 0 ? "match" : QString("%1 px differ").arg(different);
+                if (different != 0)
+                    failures++;
+            }
+        }
+
+        std::printf("%-24s %8d %10.3f %10.3f %10.3f %10.3f %10.3f  %s\n", qPrintable(scenario.name), frames,
+            mean, percentile(times, 50), percentile(times, 95), percentile(times, 99), times.back(),
+            qPrintable(golden));
+        std::fflush(stdout);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
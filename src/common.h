@@ -6,7 +6,8 @@ enum ToolType
     TT_EigenMatrix = 0,
     TT_CovMatrix = 1,
     TT_PCA = 2,
-    TT_Probability
+    TT_Probability,
+    TT_DataPCA
 };
 
 enum DistributionType
@@ -17,4 +18,17 @@ enum DistributionType
     DT_NORMAL2D
 };
 
+enum KdeMode
+{
+    KM_Heat = 0,
+    KM_Contour,
+    KM_HeatContour
+};
+
+enum LineFitMethod
+{
+    LF_TotalLeastSquares = 0,
+    LF_Ransac
+};
+
 #endif // COMMON_H
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Blocking FIFO of bounded size for connecting pipeline stages. A full queue
+// makes the producer wait, so a slow stage throttles the ones before it
+// instead of letting items pile up.
+//
+// Unlike SpscRing it sleeps instead of spinning, which suits items that take
+// milliseconds each, such as video frames.
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1)
+        , m_closed(false)
+    {
+    }
+
+    // Waits while the queue is full. Returns false, leaving item untouched,
+    // once the queue is closed.
+    bool push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_items.size() >= m_capacity && !m_closed)
+            m_notFull.wait(lock);
+        if (m_closed)
+            return false;
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Waits while the queue is empty. Returns false when it is closed and
+    // all items have been taken.
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_items.empty() && !m_closed)
+            m_notEmpty.wait(lock);
+        if (m_items.empty())
+            return false;
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // Wakes all waiters; no more items are accepted.
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed;
+};
+
+#endif // BOUNDEDQUEUE_H
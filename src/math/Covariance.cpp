@@ -0,0 +1,50 @@
+#include "Covariance.h"
+#include "Parallel.h"
+
+#include <vector>
+
+PointStatistics computePointStatistics(const PointSet& points)
+{
+    PointStatistics result;
+    result.mean.setZero();
+    result.covariance.setZero();
+    const size_t count = points.size();
+    if (count == 0)
+        return result;
+
+    // Shift by the first point so the raw second moments do not cancel.
+    const float* xs = points.x.data();
+    const float* ys = points.y.data();
+    const double shiftX = xs[0];
+    const double shiftY = ys[0];
+
+    typedef Eigen::Matrix<double, 5, 1> Moments;
+    std::vector<Moments> moments(parallelChunks(count));
+    parallelFor(count, [&](size_t begin, size_t end, int chunk)
+    {
+        double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+        for (size_t i = begin; i < end; i++)
+        {
+            double x = xs[i] - shiftX;
+            double y = ys[i] - shiftY;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+            syy += y * y;
+        }
+        moments[chunk] << sx, sy, sxx, sxy, syy;
+    });
+
+    Moments total = Moments::Zero();
+    for (size_t i = 0; i < moments.size(); i++)
+        total += moments[i];
+    total /= double(count);
+
+    double mx = total(0);
+    double my = total(1);
+    result.mean = Eigen::Vector2f(float(mx + shiftX), float(my + shiftY));
+    result.covariance << float(total(2) - mx * mx), float(total(3) - mx * my),
+                         float(total(3) - mx * my), float(total(4) - my * my);
+    return result;
+}
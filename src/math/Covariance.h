@@ -0,0 +1,20 @@
+#ifndef COVARIANCE_H
+#define COVARIANCE_H
+
+#include <Eigen/Core>
+
+#include "PointSet.h"
+
+struct PointStatistics
+{
+    Eigen::Vector2f mean;
+    // Population covariance (divided by N), as drawn by the covariance tool.
+    Eigen::Matrix2f covariance;
+};
+
+// Mean and covariance of points in one parallel pass. Moments are summed in
+// double per thread, so the result stays accurate for tens of millions of
+// points far from the origin.
+PointStatistics computePointStatistics(const PointSet& points);
+
+#endif // COVARIANCE_H
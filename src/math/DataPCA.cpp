@@ -0,0 +1,251 @@
+#include "DataPCA.h"
+#include "Parallel.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <random>
+#include <utility>
+
+namespace
+{
+    typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrixXf;
+
+    // Width of the square scatter tiles handed to the worker threads.
+    const int TileSize = 64;
+
+    // Extra random directions carried through the subspace iteration.
+    const int Oversampling = 10;
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    Eigen::MatrixXd orthonormalize(const Eigen::MatrixXd& y)
+    {
+        Eigen::HouseholderQR<Eigen::MatrixXd> qr(y);
+        return qr.householderQ() * Eigen::MatrixXd::Identity(y.rows(), y.cols());
+    }
+}
+
+DataPCA::DataPCA()
+    : m_componentCount(10)
+    , m_blockRows(4096)
+    , m_powerIterations(4)
+    , m_seed(42)
+    , m_rows(0)
+    , m_totalVariance(0)
+    , m_covarianceMs(0)
+    , m_eigenMs(0)
+    , m_projectionMs(0)
+{
+}
+
+bool DataPCA::fit(MatrixReader& reader, const Progress& progress)
+{
+    m_rows = 0;
+    m_projections.clear();
+    if (!reader.isOpen() || !reader.rewind())
+        return false;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!accumulateScatter(reader, progress))
+        return false;
+    m_covarianceMs = millisecondsSince(start);
+
+    if (progress && !progress(EigenStage, 0))
+        return false;
+    start = std::chrono::steady_clock::now();
+    solveEigen();
+    m_eigenMs = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    if (!project(reader, progress))
+        return false;
+    m_projectionMs = millisecondsSince(start);
+    return true;
+}
+
+bool DataPCA::accumulateScatter(MatrixReader& reader, const Progress& progress)
+{
+    int d = reader.columns();
+
+    // Lower triangle of the scatter matrix, split into square tiles that the
+    // threads update independently.
+    int tileCount = (d + TileSize - 1) / TileSize;
+    std::vector<std::pair<int, int>> tiles;
+    for (int i = 0; i < tileCount; i++)
+        for (int j = 0; j <= i; j++)
+            tiles.push_back(std::make_pair(i * TileSize, j * TileSize));
+    std::vector<Eigen::MatrixXf> products(tiles.size());
+
+    Eigen::MatrixXd scatter = Eigen::MatrixXd::Zero(d, d);
+    Eigen::VectorXd sum = Eigen::VectorXd::Zero(d);
+    Eigen::RowVectorXf shift;
+
+    // Double buffered: the next block is read while this one is reduced.
+    RowMatrixXf blocks[2] = { RowMatrixXf(m_blockRows, d), RowMatrixXf(m_blockRows, d) };
+    int current = 0;
+    size_t count = reader.read(blocks[current].data(), m_blockRows);
+    if (count > 0)
+        shift = blocks[current].row(0);
+
+    while (count > 0)
+    {
+        int next = 1 - current;
+        std::future<size_t> pending = std::async(std::launch::async, [&reader, &blocks, next, this]()
+        {
+            return reader.read(blocks[next].data(), m_blockRows);
+        });
+
+        // Shifting by the first row keeps the float products well conditioned.
+        RowMatrixXf::RowsBlockXpr x = blocks[current].topRows(count);
+        x.rowwise() -= shift;
+        sum += x.colwise().sum().transpose().cast<double>();
+
+        parallelFor(tiles.size(), [&](size_t begin, size_t end, int)
+        {
+            for (size_t t = begin; t < end; t++)
+            {
+                int i = tiles[t].first;
+                int j = tiles[t].second;
+                int rows = std::min(TileSize, d - i);
+                int cols = std::min(TileSize, d - j);
+                products[t].noalias() = x.middleCols(i, rows).transpose() * x.middleCols(j, cols);
+                scatter.block(i, j, rows, cols) += products[t].cast<double>();
+            }
+        }, 1);
+
+        m_rows += count;
+        count = pending.get();
+        current = next;
+        if (progress && !progress(CovarianceStage, m_rows))
+            return false;
+    }
+
+    if (!reader.errorString().empty() || m_rows < 2)
+        return false;
+
+    Eigen::VectorXd meanShift = sum / double(m_rows);
+    Eigen::MatrixXd full = scatter.selfadjointView<Eigen::Lower>();
+    m_covariance = (full - double(m_rows) * meanShift * meanShift.transpose()) / double(m_rows - 1);
+    m_mean = shift.transpose().cast<double>() + meanShift;
+    m_totalVariance = m_covariance.trace();
+    return true;
+}
+
+void DataPCA::solveEigen()
+{
+    int d = int(m_covariance.rows());
+    int k = std::max(1, std::min(m_componentCount, d));
+    int l = std::min(d, k + Oversampling);
+
+    Eigen::MatrixXd basis;
+    Eigen::MatrixXd reduced;
+    if (2 * l >= d)
+    {
+        // Small enough that the dense solve is the cheaper option.
+        basis = Eigen::MatrixXd::Identity(d, d);
+        reduced = m_covariance;
+    }
+    else
+    {
+        std::mt19937 rng(m_seed);
+        std::normal_distribution<double> normal;
+        Eigen::MatrixXd omega(d, l);
+        for (int c = 0; c < l; c++)
+            for (int r = 0; r < d; r++)
+                omega(r, c) = normal(rng);
+
+        basis = orthonormalize(m_covariance * omega);
+        for (int i = 0; i < m_powerIterations; i++)
+            basis = orthonormalize(m_covariance * basis);
+        reduced = basis.transpose() * m_covariance * basis;
+    }
+
+    // Eigenvalues come back ascending; keep the k largest, descending.
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(reduced);
+    int n = int(reduced.rows());
+    m_eigenvalues.resize(k);
+    Eigen::MatrixXd vectors(d, k);
+    for (int i = 0; i < k; i++)
+    {
+        m_eigenvalues(i) = std::max(0.0, solver.eigenvalues()(n - 1 - i));
+        Eigen::VectorXd v = basis * solver.eigenvectors().col(n - 1 - i);
+        // Fix the sign so the largest entry is positive.
+        Eigen::Index largest;
+        v.cwiseAbs().maxCoeff(&largest);
+        if (v(largest) < 0)
+            v = -v;
+        vectors.col(i) = v;
+    }
+    m_components = vectors.cast<float>();
+}
+
+bool DataPCA::project(MatrixReader& reader, const Progress& progress)
+{
+    if (!reader.rewind())
+        return false;
+
+    int d = int(m_components.rows());
+    int k = int(m_components.cols());
+    m_projections.resize(m_rows * k);
+    Eigen::RowVectorXf mean = m_mean.transpose().cast<float>();
+
+    RowMatrixXf blocks[2] = { RowMatrixXf(m_blockRows, d), RowMatrixXf(m_blockRows, d) };
+    int current = 0;
+    size_t row = 0;
+    size_t count = reader.read(blocks[current].data(), m_blockRows);
+    while (count > 0 && row < m_rows)
+    {
+        int next = 1 - current;
+        std::future<size_t> pending = std::async(std::launch::async, [&reader, &blocks, next, this]()
+        {
+            return reader.read(blocks[next].data(), m_blockRows);
+        });
+
+        count = std::min(count, m_rows - row);
+        Eigen::Map<RowMatrixXf> out(m_projections.data() + row * k, count, k);
+        RowMatrixXf& block = blocks[current];
+        parallelFor(count, [&](size_t begin, size_t end, int)
+        {
+            RowMatrixXf::RowsBlockXpr x = block.middleRows(begin, end - begin);
+            x.rowwise() -= mean;
+            out.middleRows(begin, end - begin).noalias() = x * m_components;
+        }, 256);
+
+        row += count;
+        count = pending.get();
+        current = next;
+        if (progress && !progress(ProjectionStage, row))
+            return false;
+    }
+
+    // The file changed between the passes.
+    if (row != m_rows || !reader.errorString().empty())
+    {
+        m_projections.clear();
+        return false;
+    }
+    return true;
+}
+
+PointSet DataPCA::projectedPair(int a, int b, float scale) const
+{
+    PointSet points;
+    int k = int(m_components.cols());
+    if (a < 0 || b < 0 || a >= k || b >= k || m_projections.empty())
+        return points;
+
+    points.x.resize(m_rows);
+    points.y.resize(m_rows);
+    const float* p = m_projections.data();
+    for (size_t i = 0; i < m_rows; i++)
+    {
+        points.x[i] = p[i * k + a] * scale;
+        points.y[i] = p[i * k + b] * scale;
+    }
+    return points;
+}
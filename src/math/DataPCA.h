@@ -0,0 +1,88 @@
+#ifndef DATAPCA_H
+#define DATAPCA_H
+
+#include <functional>
+#include <vector>
+#include <Eigen/Core>
+
+#include "MatrixReader.h"
+#include "PointSet.h"
+
+// Principal component analysis of tall N x D data streamed from a
+// MatrixReader.
+//
+// The first pass accumulates the D x D scatter matrix block by block with a
+// tiled symmetric rank-k update spread over threads while the next block is
+// read. The top components come from randomized subspace iteration (Halko,
+// Martinsson and Tropp 2011) on the covariance instead of a full
+// eigendecomposition. A second pass projects every row onto them.
+class DataPCA
+{
+public:
+    enum Stage
+    {
+        CovarianceStage = 0,
+        EigenStage,
+        ProjectionStage
+    };
+
+    // Called after every block with the rows processed so far in the current
+    // stage; returning false cancels the fit.
+    typedef std::function<bool(Stage stage, size_t rows)> Progress;
+
+    DataPCA();
+
+    void setComponentCount(int count) { m_componentCount = count; }
+    int componentCount() const { return m_componentCount; }
+    void setBlockRows(int rows) { m_blockRows = rows; }
+    void setPowerIterations(int iterations) { m_powerIterations = iterations; }
+    void setSeed(unsigned int seed) { m_seed = seed; }
+
+    // Returns false if cancelled, on a read error or with fewer than two rows.
+    bool fit(MatrixReader& reader, const Progress& progress = Progress());
+
+    size_t rows() const { return m_rows; }
+    int columns() const { return int(m_mean.size()); }
+    const Eigen::VectorXd& mean() const { return m_mean; }
+    const Eigen::MatrixXd& covariance() const { return m_covariance; }
+    // Trace of the covariance, i.e. the variance over all components.
+    double totalVariance() const { return m_totalVariance; }
+    // Top eigenvalues, descending, and the matching unit eigenvectors as the
+    // columns of a D x k matrix.
+    const Eigen::VectorXd& eigenvalues() const { return m_eigenvalues; }
+    const Eigen::MatrixXf& components() const { return m_components; }
+
+    // Row-major N x k coordinates of the centred rows in the component basis.
+    const std::vector<float>& projections() const { return m_projections; }
+    // Coordinates of every row on components a and b, multiplied by scale.
+    PointSet projectedPair(int a, int b, float scale = 1.0f) const;
+
+    double covarianceMs() const { return m_covarianceMs; }
+    double eigenMs() const { return m_eigenMs; }
+    double projectionMs() const { return m_projectionMs; }
+
+private:
+    bool accumulateScatter(MatrixReader& reader, const Progress& progress);
+    void solveEigen();
+    bool project(MatrixReader& reader, const Progress& progress);
+
+private:
+    int m_componentCount;
+    int m_blockRows;
+    int m_powerIterations;
+    unsigned int m_seed;
+
+    size_t m_rows;
+    Eigen::VectorXd m_mean;
+    Eigen::MatrixXd m_covariance;
+    double m_totalVariance;
+    Eigen::VectorXd m_eigenvalues;
+    Eigen::MatrixXf m_components;
+    std::vector<float> m_projections;
+
+    double m_covarianceMs;
+    double m_eigenMs;
+    double m_projectionMs;
+};
+
+#endif // DATAPCA_H
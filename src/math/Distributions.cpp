@@ -0,0 +1,103 @@
+#include "Distributions.h"
+#include "Parallel.h"
+
+#include <Eigen/LU>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const double Pi = 3.14159265358979323846;
+
+    void summarize(DistributionSamples& result)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < result.samples.size(); i++)
+            sum += result.samples[i].y();
+        result.avg = result.samples.empty() ? 0 : sum / result.samples.size();
+        result.var = 0;
+        for (size_t i = 0; i < result.samples.size(); i++)
+            result.var += (result.samples[i].y() - result.avg) * (result.samples[i].y() - result.avg);
+        if (!result.samples.empty())
+            result.var /= result.samples.size();
+        result.std = std::sqrt(result.var);
+    }
+}
+
+DistributionSamples bernoulliSamples(double probability, int count)
+{
+    DistributionSamples result;
+    result.samples.reserve(count + 1);
+    for (int i = 0; i <= count; i++)
+    {
+        double value = std::pow(probability, i) * std::pow(1 - probability, count - i);
+        result.samples.push_back(Eigen::Vector2f(float(i), float(value)));
+    }
+    summarize(result);
+    return result;
+}
+
+DistributionSamples normalSamples(double u, double sigma, double delta)
+{
+    DistributionSamples result;
+    int count = int(std::floor(20 / delta + 1e-6)) + 1;
+    result.samples.reserve(count);
+    double norm = std::sqrt(1 / (2 * Pi * sigma * sigma));
+    for (int k = 0; k < count; k++)
+    {
+        double i = -10 + k * delta;
+        double value = norm * std::exp(-1.0 / (2 * sigma * sigma) * (i - u) * (i - u));
+        result.samples.push_back(Eigen::Vector2f(float(i), float(value)));
+    }
+    summarize(result);
+    return result;
+}
+
+void evaluateNormal2D(const Eigen::Vector2f& mean, const Eigen::Matrix2f& covariance,
+    float left, float bottom, float step, int columns, int rows, float* density)
+{
+    Eigen::Matrix2f inverse = covariance.inverse();
+    const float qa = -0.5f * inverse(0, 0);
+    const float qb = -inverse(0, 1);
+    const float qc = -0.5f * inverse(1, 1);
+    const float norm = float(1.0 / (2 * Pi * std::sqrt(covariance.determinant())));
+    parallelFor(rows, [&](size_t begin, size_t end, int)
+    {
+        for (size_t row = begin; row < end; row++)
+        {
+            float* out = density + row * columns;
+            const float dy = bottom + row * step - mean.y();
+            const float cy = qc * dy * dy;
+            const float by = qb * dy;
+            for (int col = 0; col < columns; col++)
+            {
+                float dx = left + col * step - mean.x();
+                out[col] = norm * std::exp(qa * dx * dx + by * dx + cy);
+            }
+        }
+    }, 16);
+}
+
+std::vector<Eigen::Vector3f> normal2DGrid(double sigma, double delta)
+{
+    const float step = float(delta / 10);
+    const int count = int(std::floor(20 / delta + 1e-6)) + 1;
+    std::vector<float> density(size_t(count) * count);
+    evaluateNormal2D(Eigen::Vector2f::Zero(), Eigen::Matrix2f::Identity() * float(sigma),
+        -1, -1, step, count, count, density.data());
+
+    float min = *std::min_element(density.begin(), density.end());
+    float max = *std::max_element(density.begin(), density.end());
+    float range = max > min ? max - min : 1;
+    std::vector<Eigen::Vector3f> samples;
+    samples.reserve(density.size());
+    for (int row = 0; row < count; row++)
+    {
+        for (int col = 0; col < count; col++)
+        {
+            samples.push_back(Eigen::Vector3f(-1 + col * step, -1 + row * step,
+                (density[size_t(row) * count + col] - min) / range));
+        }
+    }
+    return samples;
+}
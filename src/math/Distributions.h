@@ -0,0 +1,33 @@
+#ifndef DISTRIBUTIONS_H
+#define DISTRIBUTIONS_H
+
+#include <vector>
+#include <Eigen/Core>
+
+// Sampled probability curves for the probability tool. Each sample is
+// (x, p(x)); avg, var and std summarize the sampled p values.
+struct DistributionSamples
+{
+    std::vector<Eigen::Vector2f> samples;
+    double avg;
+    double var;
+    double std;
+};
+
+// Probability of i successes in a fixed sequence of count trials, i = 0..count.
+DistributionSamples bernoulliSamples(double probability, int count);
+
+// N(u, sigma^2) sampled over [-10, 10] with spacing delta.
+DistributionSamples normalSamples(double u, double sigma, double delta);
+
+// Evaluates the N(mean, covariance) density on a columns x rows grid whose
+// first node is (left, bottom) and whose spacing is step. density is row
+// major, one float per node.
+void evaluateNormal2D(const Eigen::Vector2f& mean, const Eigen::Matrix2f& covariance,
+    float left, float bottom, float step, int columns, int rows, float* density);
+
+// N(0, sigma I) over [-1, 1]^2 with spacing delta / 10, as (x, y, density)
+// with the density rescaled to 0..1.
+std::vector<Eigen::Vector3f> normal2DGrid(double sigma, double delta);
+
+#endif // DISTRIBUTIONS_H
@@ -0,0 +1,153 @@
+#include "EigenSolvers.h"
+#include "Simd.h"
+
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Unit null vector of [a - l, b; c, d - l], picking the better
+    // conditioned row. Falls back to the x axis for a multiple of identity.
+    Eigen::Vector2f nullVector(float a, float b, float c, float d, float lambda)
+    {
+        Eigen::Vector2f v1(b, lambda - a);
+        Eigen::Vector2f v2(lambda - d, c);
+        Eigen::Vector2f v = v1.squaredNorm() >= v2.squaredNorm() ? v1 : v2;
+        float norm = v.norm();
+        if (norm <= 1e-30f)
+            return Eigen::Vector2f(1, 0);
+        return v / norm;
+    }
+
+    // Radius below which a tensor counts as isotropic.
+    const float Tiny = 1e-30f;
+
+#if defined(SIMD_AVX)
+    // Solves tensors in groups of 8 and returns how many were done.
+    SIMD_AVX_TARGET size_t symmetricEigen2Avx(const float* xx, const float* xy, const float* yy, size_t count,
+        float* major, float* minor, float* cos2, float* sin2)
+    {
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 tiny = _mm256_set1_ps(Tiny);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 a = _mm256_loadu_ps(xx + i);
+            __m256 b = _mm256_loadu_ps(xy + i);
+            __m256 c = _mm256_loadu_ps(yy + i);
+            __m256 mean = _mm256_mul_ps(half, _mm256_add_ps(a, c));
+            __m256 difference = _mm256_mul_ps(half, _mm256_sub_ps(a, c));
+            __m256 radius = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(difference, difference), _mm256_mul_ps(b, b)));
+            __m256 inverse = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(radius, tiny));
+            _mm256_storeu_ps(major + i, _mm256_add_ps(mean, radius));
+            _mm256_storeu_ps(minor + i, _mm256_sub_ps(mean, radius));
+            _mm256_storeu_ps(cos2 + i, _mm256_mul_ps(difference, inverse));
+            _mm256_storeu_ps(sin2 + i, _mm256_mul_ps(b, inverse));
+        }
+        return i;
+    }
+#endif
+
+#if defined(SIMD_SSE2)
+    // Solves tensors in groups of 4 and returns how many were done.
+    size_t symmetricEigen2Sse2(const float* xx, const float* xy, const float* yy, size_t count,
+        float* major, float* minor, float* cos2, float* sin2)
+    {
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 tiny = _mm_set1_ps(Tiny);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 a = _mm_loadu_ps(xx + i);
+            __m128 b = _mm_loadu_ps(xy + i);
+            __m128 c = _mm_loadu_ps(yy + i);
+            __m128 mean = _mm_mul_ps(half, _mm_add_ps(a, c));
+            __m128 difference = _mm_mul_ps(half, _mm_sub_ps(a, c));
+            __m128 radius = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(difference, difference), _mm_mul_ps(b, b)));
+            __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(radius, tiny));
+            _mm_storeu_ps(major + i, _mm_add_ps(mean, radius));
+            _mm_storeu_ps(minor + i, _mm_sub_ps(mean, radius));
+            _mm_storeu_ps(cos2 + i, _mm_mul_ps(difference, inverse));
+            _mm_storeu_ps(sin2 + i, _mm_mul_ps(b, inverse));
+        }
+        return i;
+    }
+#endif
+}
+
+void symmetricEigen2(const Eigen::Matrix2f& matrix, Eigen::Vector2f& values, Eigen::Matrix2f& vectors)
+{
+    float a = matrix(0, 0);
+    float b = matrix(0, 1);
+    float d = matrix(1, 1);
+    float half = 0.5f * (a + d);
+    float halfDifference = 0.5f * (a - d);
+    float radius = std::sqrt(halfDifference * halfDifference + b * b);
+    values = Eigen::Vector2f(half + radius, half - radius);
+
+    Eigen::Vector2f major = nullVector(a, b, b, d, values.x());
+    vectors.col(0) = major;
+    vectors.col(1) = Eigen::Vector2f(-major.y(), major.x());
+}
+
+void symmetricEigen2Batch(const float* xx, const float* xy, const float* yy, size_t count,
+    float* major, float* minor, float* cos2, float* sin2)
+{
+    size_t i = 0;
+#if defined(SIMD_AVX)
+    if (cpuHasAvx())
+        i = symmetricEigen2Avx(xx, xy, yy, count, major, minor, cos2, sin2);
+#endif
+#if defined(SIMD_SSE2)
+    i += symmetricEigen2Sse2(xx + i, xy + i, yy + i, count - i, major + i, minor + i, cos2 + i, sin2 + i);
+#endif
+    for (; i < count; i++)
+    {
+        float mean = 0.5f * (xx[i] + yy[i]);
+        float difference = 0.5f * (xx[i] - yy[i]);
+        float radius = std::sqrt(difference * difference + xy[i] * xy[i]);
+        float inverse = 1.0f / std::max(radius, Tiny);
+        major[i] = mean + radius;
+        minor[i] = mean - radius;
+        cos2[i] = difference * inverse;
+        sin2[i] = xy[i] * inverse;
+    }
+}
+
+void symmetricEigen3(const Eigen::Matrix3f& matrix, Eigen::Vector3f& values, Eigen::Matrix3f& vectors)
+{
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver;
+    solver.computeDirect(matrix);
+    // Eigen sorts ascending.
+    values = solver.eigenvalues().reverse();
+    vectors = solver.eigenvectors().rowwise().reverse();
+}
+
+bool eigen2(const Eigen::Matrix2f& matrix, Eigen::Vector2f& values, Eigen::Matrix2f& vectors)
+{
+    float a = matrix(0, 0);
+    float b = matrix(0, 1);
+    float c = matrix(1, 0);
+    float d = matrix(1, 1);
+    float half = 0.5f * (a + d);
+    float discriminant = 0.25f * (a - d) * (a - d) + b * c;
+    if (discriminant < 0)
+    {
+        Eigen::EigenSolver<Eigen::Matrix2f> solver(matrix);
+        values = solver.eigenvalues().real();
+        vectors = solver.eigenvectors().real();
+        return false;
+    }
+
+    float radius = std::sqrt(discriminant);
+    values = Eigen::Vector2f(half + radius, half - radius);
+    vectors.col(0) = nullVector(a, b, c, d, values.x());
+    vectors.col(1) = nullVector(a, b, c, d, values.y());
+    if (radius <= 1e-7f * std::max(std::abs(half), 1.0f) && std::abs(vectors.col(0).dot(vectors.col(1))) > 0.999f)
+    {
+        // Repeated eigenvalue: keep the two columns distinct.
+        vectors.col(1) = Eigen::Vector2f(-vectors(1, 0), vectors(0, 0));
+    }
+    return true;
+}
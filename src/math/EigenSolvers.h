@@ -0,0 +1,29 @@
+#ifndef EIGENSOLVERS_H
+#define EIGENSOLVERS_H
+
+#include <cstddef>
+#include <Eigen/Core>
+
+// Closed-form eigen decompositions for the small matrices the tools draw.
+// Eigenvalues come back in descending order with unit eigenvectors in the
+// matching columns.
+
+// Symmetric 2x2 (covariance) matrix.
+void symmetricEigen2(const Eigen::Matrix2f& matrix, Eigen::Vector2f& values, Eigen::Matrix2f& vectors);
+
+// Batched symmetric 2x2 solve over count tensors [[xx, xy], [xy, yy]] held
+// in separate planes, vectorized with AVX when the CPU has it and SSE2
+// otherwise. Writes both eigenvalues and the major eigenvector as its doubled
+// angle (cos 2t, sin 2t), which is continuous across the t / t + pi sign
+// ambiguity; isotropic tensors get (0, 0).
+void symmetricEigen2Batch(const float* xx, const float* xy, const float* yy, size_t count,
+    float* major, float* minor, float* cos2, float* sin2);
+
+// Symmetric 3x3 (colour scatter) matrix.
+void symmetricEigen3(const Eigen::Matrix3f& matrix, Eigen::Vector3f& values, Eigen::Matrix3f& vectors);
+
+// General real 2x2 matrix. Returns false when the eigenvalues are complex;
+// values and vectors then hold the real parts, as Eigen::EigenSolver does.
+bool eigen2(const Eigen::Matrix2f& matrix, Eigen::Vector2f& values, Eigen::Matrix2f& vectors);
+
+#endif // EIGENSOLVERS_H
@@ -0,0 +1,264 @@
+#include "GaussianMixture.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace
+{
+    // Points per E-step block. Small enough that the block's K columns of
+    // log-densities stay in L1.
+    const int BlockSize = 256;
+
+    // Sufficient statistics per component: sum r, r x, r y, r xx, r xy, r yy.
+    const int StatCount = 6;
+
+    const double TwoPi = 6.283185307179586;
+}
+
+GaussianMixture::GaussianMixture()
+    : m_componentCount(3)
+    , m_maxIterations(100)
+    , m_tolerance(1e-6)
+    , m_seed(5489u)
+    , m_logLikelihood(0)
+    , m_iterations(0)
+    , m_converged(false)
+{
+}
+
+bool GaussianMixture::fit(const PointSet& points, const Progress& progress)
+{
+    const size_t count = points.size();
+    const int k = std::max(m_componentCount, 1);
+    m_components.clear();
+    m_logLikelihood = 0;
+    m_iterations = 0;
+    m_converged = false;
+    if (count < size_t(k))
+        return false;
+
+    const float* xs = points.x.data();
+    const float* ys = points.y.data();
+
+    // Global mean and covariance. Statistics are accumulated relative to the
+    // mean to avoid cancellation in the float block sums.
+    std::vector<Eigen::Matrix<double, 5, 1>> moments(parallelChunks(count));
+    parallelFor(count, [&](size_t begin, size_t end, int chunk)
+    {
+        Eigen::Matrix<double, 5, 1> m = Eigen::Matrix<double, 5, 1>::Zero();
+        for (size_t i = begin; i < end; i++)
+        {
+            double x = xs[i];
+            double y = ys[i];
+            m += Eigen::Matrix<double, 5, 1>(x, y, x * x, x * y, y * y);
+        }
+        moments[chunk] = m;
+    });
+    Eigen::Matrix<double, 5, 1> total = Eigen::Matrix<double, 5, 1>::Zero();
+    for (size_t i = 0; i < moments.size(); i++)
+        total += moments[i];
+    total /= double(count);
+    const float shiftX = float(total(0));
+    const float shiftY = float(total(1));
+    Eigen::Matrix2f globalCov;
+    globalCov << float(total(2) - total(0) * total(0)), float(total(3) - total(0) * total(1)),
+                 float(total(3) - total(0) * total(1)), float(total(4) - total(1) * total(1));
+    const float regularization = std::max(globalCov.trace() * 1e-6f, 1e-12f);
+    globalCov += Eigen::Matrix2f::Identity() * regularization;
+
+    // k-means++ style seeding on a random subsample.
+    std::mt19937 rng(m_seed);
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    std::vector<Eigen::Vector2f> sample(std::min<size_t>(count, 4096));
+    for (size_t i = 0; i < sample.size(); i++)
+    {
+        size_t index = pick(rng);
+        sample[i] = Eigen::Vector2f(xs[index], ys[index]);
+    }
+    std::vector<float> distances(sample.size(), std::numeric_limits<float>::max());
+    m_components.resize(k);
+    for (int c = 0; c < k; c++)
+    {
+        size_t chosen = 0;
+        if (c == 0)
+        {
+            chosen = pick(rng) % sample.size();
+        }
+        else
+        {
+            double mass = 0;
+            for (size_t i = 0; i < distances.size(); i++)
+                mass += distances[i];
+            if (mass > 0)
+            {
+                std::discrete_distribution<size_t> weighted(distances.begin(), distances.end());
+                chosen = weighted(rng);
+            }
+            else
+            {
+                chosen = pick(rng) % sample.size();
+            }
+        }
+        m_components[c].mean = sample[chosen];
+        m_components[c].covariance = globalCov;
+        m_components[c].weight = 1.0f / k;
+        for (size_t i = 0; i < sample.size(); i++)
+            distances[i] = std::min(distances[i], (sample[i] - sample[chosen]).squaredNorm());
+    }
+
+    const int chunks = parallelChunks(count);
+    std::vector<Eigen::MatrixXd> stats(chunks);
+    std::vector<double> logLikelihoods(chunks);
+    Eigen::ArrayXf meanX(k), meanY(k), qa(k), qb(k), qc(k), constant(k);
+    double previous = -std::numeric_limits<double>::infinity();
+
+    for (int iteration = 0; iteration < m_maxIterations; iteration++)
+    {
+        // log N(x | mu, S) + log w = constant - 0.5 * d^T S^-1 d, expanded so
+        // the quadratic form is qa dx^2 + qb dx dy + qc dy^2.
+        for (int c = 0; c < k; c++)
+        {
+            const GaussianComponent& g = m_components[c];
+            float a = g.covariance(0, 0);
+            float b = g.covariance(0, 1);
+            float d = g.covariance(1, 1);
+            float det = a * d - b * b;
+            meanX(c) = g.mean.x();
+            meanY(c) = g.mean.y();
+            qa(c) = -0.5f * d / det;
+            qb(c) = b / det;
+            qc(c) = -0.5f * a / det;
+            constant(c) = std::log(g.weight) - float(std::log(TwoPi)) - 0.5f * std::log(det);
+        }
+
+        // Fused E-step and M-step reductions. The block keeps one contiguous
+        // row of log-densities per component so every pass below is a flat,
+        // vectorized loop over points.
+        parallelFor(count, [&](size_t begin, size_t end, int chunk)
+        {
+            typedef Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> BlockArray;
+            BlockArray logP(k, BlockSize);
+            Eigen::ArrayXf maxLogP(BlockSize);
+            Eigen::ArrayXf total(BlockSize);
+            Eigen::ArrayXf dx(BlockSize);
+            Eigen::ArrayXf dy(BlockSize);
+            Eigen::ArrayXf dxx(BlockSize);
+            Eigen::ArrayXf dxy(BlockSize);
+            Eigen::ArrayXf dyy(BlockSize);
+            Eigen::MatrixXd& acc = stats[chunk];
+            acc.setZero(k, StatCount);
+            double logLikelihood = 0;
+
+            for (size_t start = begin; start < end; start += BlockSize)
+            {
+                const int n = int(std::min<size_t>(BlockSize, end - start));
+                Eigen::Map<const Eigen::ArrayXf> px(xs + start, n);
+                Eigen::Map<const Eigen::ArrayXf> py(ys + start, n);
+
+                for (int c = 0; c < k; c++)
+                {
+                    dx.head(n) = px - meanX(c);
+                    dy.head(n) = py - meanY(c);
+                    logP.row(c).head(n) = (constant(c) + qa(c) * dx.head(n).square()
+                        + qb(c) * dx.head(n) * dy.head(n) + qc(c) * dy.head(n).square()).transpose();
+                }
+
+                // log-sum-exp over components; after normalization the rows
+                // hold the responsibilities.
+                maxLogP.head(n) = logP.row(0).head(n).transpose();
+                for (int c = 1; c < k; c++)
+                    maxLogP.head(n) = maxLogP.head(n).max(logP.row(c).head(n).transpose());
+                total.head(n).setZero();
+                for (int c = 0; c < k; c++)
+                {
+                    logP.row(c).head(n) = (logP.row(c).head(n) - maxLogP.head(n).transpose()).exp();
+                    total.head(n) += logP.row(c).head(n).transpose();
+                }
+                logLikelihood += (maxLogP.head(n) + total.head(n).log()).sum();
+                total.head(n) = total.head(n).inverse();
+
+                dx.head(n) = px - shiftX;
+                dy.head(n) = py - shiftY;
+                dxx.head(n) = dx.head(n).square();
+                dxy.head(n) = dx.head(n) * dy.head(n);
+                dyy.head(n) = dy.head(n).square();
+                for (int c = 0; c < k; c++)
+                {
+                    logP.row(c).head(n) *= total.head(n).transpose();
+                    Eigen::Map<const Eigen::ArrayXf> r(logP.row(c).data(), n);
+                    acc(c, 0) += r.sum();
+                    acc(c, 1) += (r * dx.head(n)).sum();
+                    acc(c, 2) += (r * dy.head(n)).sum();
+                    acc(c, 3) += (r * dxx.head(n)).sum();
+                    acc(c, 4) += (r * dxy.head(n)).sum();
+                    acc(c, 5) += (r * dyy.head(n)).sum();
+                }
+            }
+            logLikelihoods[chunk] = logLikelihood;
+        });
+
+        Eigen::MatrixXd sum = Eigen::MatrixXd::Zero(k, StatCount);
+        double logLikelihood = 0;
+        for (int i = 0; i < chunks; i++)
+        {
+            sum += stats[i];
+            logLikelihood += logLikelihoods[i];
+        }
+
+        // M-step. Components that lost all their mass are re-seeded.
+        float weightSum = 0;
+        bool reseeded = false;
+        for (int c = 0; c < k; c++)
+        {
+            GaussianComponent& g = m_components[c];
+            double nk = sum(c, 0);
+            if (nk < 1e-9 * count + 1e-3)
+            {
+                reseeded = true;
+                size_t index = pick(rng);
+                g.mean = Eigen::Vector2f(xs[index], ys[index]);
+                g.covariance = globalCov;
+                g.weight = 1.0f / k;
+            }
+            else
+            {
+                double mx = sum(c, 1) / nk;
+                double my = sum(c, 2) / nk;
+                double sxx = sum(c, 3) / nk - mx * mx;
+                double sxy = sum(c, 4) / nk - mx * my;
+                double syy = sum(c, 5) / nk - my * my;
+                g.mean = Eigen::Vector2f(float(mx) + shiftX, float(my) + shiftY);
+                g.covariance << float(sxx) + regularization, float(sxy),
+                                float(sxy), float(syy) + regularization;
+                g.weight = float(nk / count);
+            }
+            weightSum += g.weight;
+        }
+        for (int c = 0; c < k; c++)
+            m_components[c].weight /= weightSum;
+
+        m_iterations = iteration + 1;
+        m_logLikelihood = logLikelihood;
+
+        if (progress && !progress(m_iterations, logLikelihood))
+            return false;
+
+        // A re-seeded component has not been fitted yet, and the likelihood
+        // usually drops next time, so this iteration cannot be a convergence.
+        if (reseeded)
+        {
+            previous = -std::numeric_limits<double>::infinity();
+            continue;
+        }
+        if ((logLikelihood - previous) / count < m_tolerance)
+        {
+            m_converged = true;
+            break;
+        }
+        previous = logLikelihood;
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef GAUSSIANMIXTURE_H
+#define GAUSSIANMIXTURE_H
+
+#include <functional>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include "PointSet.h"
+
+struct GaussianComponent
+{
+    float weight;
+    Eigen::Vector2f mean;
+    Eigen::Matrix2f covariance;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<GaussianComponent, Eigen::aligned_allocator<GaussianComponent>> GaussianComponents;
+
+// K-component 2D Gaussian mixture fitted with expectation maximization.
+//
+// Each iteration streams the points once: responsibilities are computed per
+// block of SoA points in log space (log-sum-exp) and immediately reduced into
+// per-thread sufficient statistics, so no N x K responsibility matrix is kept.
+class GaussianMixture
+{
+public:
+    // Called after every iteration; returning false cancels the fit.
+    typedef std::function<bool(int iteration, double logLikelihood)> Progress;
+
+    GaussianMixture();
+
+    void setComponentCount(int count) { m_componentCount = count; }
+    int componentCount() const { return m_componentCount; }
+    void setMaxIterations(int iterations) { m_maxIterations = iterations; }
+    int maxIterations() const { return m_maxIterations; }
+    // Stop when the mean log-likelihood per point improves by less than this.
+    void setTolerance(double tolerance) { m_tolerance = tolerance; }
+    void setSeed(unsigned int seed) { m_seed = seed; }
+
+    // Returns false if cancelled or there are fewer points than components.
+    bool fit(const PointSet& points, const Progress& progress = Progress());
+
+    const GaussianComponents& components() const { return m_components; }
+    double logLikelihood() const { return m_logLikelihood; }
+    int iterations() const { return m_iterations; }
+    bool converged() const { return m_converged; }
+
+private:
+    int m_componentCount;
+    int m_maxIterations;
+    double m_tolerance;
+    unsigned int m_seed;
+
+    GaussianComponents m_components;
+    double m_logLikelihood;
+    int m_iterations;
+    bool m_converged;
+};
+
+#endif // GAUSSIANMIXTURE_H
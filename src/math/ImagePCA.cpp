@@ -0,0 +1,114 @@
+#include "ImagePCA.h"
+#include "EigenSolvers.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <vector>
+
+ImagePCA::ImagePCA()
+    : m_scatter(Eigen::Matrix3f::Zero())
+    , m_axis(Eigen::Vector3f::Constant(0.57735027f))
+    , m_maxProjection(255 * 3 * 0.57735027f)
+{
+}
+
+void ImagePCA::computeBasis(const uint8_t* rgb, int width, int height, int stride)
+{
+    // Products of 8-bit channels are summed exactly in 64-bit integers.
+    std::vector<std::vector<uint64_t>> sums(parallelChunks(height, 8));
+    parallelFor(height, [&](size_t begin, size_t end, int chunk)
+    {
+        uint64_t rr = 0, rg = 0, rb = 0, gg = 0, gb = 0, bb = 0;
+        for (size_t i = begin; i < end; i++)
+        {
+            const uint8_t* p = rgb + i * stride;
+            for (int j = 0; j < width; j++, p += 3)
+            {
+                uint32_t r = p[0];
+                uint32_t g = p[1];
+                uint32_t b = p[2];
+                rr += r * r;
+                rg += r * g;
+                rb += r * b;
+                gg += g * g;
+                gb += g * b;
+                bb += b * b;
+            }
+        }
+        uint64_t values[] = { rr, rg, rb, gg, gb, bb };
+        sums[chunk].assign(values, values + 6);
+    }, 8);
+
+    uint64_t total[6] = { 0, 0, 0, 0, 0, 0 };
+    for (size_t i = 0; i < sums.size(); i++)
+    {
+        for (size_t j = 0; j < sums[i].size(); j++)
+            total[j] += sums[i][j];
+    }
+    m_scatter << float(total[0]), float(total[1]), float(total[2]),
+                 float(total[1]), float(total[3]), float(total[4]),
+                 float(total[2]), float(total[4]), float(total[5]);
+
+    Eigen::Vector3f values;
+    Eigen::Matrix3f vectors;
+    symmetricEigen3(m_scatter, values, vectors);
+    setAxis(vectors.col(0));
+}
+
+void ImagePCA::setAxis(const Eigen::Vector3f& axis)
+{
+    // The principal axis of non-negative colours lies in the positive octant
+    // up to sign; fix the sign so brighter pixels encode to larger values.
+    m_axis = axis.normalized();
+    if (m_axis.sum() < 0)
+        m_axis = -m_axis;
+    m_maxProjection = 255 * m_axis.sum();
+}
+
+void ImagePCA::encode(const uint8_t* rgb, int width, int height, int stride,
+    float* projection, uint8_t* gray, int grayStride) const
+{
+    const float dr = m_axis.x();
+    const float dg = m_axis.y();
+    const float db = m_axis.z();
+    const float scale = m_maxProjection > 0 ? 255 / m_maxProjection : 0;
+    parallelFor(height, [&](size_t begin, size_t end, int)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const uint8_t* p = rgb + i * stride;
+            float* out = projection ? projection + i * width : nullptr;
+            uint8_t* g = gray ? gray + i * grayStride : nullptr;
+            for (int j = 0; j < width; j++, p += 3)
+            {
+                float value = dr * p[0] + dg * p[1] + db * p[2];
+                if (out)
+                    out[j] = value;
+                if (g)
+                    g[j] = uint8_t(std::min(std::max(value * scale, 0.0f), 255.0f));
+            }
+        }
+    }, 8);
+}
+
+void ImagePCA::decode(const float* projection, int width, int height, uint8_t* rgb, int stride) const
+{
+    const float dr = m_axis.x();
+    const float dg = m_axis.y();
+    const float db = m_axis.z();
+    parallelFor(height, [&](size_t begin, size_t end, int)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const float* in = projection + i * width;
+            uint8_t* p = rgb + i * stride;
+            for (int j = 0; j < width; j++, p += 3)
+            {
+                float value = in[j];
+                p[0] = uint8_t(std::min(std::max(dr * value, 0.0f), 255.0f));
+                p[1] = uint8_t(std::min(std::max(dg * value, 0.0f), 255.0f));
+                p[2] = uint8_t(std::min(std::max(db * value, 0.0f), 255.0f));
+            }
+        }
+    }, 8);
+}
@@ -0,0 +1,35 @@
+#ifndef IMAGEPCA_H
+#define IMAGEPCA_H
+
+#include <cstdint>
+#include <Eigen/Core>
+
+// Colour PCA of an 8-bit interleaved RGB image: every pixel is projected onto
+// the principal axis of the uncentred colour scatter X X^T, giving a single
+// grey plane, and decoded back to RGB along the same axis.
+class ImagePCA
+{
+public:
+    ImagePCA();
+
+    // stride is the row pitch in bytes; pixels are R, G, B.
+    void computeBasis(const uint8_t* rgb, int width, int height, int stride);
+    void setAxis(const Eigen::Vector3f& axis);
+
+    const Eigen::Matrix3f& scatter() const { return m_scatter; }
+    const Eigen::Vector3f& axis() const { return m_axis; }
+    // Projection of white, used to scale the grey plane to 0..255.
+    float maxProjection() const { return m_maxProjection; }
+
+    // Either output may be null. projection is width * height floats.
+    void encode(const uint8_t* rgb, int width, int height, int stride,
+        float* projection, uint8_t* gray, int grayStride) const;
+    void decode(const float* projection, int width, int height, uint8_t* rgb, int stride) const;
+
+private:
+    Eigen::Matrix3f m_scatter;
+    Eigen::Vector3f m_axis;
+    float m_maxProjection;
+};
+
+#endif // IMAGEPCA_H
@@ -0,0 +1,413 @@
+#include "KMeans.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    // Points per assignment block; labels and distances live on the stack.
+    const int BlockSize = 256;
+
+#if defined(SIMD_AVX)
+    // Assigns points in groups of 8 and returns how many were done.
+    SIMD_AVX_TARGET int nearestCentroidsAvx(const float* xs, const float* ys, int n,
+        const float* mx, const float* my, const float* cc, int count,
+        int* labels, float* distances)
+    {
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 px = _mm256_loadu_ps(xs + i);
+            __m256 py = _mm256_loadu_ps(ys + i);
+            __m256 best = _mm256_set1_ps(FLT_MAX);
+            __m256 bestLabel = _mm256_setzero_ps();
+            for (int c = 0; c < count; c++)
+            {
+                __m256 d = _mm256_add_ps(_mm256_set1_ps(cc[c]),
+                    _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(mx[c])), _mm256_mul_ps(py, _mm256_set1_ps(my[c]))));
+                __m256 closer = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+                best = _mm256_min_ps(d, best);
+                // Masked select rather than blendv, which GCC scalarizes in
+                // target("avx") functions.
+                bestLabel = _mm256_or_ps(_mm256_and_ps(closer, _mm256_set1_ps(float(c))), _mm256_andnot_ps(closer, bestLabel));
+            }
+            __m256 norm = _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py));
+            _mm256_storeu_ps(distances + i, _mm256_max_ps(_mm256_add_ps(best, norm), _mm256_setzero_ps()));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(labels + i), _mm256_cvtps_epi32(bestLabel));
+        }
+        return i;
+    }
+#endif
+
+#if defined(SIMD_SSE2)
+    // Assigns points in groups of 4 and returns how many were done.
+    int nearestCentroidsSse2(const float* xs, const float* ys, int n,
+        const float* mx, const float* my, const float* cc, int count,
+        int* labels, float* distances)
+    {
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 px = _mm_loadu_ps(xs + i);
+            __m128 py = _mm_loadu_ps(ys + i);
+            __m128 best = _mm_set1_ps(FLT_MAX);
+            __m128i bestLabel = _mm_setzero_si128();
+            for (int c = 0; c < count; c++)
+            {
+                __m128 d = _mm_add_ps(_mm_set1_ps(cc[c]),
+                    _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(mx[c])), _mm_mul_ps(py, _mm_set1_ps(my[c]))));
+                __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+                best = _mm_min_ps(d, best);
+                bestLabel = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(c)), _mm_andnot_si128(closer, bestLabel));
+            }
+            __m128 norm = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+            _mm_storeu_ps(distances + i, _mm_max_ps(_mm_add_ps(best, norm), _mm_setzero_ps()));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(labels + i), bestLabel);
+        }
+        return i;
+    }
+#endif
+}
+
+void nearestCentroids(const float* xs, const float* ys, int n,
+    const float* mx, const float* my, const float* cc, int count,
+    int* labels, float* distances)
+{
+    int i = 0;
+#if defined(SIMD_AVX)
+    if (cpuHasAvx())
+        i = nearestCentroidsAvx(xs, ys, n, mx, my, cc, count, labels, distances);
+#endif
+#if defined(SIMD_SSE2)
+    // Whatever the AVX kernel left, in groups of 4.
+    i += nearestCentroidsSse2(xs + i, ys + i, n - i, mx, my, cc, count, labels + i, distances + i);
+#endif
+    for (; i < n; i++)
+    {
+        float best = FLT_MAX;
+        int bestLabel = 0;
+        for (int c = 0; c < count; c++)
+        {
+            float d = cc[c] + xs[i] * mx[c] + ys[i] * my[c];
+            if (d < best)
+            {
+                best = d;
+                bestLabel = c;
+            }
+        }
+        distances[i] = std::max(0.0f, best + xs[i] * xs[i] + ys[i] * ys[i]);
+        labels[i] = bestLabel;
+    }
+}
+
+KMeans::KMeans()
+    : m_clusterCount(8)
+    , m_algorithm(Lloyd)
+    , m_maxIterations(100)
+    , m_batchSize(10000)
+    , m_tolerance(1e-6)
+    , m_seed(5489u)
+    , m_inertia(0)
+    , m_iterations(0)
+    , m_converged(false)
+{
+}
+
+bool KMeans::fit(const PointSet& points, const Progress& progress)
+{
+    const size_t count = points.size();
+    const int k = std::max(m_clusterCount, 1);
+    m_centroidsX.clear();
+    m_centroidsY.clear();
+    m_clusters.clear();
+    m_iterationTimes.clear();
+    m_inertia = 0;
+    m_iterations = 0;
+    m_converged = false;
+    if (count < size_t(k))
+        return false;
+
+    m_rng.seed(m_seed);
+    double threshold = m_tolerance * seed(points);
+    std::vector<float> counts(k, 0.0f);
+
+    for (int iteration = 0; iteration < m_maxIterations; iteration++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double shift = m_algorithm == MiniBatch ? miniBatchStep(points, counts) : lloydStep(points);
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        m_iterationTimes.push_back(milliseconds);
+        m_iterations = iteration + 1;
+        if (progress && !progress(m_iterations, m_inertia, milliseconds))
+            return false;
+
+        if (shift <= threshold)
+        {
+            m_converged = true;
+            break;
+        }
+    }
+
+    summarize(points);
+    return true;
+}
+
+double KMeans::seed(const PointSet& points)
+{
+    // k-means++ on a random subsample; a full pass per seed is too slow for
+    // k in the hundreds over millions of points.
+    const size_t count = points.size();
+    const int k = std::max(m_clusterCount, 1);
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    size_t sampleSize = std::min(count, std::max<size_t>(10000, size_t(k) * 50));
+    std::vector<float> sx(sampleSize);
+    std::vector<float> sy(sampleSize);
+    double meanX = 0;
+    double meanY = 0;
+    for (size_t i = 0; i < sampleSize; i++)
+    {
+        size_t index = pick(m_rng);
+        sx[i] = points.x[index];
+        sy[i] = points.y[index];
+        meanX += sx[i];
+        meanY += sy[i];
+    }
+    meanX /= sampleSize;
+    meanY /= sampleSize;
+    double variance = 0;
+    for (size_t i = 0; i < sampleSize; i++)
+        variance += (sx[i] - meanX) * (sx[i] - meanX) + (sy[i] - meanY) * (sy[i] - meanY);
+    variance /= sampleSize;
+
+    std::vector<float> distances(sampleSize, FLT_MAX);
+    m_centroidsX.resize(k);
+    m_centroidsY.resize(k);
+    for (int c = 0; c < k; c++)
+    {
+        size_t chosen = pick(m_rng) % sampleSize;
+        if (c > 0)
+        {
+            double mass = 0;
+            for (size_t i = 0; i < sampleSize; i++)
+                mass += distances[i];
+            if (mass > 0)
+            {
+                std::discrete_distribution<size_t> weighted(distances.begin(), distances.end());
+                chosen = weighted(m_rng);
+            }
+        }
+        m_centroidsX[c] = sx[chosen];
+        m_centroidsY[c] = sy[chosen];
+        for (size_t i = 0; i < sampleSize; i++)
+        {
+            float dx = sx[i] - sx[chosen];
+            float dy = sy[i] - sy[chosen];
+            distances[i] = std::min(distances[i], dx * dx + dy * dy);
+        }
+    }
+    return variance;
+}
+
+void KMeans::prepareCentroids()
+{
+    size_t k = m_centroidsX.size();
+    m_scaledX.resize(k);
+    m_scaledY.resize(k);
+    m_squaredNorms.resize(k);
+    for (size_t c = 0; c < k; c++)
+    {
+        m_scaledX[c] = -2 * m_centroidsX[c];
+        m_scaledY[c] = -2 * m_centroidsY[c];
+        m_squaredNorms[c] = m_centroidsX[c] * m_centroidsX[c] + m_centroidsY[c] * m_centroidsY[c];
+    }
+}
+
+double KMeans::lloydStep(const PointSet& points)
+{
+    const size_t count = points.size();
+    const int k = int(m_centroidsX.size());
+    prepareCentroids();
+
+    // Per-thread accumulators: sum x, sum y and count per centroid.
+    const int chunks = parallelChunks(count);
+    std::vector<std::vector<double>> sums(chunks);
+    std::vector<double> inertias(chunks);
+    parallelFor(count, [&](size_t begin, size_t end, int chunk)
+    {
+        std::vector<double>& sum = sums[chunk];
+        sum.assign(size_t(k) * 3, 0.0);
+        int labels[BlockSize];
+        float distances[BlockSize];
+        double inertia = 0;
+        for (size_t start = begin; start < end; start += BlockSize)
+        {
+            int n = int(std::min<size_t>(BlockSize, end - start));
+            const float* xs = points.x.data() + start;
+            const float* ys = points.y.data() + start;
+            nearestCentroids(xs, ys, n, m_scaledX.data(), m_scaledY.data(), m_squaredNorms.data(), k, labels, distances);
+            for (int i = 0; i < n; i++)
+            {
+                double* s = sum.data() + labels[i] * 3;
+                s[0] += xs[i];
+                s[1] += ys[i];
+                s[2] += 1;
+                inertia += distances[i];
+            }
+        }
+        inertias[chunk] = inertia;
+    });
+
+    std::vector<double> total(size_t(k) * 3, 0.0);
+    m_inertia = 0;
+    for (int i = 0; i < chunks; i++)
+    {
+        for (size_t j = 0; j < total.size(); j++)
+            total[j] += sums[i][j];
+        m_inertia += inertias[i];
+    }
+
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    double shift = 0;
+    for (int c = 0; c < k; c++)
+    {
+        float x;
+        float y;
+        if (total[c * 3 + 2] > 0)
+        {
+            x = float(total[c * 3] / total[c * 3 + 2]);
+            y = float(total[c * 3 + 1] / total[c * 3 + 2]);
+        }
+        else
+        {
+            // Empty cluster: restart it on a random point.
+            size_t index = pick(m_rng);
+            x = points.x[index];
+            y = points.y[index];
+        }
+        shift += (x - m_centroidsX[c]) * (x - m_centroidsX[c]) + (y - m_centroidsY[c]) * (y - m_centroidsY[c]);
+        m_centroidsX[c] = x;
+        m_centroidsY[c] = y;
+    }
+    return shift / k;
+}
+
+double KMeans::miniBatchStep(const PointSet& points, std::vector<float>& counts)
+{
+    const size_t count = points.size();
+    const int k = int(m_centroidsX.size());
+    const int batch = int(std::min<size_t>(count, size_t(std::max(m_batchSize, k))));
+    prepareCentroids();
+
+    // Gather the batch into SoA buffers so the assignment kernel streams.
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    std::vector<float> bx(batch);
+    std::vector<float> by(batch);
+    for (int i = 0; i < batch; i++)
+    {
+        size_t index = pick(m_rng);
+        bx[i] = points.x[index];
+        by[i] = points.y[index];
+    }
+
+    std::vector<int> labels(batch);
+    std::vector<float> distances(batch);
+    parallelFor(size_t(batch), [&](size_t begin, size_t end, int)
+    {
+        nearestCentroids(bx.data() + begin, by.data() + begin, int(end - begin),
+            m_scaledX.data(), m_scaledY.data(), m_squaredNorms.data(), k,
+            labels.data() + begin, distances.data() + begin);
+    }, 2048);
+
+    std::vector<float> oldX(m_centroidsX);
+    std::vector<float> oldY(m_centroidsY);
+    double inertia = 0;
+    for (int i = 0; i < batch; i++)
+    {
+        int c = labels[i];
+        counts[c] += 1;
+        float rate = 1.0f / counts[c];
+        m_centroidsX[c] += rate * (bx[i] - m_centroidsX[c]);
+        m_centroidsY[c] += rate * (by[i] - m_centroidsY[c]);
+        inertia += distances[i];
+    }
+    m_inertia = inertia * double(count) / batch;
+
+    double shift = 0;
+    for (int c = 0; c < k; c++)
+    {
+        float dx = m_centroidsX[c] - oldX[c];
+        float dy = m_centroidsY[c] - oldY[c];
+        shift += dx * dx + dy * dy;
+    }
+    return shift / k;
+}
+
+void KMeans::summarize(const PointSet& points)
+{
+    const size_t count = points.size();
+    const int k = int(m_centroidsX.size());
+    prepareCentroids();
+
+    // Moments are taken relative to each centroid: n, dx, dy, dxx, dxy, dyy.
+    const int chunks = parallelChunks(count);
+    std::vector<std::vector<double>> moments(chunks);
+    std::vector<double> inertias(chunks);
+    parallelFor(count, [&](size_t begin, size_t end, int chunk)
+    {
+        std::vector<double>& moment = moments[chunk];
+        moment.assign(size_t(k) * 6, 0.0);
+        int labels[BlockSize];
+        float distances[BlockSize];
+        double inertia = 0;
+        for (size_t start = begin; start < end; start += BlockSize)
+        {
+            int n = int(std::min<size_t>(BlockSize, end - start));
+            const float* xs = points.x.data() + start;
+            const float* ys = points.y.data() + start;
+            nearestCentroids(xs, ys, n, m_scaledX.data(), m_scaledY.data(), m_squaredNorms.data(), k, labels, distances);
+            for (int i = 0; i < n; i++)
+            {
+                int c = labels[i];
+                double dx = xs[i] - m_centroidsX[c];
+                double dy = ys[i] - m_centroidsY[c];
+                double* m = moment.data() + c * 6;
+                m[0] += 1;
+                m[1] += dx;
+                m[2] += dy;
+                m[3] += dx * dx;
+                m[4] += dx * dy;
+                m[5] += dy * dy;
+                inertia += distances[i];
+            }
+        }
+        inertias[chunk] = inertia;
+    });
+
+    std::vector<double> total(size_t(k) * 6, 0.0);
+    m_inertia = 0;
+    for (int i = 0; i < chunks; i++)
+    {
+        for (size_t j = 0; j < total.size(); j++)
+            total[j] += moments[i][j];
+        m_inertia += inertias[i];
+    }
+
+    m_clusters.resize(k);
+    for (int c = 0; c < k; c++)
+    {
+        const double* m = total.data() + c * 6;
+        GaussianComponent& cluster = m_clusters[c];
+        double n = std::max(m[0], 1.0);
+        double mx = m[1] / n;
+        double my = m[2] / n;
+        cluster.weight = float(m[0] / count);
+        cluster.mean = Eigen::Vector2f(m_centroidsX[c] + float(mx), m_centroidsY[c] + float(my));
+        cluster.covariance << float(m[3] / n - mx * mx), float(m[4] / n - mx * my),
+                              float(m[4] / n - mx * my), float(m[5] / n - my * my);
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "GaussianMixture.h"
+#include "PointSet.h"
+
+// Finds the nearest of count centroids for n points. Centroids are passed
+// pre-scaled as (-2 cx, -2 cy, cx^2 + cy^2) so the squared distance reduces
+// to |p|^2 + cc + p . m. Uses AVX when the CPU has it, checked at run time
+// with GCC and Clang, and SSE2 otherwise.
+void nearestCentroids(const float* xs, const float* ys, int n,
+    const float* mx, const float* my, const float* cc, int count,
+    int* labels, float* distances);
+
+// 2D k-means clustering with k-means++ seeding.
+//
+// Lloyd iterations assign every point per pass and reduce the new centroids
+// from per-thread accumulators. Mini-batch iterations (Sculley 2010) assign a
+// random batch and move the centroids with per-centroid learning rates, which
+// is much cheaper per iteration for very large point sets.
+class KMeans
+{
+public:
+    enum Algorithm
+    {
+        Lloyd = 0,
+        MiniBatch
+    };
+
+    // Called after every iteration; returning false cancels the fit.
+    typedef std::function<bool(int iteration, double inertia, double milliseconds)> Progress;
+
+    KMeans();
+
+    void setClusterCount(int count) { m_clusterCount = count; }
+    int clusterCount() const { return m_clusterCount; }
+    void setAlgorithm(Algorithm algorithm) { m_algorithm = algorithm; }
+    Algorithm algorithm() const { return m_algorithm; }
+    void setMaxIterations(int iterations) { m_maxIterations = iterations; }
+    int maxIterations() const { return m_maxIterations; }
+    void setBatchSize(int size) { m_batchSize = size; }
+    // Stop when the mean squared centroid shift falls below this fraction of
+    // the data variance.
+    void setTolerance(double tolerance) { m_tolerance = tolerance; }
+    void setSeed(unsigned int seed) { m_seed = seed; }
+
+    // Returns false if cancelled or there are fewer points than clusters.
+    bool fit(const PointSet& points, const Progress& progress = Progress());
+
+    const std::vector<float>& centroidsX() const { return m_centroidsX; }
+    const std::vector<float>& centroidsY() const { return m_centroidsY; }
+
+    // Per-cluster weight (share of points), mean and covariance from a final
+    // full assignment pass.
+    const GaussianComponents& clusters() const { return m_clusters; }
+
+    // Sum of squared distances to the nearest centroid over all points.
+    double inertia() const { return m_inertia; }
+    int iterations() const { return m_iterations; }
+    bool converged() const { return m_converged; }
+    const std::vector<double>& iterationTimes() const { return m_iterationTimes; }
+
+private:
+    double seed(const PointSet& points);
+    double lloydStep(const PointSet& points);
+    double miniBatchStep(const PointSet& points, std::vector<float>& counts);
+    void prepareCentroids();
+    void summarize(const PointSet& points);
+
+private:
+    int m_clusterCount;
+    Algorithm m_algorithm;
+    int m_maxIterations;
+    int m_batchSize;
+    double m_tolerance;
+    unsigned int m_seed;
+    std::mt19937 m_rng;
+
+    std::vector<float> m_centroidsX;
+    std::vector<float> m_centroidsY;
+    // Scaled centroid terms for nearestCentroids().
+    std::vector<float> m_scaledX;
+    std::vector<float> m_scaledY;
+    std::vector<float> m_squaredNorms;
+    GaussianComponents m_clusters;
+    double m_inertia;
+    int m_iterations;
+    bool m_converged;
+    std::vector<double> m_iterationTimes;
+};
+
+#endif // KMEANS_H
@@ -0,0 +1,302 @@
+#include "KernelDensity.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    struct AxisStats
+    {
+        float minX, maxX, minY, maxY;
+        double sumX, sumY, sumXX, sumYY;
+    };
+}
+
+KernelDensity::KernelDensity()
+    : m_gridSize(512)
+    , m_bandwidth(0)
+    , m_left(0)
+    , m_bottom(0)
+    , m_cellWidth(1)
+    , m_cellHeight(1)
+    , m_hx(0)
+    , m_hy(0)
+    , m_maxDensity(0)
+    , m_kernelPadded(0)
+    , m_kernelSx(0)
+    , m_kernelSy(0)
+{
+}
+
+void KernelDensity::clear()
+{
+    m_density = cv::Mat();
+    m_maxDensity = 0;
+}
+
+void KernelDensity::estimate(const PointSet& points)
+{
+    size_t count = points.size();
+    if (count == 0)
+    {
+        clear();
+        return;
+    }
+
+    const float* xs = points.x.data();
+    const float* ys = points.y.data();
+    const int gridSize = std::max(m_gridSize, 16);
+
+    // Pass 1: bounds and moments for the bandwidth rule.
+    std::vector<AxisStats> stats(parallelChunks(count));
+    parallelFor(count, [&](size_t begin, size_t end, int chunk)
+    {
+        AxisStats s;
+        s.minX = s.minY = std::numeric_limits<float>::max();
+        s.maxX = s.maxY = -std::numeric_limits<float>::max();
+        s.sumX = s.sumY = s.sumXX = s.sumYY = 0;
+        for (size_t i = begin; i < end; i++)
+        {
+            float x = xs[i];
+            float y = ys[i];
+            s.minX = std::min(s.minX, x);
+            s.maxX = std::max(s.maxX, x);
+            s.minY = std::min(s.minY, y);
+            s.maxY = std::max(s.maxY, y);
+            s.sumX += x;
+            s.sumY += y;
+            s.sumXX += double(x) * x;
+            s.sumYY += double(y) * y;
+        }
+        stats[chunk] = s;
+    });
+
+    AxisStats total = stats[0];
+    for (size_t i = 1; i < stats.size(); i++)
+    {
+        total.minX = std::min(total.minX, stats[i].minX);
+        total.maxX = std::max(total.maxX, stats[i].maxX);
+        total.minY = std::min(total.minY, stats[i].minY);
+        total.maxY = std::max(total.maxY, stats[i].maxY);
+        total.sumX += stats[i].sumX;
+        total.sumY += stats[i].sumY;
+        total.sumXX += stats[i].sumXX;
+        total.sumYY += stats[i].sumYY;
+    }
+
+    if (m_bandwidth > 0)
+    {
+        m_hx = m_hy = m_bandwidth;
+    }
+    else
+    {
+        // Scott's rule in two dimensions: h = sigma * n^(-1/6).
+        double meanX = total.sumX / count;
+        double meanY = total.sumY / count;
+        double sigmaX = std::sqrt(std::max(0.0, total.sumXX / count - meanX * meanX));
+        double sigmaY = std::sqrt(std::max(0.0, total.sumYY / count - meanY * meanY));
+        double scott = std::pow(double(count), -1.0 / 6.0);
+        m_hx = float(sigmaX * scott);
+        m_hy = float(sigmaY * scott);
+    }
+    float extent = std::max(total.maxX - total.minX, total.maxY - total.minY);
+    float minH = std::max(extent, 1.0f) * 1e-3f;
+    m_hx = std::max(m_hx, minH);
+    m_hy = std::max(m_hy, minH);
+
+    m_gridSize = gridSize;
+    m_left = total.minX - 3 * m_hx;
+    m_bottom = total.minY - 3 * m_hy;
+    m_cellWidth = (total.maxX + 3 * m_hx - m_left) / (gridSize - 1);
+    m_cellHeight = (total.maxY + 3 * m_hy - m_bottom) / (gridSize - 1);
+
+    // Pass 2: linear binning into one private grid per chunk.
+    const size_t cells = size_t(gridSize) * gridSize;
+    std::vector<std::vector<float>> bins(stats.size());
+    const float invW = 1.0f / m_cellWidth;
+    const float invH = 1.0f / m_cellHeight;
+    const float left = m_left;
+    const float bottom = m_bottom;
+    parallelFor(count, [&](size_t begin, size_t end, int chunk)
+    {
+        std::vector<float>& bin = bins[chunk];
+        bin.assign(cells, 0.0f);
+        for (size_t i = begin; i < end; i++)
+        {
+            float fx = (xs[i] - left) * invW;
+            float fy = (ys[i] - bottom) * invH;
+            int cx = std::min(std::max(int(fx), 0), gridSize - 2);
+            int cy = std::min(std::max(int(fy), 0), gridSize - 2);
+            float wx = fx - cx;
+            float wy = fy - cy;
+            float* cell = bin.data() + size_t(cy) * gridSize + cx;
+            cell[0] += (1 - wx) * (1 - wy);
+            cell[1] += wx * (1 - wy);
+            cell[gridSize] += (1 - wx) * wy;
+            cell[gridSize + 1] += wx * wy;
+        }
+    });
+
+    // Zero padding keeps the circular FFT convolution from wrapping around,
+    // and the kernel's 2r + 1 taps must not overlap themselves either.
+    float sx = m_hx / m_cellWidth;
+    float sy = m_hy / m_cellHeight;
+    int radiusX = std::min(gridSize, int(std::ceil(4 * sx)));
+    int radiusY = std::min(gridSize, int(std::ceil(4 * sy)));
+    int radius = std::max(radiusX, radiusY);
+    int padded = cv::getOptimalDFTSize(std::max(gridSize + radius, 2 * radius + 1));
+
+    cv::Mat grid = cv::Mat::zeros(padded, padded, CV_32F);
+    parallelFor(gridSize, [&](size_t begin, size_t end, int)
+    {
+        for (size_t row = begin; row < end; row++)
+        {
+            float* dst = grid.ptr<float>(int(row));
+            for (size_t b = 0; b < bins.size(); b++)
+            {
+                const float* src = bins[b].data() + row * gridSize;
+                for (int col = 0; col < gridSize; col++)
+                    dst[col] += src[col];
+            }
+        }
+    }, 16);
+    bins.clear();
+
+    if (padded != m_kernelPadded || sx != m_kernelSx || sy != m_kernelSy)
+    {
+        m_kernelSx = sx;
+        m_kernelSy = sy;
+        updateKernelSpectrum(padded, radiusX, radiusY);
+    }
+
+    cv::Mat spectrum;
+    cv::dft(grid, spectrum, 0, gridSize);
+    cv::mulSpectrums(spectrum, m_kernelSpectrum, spectrum, 0);
+    cv::dft(spectrum, grid, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, gridSize);
+
+    // Binned counts -> probability density per unit area.
+    m_density.create(gridSize, gridSize, CV_32F);
+    float scale = 1.0f / (float(count) * m_cellWidth * m_cellHeight);
+    m_maxDensity = 0;
+    for (int row = 0; row < gridSize; row++)
+    {
+        const float* src = grid.ptr<float>(row);
+        float* dst = m_density.ptr<float>(row);
+        for (int col = 0; col < gridSize; col++)
+        {
+            dst[col] = std::max(0.0f, src[col] * scale);
+            m_maxDensity = std::max(m_maxDensity, dst[col]);
+        }
+    }
+}
+
+void KernelDensity::updateKernelSpectrum(int padded, int radiusX, int radiusY)
+{
+    cv::Mat kernel = cv::Mat::zeros(padded, padded, CV_32F);
+    double sum = 0;
+    for (int dy = -radiusY; dy <= radiusY; dy++)
+    {
+        float* row = kernel.ptr<float>((dy + padded) % padded);
+        for (int dx = -radiusX; dx <= radiusX; dx++)
+        {
+            float u = dx / m_kernelSx;
+            float v = dy / m_kernelSy;
+            float k = std::exp(-0.5f * (u * u + v * v));
+            row[(dx + padded) % padded] = k;
+            sum += k;
+        }
+    }
+    kernel *= 1.0 / sum;
+
+    cv::dft(kernel, m_kernelSpectrum);
+    m_kernelPadded = padded;
+}
+
+std::vector<float> KernelDensity::contour(float level) const
+{
+    std::vector<float> segments;
+    if (m_density.empty())
+        return segments;
+
+    const int n = m_gridSize;
+    float edgeX[4];
+    float edgeY[4];
+    for (int row = 0; row < n - 1; row++)
+    {
+        const float* r0 = m_density.ptr<float>(row);
+        const float* r1 = m_density.ptr<float>(row + 1);
+        for (int col = 0; col < n - 1; col++)
+        {
+            // Corners: 0 = bottom-left, 1 = bottom-right, 2 = top-right, 3 = top-left.
+            float v[4] = { r0[col], r0[col + 1], r1[col + 1], r1[col] };
+            int mask = (v[0] >= level) | (v[1] >= level) << 1 | (v[2] >= level) << 2 | (v[3] >= level) << 3;
+            if (mask == 0 || mask == 15)
+                continue;
+
+            // Edges: 0 = bottom, 1 = right, 2 = top, 3 = left.
+            static const int edgeCorners[4][2] = { { 0, 1 }, { 1, 2 }, { 3, 2 }, { 0, 3 } };
+            static const float cornerX[4] = { 0, 1, 1, 0 };
+            static const float cornerY[4] = { 0, 0, 1, 1 };
+            bool crossed[4];
+            for (int e = 0; e < 4; e++)
+            {
+                int a = edgeCorners[e][0];
+                int b = edgeCorners[e][1];
+                crossed[e] = (v[a] >= level) != (v[b] >= level);
+                if (!crossed[e])
+                    continue;
+                float t = (level - v[a]) / (v[b] - v[a]);
+                edgeX[e] = m_left + m_cellWidth * (col + cornerX[a] + t * (cornerX[b] - cornerX[a]));
+                edgeY[e] = m_bottom + m_cellHeight * (row + cornerY[a] + t * (cornerY[b] - cornerY[a]));
+            }
+
+            int pairs[2][2];
+            int pairCount = 0;
+            if (crossed[0] && crossed[1] && crossed[2] && crossed[3])
+            {
+                // Saddle: cut off the two corners on the other side of the cell centre.
+                bool centre = (v[0] + v[1] + v[2] + v[3]) * 0.25f >= level;
+                static const int cornerEdges[4][2] = { { 0, 3 }, { 0, 1 }, { 1, 2 }, { 2, 3 } };
+                for (int c = 0; c < 4; c++)
+                {
+                    if ((v[c] >= level) != centre)
+                    {
+                        pairs[pairCount][0] = cornerEdges[c][0];
+                        pairs[pairCount][1] = cornerEdges[c][1];
+                        pairCount++;
+                    }
+                }
+            }
+            else
+            {
+                int e0 = -1;
+                for (int e = 0; e < 4; e++)
+                {
+                    if (!crossed[e])
+                        continue;
+                    if (e0 < 0)
+                    {
+                        e0 = e;
+                    }
+                    else
+                    {
+                        pairs[0][0] = e0;
+                        pairs[0][1] = e;
+                        pairCount = 1;
+                    }
+                }
+            }
+
+            for (int p = 0; p < pairCount; p++)
+            {
+                segments.push_back(edgeX[pairs[p][0]]);
+                segments.push_back(edgeY[pairs[p][0]]);
+                segments.push_back(edgeX[pairs[p][1]]);
+                segments.push_back(edgeY[pairs[p][1]]);
+            }
+        }
+    }
+    return segments;
+}
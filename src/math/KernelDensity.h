@@ -0,0 +1,74 @@
+#ifndef KERNELDENSITY_H
+#define KERNELDENSITY_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "PointSet.h"
+
+// Binned 2D Gaussian kernel density estimate.
+//
+// Points are linearly binned onto a G x G grid in O(N), then the grid is
+// convolved with the Gaussian kernel through cv::dft in O(G^2 log G). The
+// result is a density surface whose integral over the grid is ~1.
+class KernelDensity
+{
+public:
+    KernelDensity();
+
+    void setGridSize(int size) { m_gridSize = size; }
+    int gridSize() const { return m_gridSize; }
+
+    // Isotropic bandwidth in data units. Zero or negative selects Scott's rule
+    // per axis from the sample standard deviation.
+    void setBandwidth(float bandwidth) { m_bandwidth = bandwidth; }
+    float bandwidth() const { return m_bandwidth; }
+
+    void estimate(const PointSet& points);
+    void clear();
+
+    bool isEmpty() const { return m_density.empty(); }
+
+    // CV_32F, gridSize x gridSize. Row 0 is the bottom edge (y = bottom()).
+    const cv::Mat& density() const { return m_density; }
+    float maxDensity() const { return m_maxDensity; }
+
+    float left() const { return m_left; }
+    float bottom() const { return m_bottom; }
+    float right() const { return m_left + m_cellWidth * (m_gridSize - 1); }
+    float top() const { return m_bottom + m_cellHeight * (m_gridSize - 1); }
+    float cellWidth() const { return m_cellWidth; }
+    float cellHeight() const { return m_cellHeight; }
+    float bandwidthX() const { return m_hx; }
+    float bandwidthY() const { return m_hy; }
+
+    // Iso-line of the density at level, as x0, y0, x1, y1 segment quadruples
+    // in data coordinates (marching squares).
+    std::vector<float> contour(float level) const;
+
+private:
+    void updateKernelSpectrum(int padded, int radiusX, int radiusY);
+
+private:
+    int m_gridSize;
+    float m_bandwidth;
+
+    float m_left;
+    float m_bottom;
+    float m_cellWidth;
+    float m_cellHeight;
+    float m_hx;
+    float m_hy;
+    float m_maxDensity;
+
+    cv::Mat m_density;
+
+    // Kernel spectrum is reused while the padded size and the bandwidth in
+    // grid cells are unchanged.
+    cv::Mat m_kernelSpectrum;
+    int m_kernelPadded;
+    float m_kernelSx;
+    float m_kernelSy;
+};
+
+#endif // KERNELDENSITY_H
@@ -0,0 +1,412 @@
+#include "LineFit.h"
+#include "EigenSolvers.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    // Hypotheses scored per parallel round; the stopping bound is checked
+    // between rounds.
+    const int RoundSize = 64;
+    // Points per block of float lane sums before they are added up in double.
+    const size_t BlockSize = 1024;
+
+#if defined(SIMD_AVX)
+    // Adds the moments of the inliers among the first points, in groups of 8,
+    // to block and returns how many points were done.
+    SIMD_AVX_TARGET size_t accumulateInliersAvx(const float* xs, const float* ys, size_t n, float shiftX, float shiftY,
+        float nx, float ny, float d, float threshold, float* block)
+    {
+        __m256 sw = _mm256_setzero_ps();
+        __m256 sx = _mm256_setzero_ps();
+        __m256 sy = _mm256_setzero_ps();
+        __m256 sxx = _mm256_setzero_ps();
+        __m256 sxy = _mm256_setzero_ps();
+        __m256 syy = _mm256_setzero_ps();
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 px = _mm256_sub_ps(_mm256_loadu_ps(xs + i), _mm256_set1_ps(shiftX));
+            __m256 py = _mm256_sub_ps(_mm256_loadu_ps(ys + i), _mm256_set1_ps(shiftY));
+            __m256 r = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(nx)),
+                _mm256_mul_ps(py, _mm256_set1_ps(ny))), _mm256_set1_ps(d));
+            __m256 inside = _mm256_cmp_ps(_mm256_and_ps(r, absMask), _mm256_set1_ps(threshold), _CMP_LE_OQ);
+            px = _mm256_and_ps(px, inside);
+            py = _mm256_and_ps(py, inside);
+            sw = _mm256_add_ps(sw, _mm256_and_ps(inside, _mm256_set1_ps(1.0f)));
+            sx = _mm256_add_ps(sx, px);
+            sy = _mm256_add_ps(sy, py);
+            sxx = _mm256_add_ps(sxx, _mm256_mul_ps(px, px));
+            sxy = _mm256_add_ps(sxy, _mm256_mul_ps(px, py));
+            syy = _mm256_add_ps(syy, _mm256_mul_ps(py, py));
+        }
+        __m256 lanes[6] = {sw, sx, sy, sxx, sxy, syy};
+        for (int k = 0; k < 6; k++)
+        {
+            float values[8];
+            _mm256_storeu_ps(values, lanes[k]);
+            for (int j = 0; j < 8; j++)
+                block[k] += values[j];
+        }
+        return i;
+    }
+
+    // Counts the inliers among the first points in groups of 8 and returns
+    // how many points were done.
+    SIMD_AVX_TARGET size_t countLineInliersAvx(const float* xs, const float* ys, size_t n,
+        float nx, float ny, float d, float threshold, size_t& count)
+    {
+        // Float lane counts are exact well past the block size.
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const size_t Block = 1 << 16;
+        size_t i = 0;
+        while (i + 8 <= n)
+        {
+            size_t end = std::min(n, i + Block);
+            __m256 lanes = _mm256_setzero_ps();
+            for (; i + 8 <= end; i += 8)
+            {
+                __m256 r = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(xs + i), _mm256_set1_ps(nx)),
+                    _mm256_mul_ps(_mm256_loadu_ps(ys + i), _mm256_set1_ps(ny))), _mm256_set1_ps(d));
+                __m256 inside = _mm256_cmp_ps(_mm256_and_ps(r, absMask), _mm256_set1_ps(threshold), _CMP_LE_OQ);
+                lanes = _mm256_add_ps(lanes, _mm256_and_ps(inside, _mm256_set1_ps(1.0f)));
+            }
+            float values[8];
+            _mm256_storeu_ps(values, lanes);
+            for (int j = 0; j < 8; j++)
+                count += size_t(values[j]);
+        }
+        return i;
+    }
+#endif
+
+#if defined(SIMD_SSE2)
+    // Same as accumulateInliersAvx() in groups of 4.
+    size_t accumulateInliersSse2(const float* xs, const float* ys, size_t n, float shiftX, float shiftY,
+        float nx, float ny, float d, float threshold, float* block)
+    {
+        __m128 sw = _mm_setzero_ps();
+        __m128 sx = _mm_setzero_ps();
+        __m128 sy = _mm_setzero_ps();
+        __m128 sxx = _mm_setzero_ps();
+        __m128 sxy = _mm_setzero_ps();
+        __m128 syy = _mm_setzero_ps();
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 px = _mm_sub_ps(_mm_loadu_ps(xs + i), _mm_set1_ps(shiftX));
+            __m128 py = _mm_sub_ps(_mm_loadu_ps(ys + i), _mm_set1_ps(shiftY));
+            __m128 r = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(nx)),
+                _mm_mul_ps(py, _mm_set1_ps(ny))), _mm_set1_ps(d));
+            __m128 inside = _mm_cmple_ps(_mm_and_ps(r, absMask), _mm_set1_ps(threshold));
+            px = _mm_and_ps(px, inside);
+            py = _mm_and_ps(py, inside);
+            sw = _mm_add_ps(sw, _mm_and_ps(inside, _mm_set1_ps(1.0f)));
+            sx = _mm_add_ps(sx, px);
+            sy = _mm_add_ps(sy, py);
+            sxx = _mm_add_ps(sxx, _mm_mul_ps(px, px));
+            sxy = _mm_add_ps(sxy, _mm_mul_ps(px, py));
+            syy = _mm_add_ps(syy, _mm_mul_ps(py, py));
+        }
+        __m128 lanes[6] = {sw, sx, sy, sxx, sxy, syy};
+        for (int k = 0; k < 6; k++)
+        {
+            float values[4];
+            _mm_storeu_ps(values, lanes[k]);
+            for (int j = 0; j < 4; j++)
+                block[k] += values[j];
+        }
+        return i;
+    }
+
+    // Same as countLineInliersAvx() in groups of 4.
+    size_t countLineInliersSse2(const float* xs, const float* ys, size_t n,
+        float nx, float ny, float d, float threshold, size_t& count)
+    {
+        // Masks are -1 where inside, so subtracting them counts.
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const size_t Block = size_t(1) << 30;
+        size_t i = 0;
+        while (i + 4 <= n)
+        {
+            size_t end = std::min(n, i + Block);
+            __m128i lanes = _mm_setzero_si128();
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128 r = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(xs + i), _mm_set1_ps(nx)),
+                    _mm_mul_ps(_mm_loadu_ps(ys + i), _mm_set1_ps(ny))), _mm_set1_ps(d));
+                __m128 inside = _mm_cmple_ps(_mm_and_ps(r, absMask), _mm_set1_ps(threshold));
+                lanes = _mm_sub_epi32(lanes, _mm_castps_si128(inside));
+            }
+            int values[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(values), lanes);
+            for (int j = 0; j < 4; j++)
+                count += size_t(unsigned(values[j]));
+        }
+        return i;
+    }
+#endif
+
+    // Adds the moments n, x, y, xx, xy, yy of the points within threshold
+    // of the line to sums, in coordinates relative to (shiftX, shiftY).
+    void accumulateInliers(const float* xs, const float* ys, size_t n, float shiftX, float shiftY,
+        float nx, float ny, float d, float threshold, double* sums)
+    {
+#if defined(SIMD_AVX)
+        const bool avx = cpuHasAvx();
+#endif
+        for (size_t start = 0; start < n; start += BlockSize)
+        {
+            size_t end = std::min(n, start + BlockSize);
+            size_t i = start;
+            float block[6] = {0, 0, 0, 0, 0, 0};
+#if defined(SIMD_AVX)
+            if (avx)
+                i += accumulateInliersAvx(xs + i, ys + i, end - i, shiftX, shiftY, nx, ny, d, threshold, block);
+#endif
+#if defined(SIMD_SSE2)
+            i += accumulateInliersSse2(xs + i, ys + i, end - i, shiftX, shiftY, nx, ny, d, threshold, block);
+#endif
+            for (; i < end; i++)
+            {
+                float px = xs[i] - shiftX;
+                float py = ys[i] - shiftY;
+                if (std::fabs(nx * px + ny * py - d) <= threshold)
+                {
+                    block[0] += 1;
+                    block[1] += px;
+                    block[2] += py;
+                    block[3] += px * px;
+                    block[4] += px * py;
+                    block[5] += py * py;
+                }
+            }
+            for (int k = 0; k < 6; k++)
+                sums[k] += block[k];
+        }
+    }
+}
+
+FittedLine fitLineTls(const PointStatistics& statistics)
+{
+    Eigen::Vector2f values;
+    Eigen::Matrix2f vectors;
+    symmetricEigen2(statistics.covariance, values, vectors);
+
+    FittedLine line;
+    line.valid = values(0) > 0;
+    line.point = statistics.mean;
+    line.direction = vectors.col(0);
+    line.rms = std::sqrt(std::max(values(1), 0.0f));
+    return line;
+}
+
+size_t countLineInliers(const float* xs, const float* ys, size_t n, float nx, float ny, float d, float threshold)
+{
+    size_t count = 0;
+    size_t i = 0;
+#if defined(SIMD_AVX)
+    if (cpuHasAvx())
+        i = countLineInliersAvx(xs, ys, n, nx, ny, d, threshold, count);
+#endif
+#if defined(SIMD_SSE2)
+    i += countLineInliersSse2(xs + i, ys + i, n - i, nx, ny, d, threshold, count);
+#endif
+    for (; i < n; i++)
+        count += std::fabs(nx * xs[i] + ny * ys[i] - d) <= threshold;
+    return count;
+}
+
+size_t countLineInliers(const PointSet& points, const FittedLine& line)
+{
+    const Eigen::Vector2f normal = line.normal();
+    const float d = line.offset();
+    std::vector<size_t> counts(parallelChunks(points.size()), 0);
+    parallelFor(points.size(), [&](size_t begin, size_t end, int chunk)
+    {
+        counts[chunk] = countLineInliers(points.x.data() + begin, points.y.data() + begin, end - begin,
+            normal.x(), normal.y(), d, line.threshold);
+    });
+
+    size_t total = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+        total += counts[i];
+    return total;
+}
+
+LineRansac::LineRansac()
+    : m_threshold(0.5f)
+    , m_confidence(0.999)
+    , m_maxHypotheses(10000)
+    , m_sampleSize(65536)
+    , m_refinements(5)
+    , m_seed(5489u)
+    , m_hypotheses(0)
+{
+}
+
+bool LineRansac::fit(const PointSet& points, const Progress& progress)
+{
+    const size_t count = points.size();
+    m_line = FittedLine();
+    m_hypotheses = 0;
+    if (count < 2)
+        return false;
+
+    m_rng.seed(m_seed);
+    const float threshold = std::max(m_threshold, 0.0f);
+
+    // Scoring on a subsample keeps the cost per hypothesis independent of
+    // the point count. Coordinates are taken relative to a data point so
+    // distances stay accurate far from the origin.
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    const size_t sampleSize = std::min(count, std::max<size_t>(m_sampleSize, 2));
+    const size_t first = pick(m_rng);
+    const float shiftX = points.x[first];
+    const float shiftY = points.y[first];
+    std::vector<float> sx(sampleSize);
+    std::vector<float> sy(sampleSize);
+    for (size_t i = 0; i < sampleSize; i++)
+    {
+        size_t index = sampleSize == count ? i : pick(m_rng);
+        sx[i] = points.x[index] - shiftX;
+        sy[i] = points.y[index] - shiftY;
+    }
+
+    std::uniform_int_distribution<size_t> pickSample(0, sampleSize - 1);
+    std::vector<float> nx(RoundSize);
+    std::vector<float> ny(RoundSize);
+    std::vector<float> d(RoundSize);
+    std::vector<size_t> support(RoundSize);
+    size_t bestSupport = 0;
+    float bestNx = 0;
+    float bestNy = 0;
+    float bestD = 0;
+    double required = m_maxHypotheses;
+    while (m_hypotheses < required && m_hypotheses < m_maxHypotheses)
+    {
+        const int n = std::min(RoundSize, m_maxHypotheses - m_hypotheses);
+        for (int h = 0; h < n; h++)
+        {
+            size_t i = pickSample(m_rng);
+            size_t j = pickSample(m_rng);
+            float dx = sx[j] - sx[i];
+            float dy = sy[j] - sy[i];
+            float length = std::sqrt(dx * dx + dy * dy);
+            if (length > 0)
+            {
+                nx[h] = -dy / length;
+                ny[h] = dx / length;
+                d[h] = nx[h] * sx[i] + ny[h] * sy[i];
+            }
+            else
+            {
+                // Coincident pair: no line, scores nothing.
+                nx[h] = 0;
+                ny[h] = 0;
+                d[h] = 0;
+            }
+        }
+
+        parallelFor(size_t(n), [&](size_t begin, size_t end, int)
+        {
+            for (size_t h = begin; h < end; h++)
+            {
+                support[h] = nx[h] == 0 && ny[h] == 0 ? 0
+                    : countLineInliers(sx.data(), sy.data(), sampleSize, nx[h], ny[h], d[h], threshold);
+            }
+        }, 1);
+        m_hypotheses += n;
+
+        for (int h = 0; h < n; h++)
+        {
+            if (support[h] > bestSupport)
+            {
+                bestSupport = support[h];
+                bestNx = nx[h];
+                bestNy = ny[h];
+                bestD = d[h];
+            }
+        }
+
+        // Hypotheses needed to draw an all-inlier pair with the requested
+        // confidence, at the best inlier ratio seen so far.
+        if (bestSupport >= 2)
+        {
+            double ratio = double(bestSupport) / sampleSize;
+            double miss = 1 - ratio * ratio;
+            required = miss <= 0 ? 0 : std::log(1 - m_confidence) / std::log(miss);
+        }
+        if (progress && !progress(m_hypotheses, bestSupport * count / sampleSize))
+            return false;
+    }
+    if (bestSupport < 2)
+        return false;
+
+    m_line.valid = true;
+    m_line.direction = Eigen::Vector2f(bestNy, -bestNx);
+    m_line.point = Eigen::Vector2f(shiftX + bestNx * bestD, shiftY + bestNy * bestD);
+    m_line.threshold = threshold;
+
+    // Refit to all inliers until the inlier set settles; points right at the
+    // threshold may keep flipping, so a change of 0.01% counts as settled.
+    size_t previous = 0;
+    for (int i = 0; i < m_refinements; i++)
+    {
+        if (!refine(points, shiftX, shiftY))
+            break;
+        if (progress && !progress(m_hypotheses, m_line.inliers))
+            return false;
+        size_t change = m_line.inliers > previous ? m_line.inliers - previous : previous - m_line.inliers;
+        if (change <= m_line.inliers / 10000)
+            break;
+        previous = m_line.inliers;
+    }
+    m_line.inliers = countLineInliers(points, m_line);
+    return true;
+}
+
+bool LineRansac::refine(const PointSet& points, float shiftX, float shiftY)
+{
+    const Eigen::Vector2f normal = m_line.normal();
+    const float d = normal.dot(m_line.point - Eigen::Vector2f(shiftX, shiftY));
+    const int chunks = parallelChunks(points.size());
+    std::vector<double> sums(size_t(chunks) * 6, 0.0);
+    parallelFor(points.size(), [&](size_t begin, size_t end, int chunk)
+    {
+        accumulateInliers(points.x.data() + begin, points.y.data() + begin, end - begin, shiftX, shiftY,
+            normal.x(), normal.y(), d, m_line.threshold, sums.data() + chunk * 6);
+    });
+
+    double total[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < chunks; i++)
+    {
+        for (int k = 0; k < 6; k++)
+            total[k] += sums[i * 6 + k];
+    }
+    if (total[0] < 2)
+        return false;
+
+    double mx = total[1] / total[0];
+    double my = total[2] / total[0];
+    double cxy = total[4] / total[0] - mx * my;
+    PointStatistics statistics;
+    statistics.mean << float(mx), float(my);
+    statistics.covariance << float(total[3] / total[0] - mx * mx), float(cxy),
+        float(cxy), float(total[5] / total[0] - my * my);
+    FittedLine line = fitLineTls(statistics);
+    if (!line.valid)
+        return false;
+
+    line.point += Eigen::Vector2f(shiftX, shiftY);
+    line.threshold = m_line.threshold;
+    line.inliers = size_t(total[0]);
+    m_line = line;
+    return true;
+}
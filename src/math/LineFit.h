@@ -0,0 +1,95 @@
+#ifndef LINEFIT_H
+#define LINEFIT_H
+
+#include <cstddef>
+#include <functional>
+#include <random>
+#include <Eigen/Core>
+
+#include "Covariance.h"
+#include "PointSet.h"
+
+// Infinite line through point along the unit direction. The unit normal is
+// the direction turned by 90 degrees, so the signed distance of p is
+// normal . (p - point).
+struct FittedLine
+{
+    FittedLine() : valid(false), threshold(0), inliers(0), rms(0)
+    {
+        point.setZero();
+        direction << 1, 0;
+    }
+
+    Eigen::Vector2f normal() const { return Eigen::Vector2f(-direction.y(), direction.x()); }
+    float offset() const { return normal().dot(point); }
+
+    bool valid;
+    Eigen::Vector2f point;
+    Eigen::Vector2f direction;
+    // Points within this distance of the line count as inliers.
+    float threshold;
+    size_t inliers;
+    // Root mean square distance of the points the line was fitted to.
+    float rms;
+};
+
+// Closed-form total least squares: the line through the mean along the
+// major eigenvector of the covariance, which minimises the sum of squared
+// orthogonal distances.
+FittedLine fitLineTls(const PointStatistics& statistics);
+
+// Counts the points with |nx x + ny y - d| <= threshold. Uses AVX when the
+// CPU has it and SSE2 otherwise.
+size_t countLineInliers(const float* xs, const float* ys, size_t n, float nx, float ny, float d, float threshold);
+// Same over a whole point set, in parallel.
+size_t countLineInliers(const PointSet& points, const FittedLine& line);
+
+// Robust line fit with RANSAC.
+//
+// Hypotheses through two random points are scored on a random subsample, in
+// rounds that run in parallel, until the usual confidence bound on the
+// number of hypotheses is met. The best one is then refined on all points by
+// alternating the inlier selection with a total least squares fit of the
+// inliers.
+class LineRansac
+{
+public:
+    // Called after every scoring round and refinement; returning false
+    // cancels the fit.
+    typedef std::function<bool(int hypotheses, size_t inliers)> Progress;
+
+    LineRansac();
+
+    void setThreshold(float threshold) { m_threshold = threshold; }
+    float threshold() const { return m_threshold; }
+    // Probability of drawing at least one outlier-free pair.
+    void setConfidence(double confidence) { m_confidence = confidence; }
+    void setMaxHypotheses(int hypotheses) { m_maxHypotheses = hypotheses; }
+    int maxHypotheses() const { return m_maxHypotheses; }
+    void setSampleSize(size_t size) { m_sampleSize = size; }
+    void setRefinements(int refinements) { m_refinements = refinements; }
+    void setSeed(unsigned int seed) { m_seed = seed; }
+
+    // Returns false if cancelled or no line is supported by two points.
+    bool fit(const PointSet& points, const Progress& progress = Progress());
+
+    const FittedLine& line() const { return m_line; }
+    int hypotheses() const { return m_hypotheses; }
+
+private:
+    bool refine(const PointSet& points, float shiftX, float shiftY);
+
+private:
+    float m_threshold;
+    double m_confidence;
+    int m_maxHypotheses;
+    size_t m_sampleSize;
+    int m_refinements;
+    unsigned int m_seed;
+    std::mt19937 m_rng;
+
+    FittedLine m_line;
+    int m_hypotheses;
+};
+
+#endif // LINEFIT_H
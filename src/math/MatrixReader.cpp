@@ -0,0 +1,274 @@
+#include "MatrixReader.h"
+#include "NumberParser.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+    // Parses one row of separated numbers. Returns false if the line holds
+    // anything that is not a number, e.g. a CSV header.
+    bool parseRow(const std::string& line, std::vector<double>& values)
+    {
+        values.clear();
+        const char* p = line.c_str();
+        const char* end = p + line.size();
+        while (true)
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == ';' || *p == '\r'))
+                p++;
+            if (p == end)
+                break;
+            // Not strtod: a comma-decimal locale would reject "1.5,2.5".
+            float value;
+            if (!parseNumber(p, end, value))
+                return false;
+            values.push_back(value);
+        }
+        return true;
+    }
+
+    bool isBlankOrComment(const std::string& line)
+    {
+        size_t i = line.find_first_not_of(" \t\r");
+        return i == std::string::npos || line[i] == '#';
+    }
+}
+
+MatrixReader::MatrixReader()
+    : m_npy(false)
+    , m_double(false)
+    , m_columns(0)
+    , m_rows(-1)
+    , m_rowsRead(0)
+    , m_dataOffset(0)
+{
+}
+
+bool MatrixReader::open(const std::string& filename)
+{
+    close();
+    m_file.open(filename, std::ios::binary);
+    if (!m_file)
+    {
+        m_error = "cannot open " + filename;
+        return false;
+    }
+
+    char magic[6] = {};
+    m_file.read(magic, 6);
+    m_npy = m_file.gcount() == 6 && std::memcmp(magic, "\x93NUMPY", 6) == 0;
+    m_file.clear();
+    m_file.seekg(0);
+
+    bool ok = m_npy ? openNpy() : openText();
+    if (!ok)
+    {
+        std::string error = m_error;
+        close();
+        m_error = error;
+    }
+    return ok;
+}
+
+void MatrixReader::close()
+{
+    if (m_file.is_open())
+        m_file.close();
+    m_file.clear();
+    m_npy = false;
+    m_double = false;
+    m_columns = 0;
+    m_rows = -1;
+    m_rowsRead = 0;
+    m_dataOffset = 0;
+    m_error.clear();
+}
+
+bool MatrixReader::openNpy()
+{
+    unsigned char preamble[10];
+    m_file.read(reinterpret_cast<char*>(preamble), 10);
+    if (m_file.gcount() != 10)
+    {
+        m_error = "truncated .npy header";
+        return false;
+    }
+
+    // Version 1 stores the header length in 2 bytes, later versions in 4.
+    uint32_t headerLength = preamble[8] | (preamble[9] << 8);
+    std::streamoff offset = 10;
+    if (preamble[6] >= 2)
+    {
+        unsigned char extra[2];
+        m_file.read(reinterpret_cast<char*>(extra), 2);
+        headerLength |= (uint32_t(extra[0]) << 16) | (uint32_t(extra[1]) << 24);
+        offset = 12;
+    }
+
+    std::string header(headerLength, '\0');
+    m_file.read(&header[0], headerLength);
+    if (uint32_t(m_file.gcount()) != headerLength)
+    {
+        m_error = "truncated .npy header";
+        return false;
+    }
+    m_dataOffset = offset + headerLength;
+
+    size_t descr = header.find("'descr'");
+    size_t quote = descr == std::string::npos ? descr : header.find('\'', descr + 7);
+    std::string type = quote == std::string::npos ? std::string() : header.substr(quote + 1, 3);
+    if (type == "<f4")
+        m_double = false;
+    else if (type == "<f8")
+        m_double = true;
+    else
+    {
+        m_error = "only little-endian float32/float64 .npy files are supported";
+        return false;
+    }
+
+    size_t fortran = header.find("'fortran_order'");
+    if (fortran != std::string::npos && header.find("True", fortran) < header.find(',', fortran))
+    {
+        m_error = "Fortran-ordered .npy files are not supported";
+        return false;
+    }
+
+    size_t shape = header.find("'shape'");
+    size_t open = shape == std::string::npos ? shape : header.find('(', shape);
+    size_t close = open == std::string::npos ? open : header.find(')', open);
+    if (close == std::string::npos)
+    {
+        m_error = "missing .npy shape";
+        return false;
+    }
+
+    std::vector<long long> dims;
+    const char* p = header.c_str() + open + 1;
+    const char* end = header.c_str() + close;
+    while (p < end)
+    {
+        char* next = nullptr;
+        long long dim = std::strtoll(p, &next, 10);
+        if (next == p)
+        {
+            p++;
+            continue;
+        }
+        dims.push_back(dim);
+        p = next;
+    }
+    if (dims.empty() || dims.size() > 2)
+    {
+        m_error = "expected a 1-D or 2-D .npy array";
+        return false;
+    }
+
+    m_rows = dims[0];
+    m_columns = dims.size() == 2 ? int(dims[1]) : 1;
+    return m_columns > 0 && rewind();
+}
+
+bool MatrixReader::openText()
+{
+    // The first numeric row fixes the column count; a non-numeric first line
+    // is taken as a header and skipped.
+    std::streamoff offset = 0;
+    bool first = true;
+    while (std::getline(m_file, m_line))
+    {
+        if (isBlankOrComment(m_line))
+        {
+            offset = m_file.tellg();
+            continue;
+        }
+        if (parseRow(m_line, m_scratch) && !m_scratch.empty())
+        {
+            m_columns = int(m_scratch.size());
+            break;
+        }
+        if (!first)
+        {
+            m_error = "unparsable row: " + m_line.substr(0, 64);
+            return false;
+        }
+        first = false;
+        offset = m_file.tellg();
+    }
+
+    if (m_columns == 0)
+    {
+        m_error = "no numeric rows";
+        return false;
+    }
+
+    m_rows = -1;
+    m_dataOffset = offset;
+    return rewind();
+}
+
+bool MatrixReader::rewind()
+{
+    m_file.clear();
+    m_file.seekg(m_dataOffset);
+    m_rowsRead = 0;
+    return bool(m_file);
+}
+
+size_t MatrixReader::read(float* buffer, size_t maxRows)
+{
+    if (!isOpen() || !m_error.empty())
+        return 0;
+
+    size_t count = 0;
+    if (m_npy)
+    {
+        size_t remaining = size_t(m_rows - m_rowsRead);
+        count = std::min(maxRows, remaining);
+        size_t values = count * m_columns;
+        if (m_double)
+        {
+            m_scratch.resize(values);
+            m_file.read(reinterpret_cast<char*>(m_scratch.data()), values * sizeof(double));
+            count = size_t(m_file.gcount()) / (sizeof(double) * m_columns);
+            for (size_t i = 0; i < count * m_columns; i++)
+                buffer[i] = float(m_scratch[i]);
+        }
+        else
+        {
+            m_file.read(reinterpret_cast<char*>(buffer), values * sizeof(float));
+            count = size_t(m_file.gcount()) / (sizeof(float) * m_columns);
+        }
+        if (count < std::min(maxRows, remaining))
+            m_error = "unexpected end of .npy data";
+    }
+    else
+    {
+        while (count < maxRows && nextTextRow(buffer + count * m_columns, count))
+            count++;
+    }
+
+    m_rowsRead += count;
+    return count;
+}
+
+bool MatrixReader::nextTextRow(float* row, size_t rowInBlock)
+{
+    while (std::getline(m_file, m_line))
+    {
+        if (isBlankOrComment(m_line))
+            continue;
+        if (!parseRow(m_line, m_scratch) || int(m_scratch.size()) != m_columns)
+        {
+            m_error = "bad row " + std::to_string(m_rowsRead + rowInBlock + 1) + ": expected "
+                + std::to_string(m_columns) + " values";
+            return false;
+        }
+        for (int i = 0; i < m_columns; i++)
+            row[i] = float(m_scratch[i]);
+        return true;
+    }
+    return false;
+}
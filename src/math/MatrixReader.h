@@ -0,0 +1,55 @@
+#ifndef MATRIXREADER_H
+#define MATRIXREADER_H
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Streams the rows of an N x D matrix from disk in blocks, so arbitrarily
+// tall files never have to fit in memory.
+//
+// Reads NumPy .npy files holding a little-endian float32 or float64 array in
+// C order, and text files with one row per line and values separated by
+// commas, tabs or spaces. Lines starting with '#' are skipped.
+class MatrixReader
+{
+public:
+    MatrixReader();
+
+    bool open(const std::string& filename);
+    void close();
+    bool isOpen() const { return m_columns > 0; }
+
+    int columns() const { return m_columns; }
+    // Row count from the .npy header, or -1 for text files.
+    long long rows() const { return m_rows; }
+
+    // Reads up to maxRows rows into buffer (row-major, columns() floats per
+    // row). Returns the number of rows read; 0 at the end of the data.
+    size_t read(float* buffer, size_t maxRows);
+    // Seeks back to the first row.
+    bool rewind();
+
+    const std::string& errorString() const { return m_error; }
+
+private:
+    bool openNpy();
+    bool openText();
+    // rowInBlock counts the rows the current read() has taken so far.
+    bool nextTextRow(float* row, size_t rowInBlock);
+
+private:
+    std::ifstream m_file;
+    bool m_npy;
+    bool m_double;
+    int m_columns;
+    long long m_rows;
+    long long m_rowsRead;
+    std::streamoff m_dataOffset;
+    std::string m_line;
+    std::vector<double> m_scratch;
+    std::string m_error;
+};
+
+#endif // MATRIXREADER_H
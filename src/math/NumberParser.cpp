@@ -0,0 +1,94 @@
+#include "NumberParser.h"
+
+#include <cmath>
+#include <cstdint>
+
+namespace
+{
+    bool isDigit(char c)
+    {
+        return unsigned(c - '0') < 10;
+    }
+
+    double powerOf10(int exponent)
+    {
+        static const double Exact[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+            1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        if (exponent >= 0 && exponent <= 22)
+            return Exact[exponent];
+        if (exponent < 0 && exponent >= -22)
+            return 1.0 / Exact[-exponent];
+        return std::pow(10.0, exponent);
+    }
+}
+
+bool parseNumber(const char*& p, const char* end, float& value)
+{
+    const char* s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+    {
+        negative = *s == '-';
+        s++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; s < end && isDigit(*s); s++, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if (s < end && *s == '.')
+    {
+        for (s++; s < end && isDigit(*s); s++, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any)
+        return false;
+
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        const char* e = s + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+        {
+            negativeExponent = *e == '-';
+            e++;
+        }
+        if (e < end && isDigit(*e))
+        {
+            int power = 0;
+            for (; e < end && isDigit(*e); e++)
+            {
+                if (power < 10000)
+                    power = power * 10 + (*e - '0');
+            }
+            exponent += negativeExponent ? -power : power;
+            s = e;
+        }
+    }
+
+    double result = double(mantissa);
+    if (exponent != 0 && mantissa != 0)
+        result *= powerOf10(exponent);
+    value = float(negative ? -result : result);
+    p = s;
+    return true;
+}
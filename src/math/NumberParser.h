@@ -0,0 +1,10 @@
+#ifndef NUMBERPARSER_H
+#define NUMBERPARSER_H
+
+// Parses a decimal number at p and moves p past it. Much faster than strtof
+// and independent of the locale, which QApplication sets from the
+// environment; up to 19 significant digits are kept, which is far beyond
+// float precision.
+bool parseNumber(const char*& p, const char* end, float& value);
+
+#endif // NUMBERPARSER_H
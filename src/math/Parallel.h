@@ -0,0 +1,45 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of chunks parallelFor() splits count items into.
+inline int parallelChunks(size_t count, size_t minChunk = 16384)
+{
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunks = (count + minChunk - 1) / std::max<size_t>(minChunk, 1);
+    return static_cast<int>(std::max<size_t>(1, std::min(threads, chunks)));
+}
+
+// Runs fn(begin, end, chunk) over contiguous slices of [0, count). The last
+// slice runs on the calling thread. Chunk indices are stable so callers can
+// keep per-chunk accumulators and reduce them afterwards without locking.
+template<typename Fn>
+int parallelFor(size_t count, Fn fn, size_t minChunk = 16384)
+{
+    int chunks = parallelChunks(count, minChunk);
+    if (chunks <= 1)
+    {
+        fn(size_t(0), count, 0);
+        return 1;
+    }
+
+    size_t step = (count + chunks - 1) / chunks;
+    std::vector<std::thread> threads;
+    threads.reserve(chunks - 1);
+    for (int i = 0; i < chunks - 1; i++)
+    {
+        size_t begin = std::min(count, i * step);
+        size_t end = std::min(count, begin + step);
+        threads.emplace_back([=, &fn]() { fn(begin, end, i); });
+    }
+    fn(std::min(count, (chunks - 1) * step), count, chunks - 1);
+    for (std::thread& t : threads)
+        t.join();
+    return chunks;
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,695 @@
+#include "PcaCodec.h"
+#include "EigenSolvers.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include <zlib.h>
+
+
+namespace
+{
+    const char Magic[4] = {'P', 'C', 'A', 'I'};
+    const uint32_t Version = 1;
+
+    enum ChunkCoding
+    {
+        RawChunk = 0,
+        DeltaDeflateChunk
+    };
+
+    void putUint32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            out.push_back(uint8_t(value >> (8 * i)));
+    }
+
+    void putFloat(std::vector<uint8_t>& out, float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, 4);
+        putUint32(out, bits);
+    }
+
+    void setUint64(uint8_t* p, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+            p[i] = uint8_t(value >> (8 * i));
+    }
+
+    void setUint32(uint8_t* p, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            p[i] = uint8_t(value >> (8 * i));
+    }
+
+    // Bounds-checked little-endian reader.
+    struct Reader
+    {
+        const uint8_t* p;
+        const uint8_t* end;
+
+        bool uint32(uint32_t& value)
+        {
+            if (end - p < 4)
+                return false;
+            value = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+            p += 4;
+            return true;
+        }
+
+        bool uint64(uint64_t& value)
+        {
+            uint32_t low, high;
+            if (!uint32(low) || !uint32(high))
+                return false;
+            value = uint64_t(high) << 32 | low;
+            return true;
+        }
+
+        bool float32(float& value)
+        {
+            uint32_t bits;
+            if (!uint32(bits))
+                return false;
+            std::memcpy(&value, &bits, 4);
+            return std::isfinite(value);
+        }
+    };
+
+    uint8_t clampByte(float value)
+    {
+        return uint8_t(std::min(std::max(value, 0.0f), 255.0f) + 0.5f);
+    }
+
+#if defined(SIMD_SSE2)
+    // Broadcast weights and bias of reconstructRow().
+    struct RowWeights
+    {
+        RowWeights(const float* weights, const float* bias)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                b[c] = _mm_set1_ps(bias[c]);
+                for (int k = 0; k < 3; k++)
+                    w[c][k] = _mm_set1_ps(weights[c * 3 + k]);
+            }
+        }
+
+        __m128 w[3][3];
+        __m128 b[3];
+    };
+
+    // Reconstructs the 16 pixels at x as 16 bytes each of R, G and B.
+    inline void reconstructChannels(const uint8_t* const* planes, int count, int x,
+        const RowWeights& weights, __m128i* channels)
+    {
+        // 16 pixels as four vectors of four floats per plane.
+        const __m128i zero = _mm_setzero_si128();
+        __m128 q[3][4];
+        for (int k = 0; k < count; k++)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[k] + x));
+            __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            q[k][0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+            q[k][1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+            q[k][2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+            q[k][3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            __m128i v[4];
+            for (int i = 0; i < 4; i++)
+            {
+                __m128 sum = weights.b[c];
+                for (int k = 0; k < count; k++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(weights.w[c][k], q[k][i]));
+                v[i] = _mm_cvtps_epi32(sum);
+            }
+            // Saturating packs clamp to 0..255.
+            channels[c] = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        }
+    }
+
+    // Reconstructs pixels from x in groups of 16, interleaving through a
+    // buffer, and returns where it stopped.
+    int reconstructRowSse2(const uint8_t* const* planes, int count, int x, int width,
+        const float* weights, const float* bias, uint8_t* rgb)
+    {
+        const RowWeights rowWeights(weights, bias);
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i channels[3];
+            reconstructChannels(planes, count, x, rowWeights, channels);
+            uint8_t planar[3][16];
+            for (int c = 0; c < 3; c++)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(planar[c]), channels[c]);
+            uint8_t* out = rgb + x * 3;
+            for (int i = 0; i < 16; i++)
+            {
+                out[i * 3] = planar[0][i];
+                out[i * 3 + 1] = planar[1][i];
+                out[i * 3 + 2] = planar[2][i];
+            }
+        }
+        return x;
+    }
+#endif
+
+#if defined(SIMD_SSE2) && defined(SIMD_SSSE3)
+    // Scatter 16 bytes of R, G and B into 48 interleaved bytes: mask [o][c]
+    // picks the bytes of channel c that land in output block o.
+    struct InterleaveMasks
+    {
+        InterleaveMasks()
+        {
+            for (int o = 0; o < 3; o++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    uint8_t bytes[16];
+                    for (int j = 0; j < 16; j++)
+                    {
+                        int index = o * 16 + j;
+                        bytes[j] = index % 3 == c ? uint8_t(index / 3) : 0x80;
+                    }
+                    mask[o][c] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+                }
+            }
+        }
+
+        __m128i mask[3][3];
+    };
+
+    // Same as reconstructRowSse2() with the interleave done by shuffles.
+    SIMD_SSSE3_TARGET int reconstructRowSsse3(const uint8_t* const* planes, int count, int x, int width,
+        const float* weights, const float* bias, uint8_t* rgb)
+    {
+        static const InterleaveMasks masks;
+        const RowWeights rowWeights(weights, bias);
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i channels[3];
+            reconstructChannels(planes, count, x, rowWeights, channels);
+            uint8_t* out = rgb + x * 3;
+            for (int o = 0; o < 3; o++)
+            {
+                __m128i block = _mm_or_si128(_mm_or_si128(
+                    _mm_shuffle_epi8(channels[0], masks.mask[o][0]),
+                    _mm_shuffle_epi8(channels[1], masks.mask[o][1])),
+                    _mm_shuffle_epi8(channels[2], masks.mask[o][2]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o * 16), block);
+            }
+        }
+        return x;
+    }
+#endif
+
+    // rgb[c] = bias[c] + sum_k weights[c * 3 + k] * plane_k for one row.
+    void reconstructRow(const uint8_t* const* planes, int count, int width,
+        const float* weights, const float* bias, uint8_t* rgb)
+    {
+        int x = 0;
+#if defined(SIMD_SSE2) && defined(SIMD_SSSE3)
+        if (cpuHasSsse3())
+            x = reconstructRowSsse3(planes, count, x, width, weights, bias, rgb);
+#endif
+#if defined(SIMD_SSE2)
+        x = reconstructRowSse2(planes, count, x, width, weights, bias, rgb);
+#endif
+        for (; x < width; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                float sum = bias[c];
+                for (int k = 0; k < count; k++)
+                    sum += weights[c * 3 + k] * planes[k][x];
+                rgb[x * 3 + c] = clampByte(sum);
+            }
+        }
+    }
+}
+
+PcaImageEncoder::PcaImageEncoder()
+    : m_componentCount(1)
+    , m_chunkRows(64)
+    , m_compression(Deflate)
+    , m_mean(Eigen::Vector3f::Zero())
+    , m_basis(Eigen::Matrix3f::Identity())
+{
+}
+
+bool PcaImageEncoder::encode(const uint8_t* rgb, int width, int height, int stride)
+{
+    m_data.clear();
+    m_error.clear();
+    if (width <= 0 || height <= 0)
+    {
+        m_error = "empty image";
+        return false;
+    }
+    const int components = std::min(std::max(m_componentCount, 1), 3);
+    // The decoder rejects chunks taller than the image.
+    const int chunkRows = std::min(std::max(m_chunkRows, 1), height);
+    const double pixels = double(width) * height;
+
+    // Colour moments, summed exactly in 64-bit integers.
+    std::vector<std::vector<uint64_t> > sums(parallelChunks(height, 8));
+    parallelFor(height, [&](size_t begin, size_t end, int chunk)
+    {
+        uint64_t s[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+        for (size_t i = begin; i < end; i++)
+        {
+            const uint8_t* p = rgb + i * stride;
+            for (int j = 0; j < width; j++, p += 3)
+            {
+                uint32_t r = p[0];
+                uint32_t g = p[1];
+                uint32_t b = p[2];
+                s[0] += r;
+                s[1] += g;
+                s[2] += b;
+                s[3] += r * r;
+                s[4] += r * g;
+                s[5] += r * b;
+                s[6] += g * g;
+                s[7] += g * b;
+                s[8] += b * b;
+            }
+        }
+        sums[chunk].assign(s, s + 9);
+    }, 8);
+
+    double total[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    for (size_t i = 0; i < sums.size(); i++)
+    {
+        for (size_t j = 0; j < sums[i].size(); j++)
+            total[j] += double(sums[i][j]);
+    }
+    double mean[3] = {total[0] / pixels, total[1] / pixels, total[2] / pixels};
+    Eigen::Matrix3f covariance;
+    covariance(0, 0) = float(total[3] / pixels - mean[0] * mean[0]);
+    covariance(0, 1) = covariance(1, 0) = float(total[4] / pixels - mean[0] * mean[1]);
+    covariance(0, 2) = covariance(2, 0) = float(total[5] / pixels - mean[0] * mean[2]);
+    covariance(1, 1) = float(total[6] / pixels - mean[1] * mean[1]);
+    covariance(1, 2) = covariance(2, 1) = float(total[7] / pixels - mean[1] * mean[2]);
+    covariance(2, 2) = float(total[8] / pixels - mean[2] * mean[2]);
+    m_mean << float(mean[0]), float(mean[1]), float(mean[2]);
+
+    Eigen::Vector3f values;
+    symmetricEigen3(covariance, values, m_basis);
+    // Same sign convention as ImagePCA: brighter encodes to larger values.
+    for (int k = 0; k < 3; k++)
+    {
+        if (m_basis.col(k).sum() < 0)
+            m_basis.col(k) = -m_basis.col(k);
+    }
+
+    // The planes span the range actually used along each axis.
+    std::vector<std::vector<float> > ranges(parallelChunks(height, 8));
+    parallelFor(height, [&](size_t begin, size_t end, int chunk)
+    {
+        std::vector<float> range(6);
+        for (int k = 0; k < 3; k++)
+        {
+            range[k * 2] = FLT_MAX;
+            range[k * 2 + 1] = -FLT_MAX;
+        }
+        for (size_t i = begin; i < end; i++)
+        {
+            const uint8_t* p = rgb + i * stride;
+            for (int j = 0; j < width; j++, p += 3)
+            {
+                Eigen::Vector3f x(p[0] - m_mean.x(), p[1] - m_mean.y(), p[2] - m_mean.z());
+                for (int k = 0; k < components; k++)
+                {
+                    float y = m_basis.col(k).dot(x);
+                    range[k * 2] = std::min(range[k * 2], y);
+                    range[k * 2 + 1] = std::max(range[k * 2 + 1], y);
+                }
+            }
+        }
+        ranges[chunk] = range;
+    }, 8);
+
+    float offset[3];
+    float scale[3];
+    for (int k = 0; k < components; k++)
+    {
+        float low = FLT_MAX;
+        float high = -FLT_MAX;
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            if (ranges[i].empty())
+                continue;
+            low = std::min(low, ranges[i][k * 2]);
+            high = std::max(high, ranges[i][k * 2 + 1]);
+        }
+        offset[k] = low;
+        scale[k] = high > low ? (high - low) / 255.0f : 1.0f;
+    }
+
+    // Quantize and code every chunk.
+    const int chunkCount = (height + chunkRows - 1) / chunkRows;
+    std::vector<std::vector<uint8_t> > payloads(chunkCount);
+    std::vector<uint32_t> codings(chunkCount, RawChunk);
+    std::vector<char> failed(chunkCount, 0);
+    const Eigen::Matrix3f basis = m_basis;
+    const Eigen::Vector3f colourMean = m_mean;
+    const Compression compression = m_compression;
+    parallelFor(size_t(chunkCount), [&](size_t begin, size_t end, int)
+    {
+        std::vector<uint8_t> planes;
+        for (size_t c = begin; c < end; c++)
+        {
+            const int top = int(c) * chunkRows;
+            const int rows = std::min(chunkRows, height - top);
+            const size_t planeSize = size_t(rows) * width;
+            planes.resize(planeSize * components);
+            for (int i = 0; i < rows; i++)
+            {
+                const uint8_t* p = rgb + size_t(top + i) * stride;
+                for (int j = 0; j < width; j++, p += 3)
+                {
+                    Eigen::Vector3f x(p[0] - colourMean.x(), p[1] - colourMean.y(), p[2] - colourMean.z());
+                    for (int k = 0; k < components; k++)
+                        planes[k * planeSize + size_t(i) * width + j] = clampByte((basis.col(k).dot(x) - offset[k]) / scale[k]);
+                }
+            }
+
+            std::vector<uint8_t>& payload = payloads[c];
+            if (compression == Deflate)
+            {
+                // Neighbouring pixels differ little, so the deltas are
+                // clustered around zero and code compactly.
+                std::vector<uint8_t> delta(planes.size());
+                for (size_t row = 0; row < planes.size(); row += width)
+                {
+                    uint8_t previous = 0;
+                    for (int j = 0; j < width; j++)
+                    {
+                        delta[row + j] = uint8_t(planes[row + j] - previous);
+                        previous = planes[row + j];
+                    }
+                }
+                z_stream stream;
+                std::memset(&stream, 0, sizeof(stream));
+                if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15, 8, Z_HUFFMAN_ONLY) != Z_OK)
+                {
+                    failed[c] = 1;
+                    continue;
+                }
+                payload.resize(deflateBound(&stream, uLong(delta.size())));
+                stream.next_in = delta.data();
+                stream.avail_in = uInt(delta.size());
+                stream.next_out = payload.data();
+                stream.avail_out = uInt(payload.size());
+                int result = deflate(&stream, Z_FINISH);
+                uLong size = stream.total_out;
+                deflateEnd(&stream);
+                if (result != Z_STREAM_END)
+                {
+                    failed[c] = 1;
+                    continue;
+                }
+                if (size < planes.size())
+                {
+                    payload.resize(size);
+                    codings[c] = DeltaDeflateChunk;
+                    continue;
+                }
+            }
+            payload = planes;
+        }
+    }, 1);
+
+    for (int c = 0; c < chunkCount; c++)
+    {
+        if (failed[c])
+        {
+            m_error = "deflate failed";
+            return false;
+        }
+    }
+
+    m_data.insert(m_data.end(), Magic, Magic + 4);
+    putUint32(m_data, Version);
+    putUint32(m_data, uint32_t(width));
+    putUint32(m_data, uint32_t(height));
+    putUint32(m_data, uint32_t(components));
+    putUint32(m_data, uint32_t(chunkRows));
+    for (int i = 0; i < 3; i++)
+        putFloat(m_data, m_mean(i));
+    for (int k = 0; k < components; k++)
+    {
+        for (int i = 0; i < 3; i++)
+            putFloat(m_data, m_basis(i, k));
+    }
+    for (int k = 0; k < components; k++)
+        putFloat(m_data, offset[k]);
+    for (int k = 0; k < components; k++)
+        putFloat(m_data, scale[k]);
+    putUint32(m_data, uint32_t(chunkCount));
+
+    // Entries are filled in as the chunks are appended; they are addressed
+    // by index since appending may move the buffer.
+    size_t table = m_data.size();
+    m_data.resize(table + size_t(chunkCount) * 16);
+    for (int c = 0; c < chunkCount; c++)
+    {
+        uint8_t* entry = m_data.data() + table + size_t(c) * 16;
+        setUint64(entry, m_data.size());
+        setUint32(entry + 8, uint32_t(payloads[c].size()));
+        setUint32(entry + 12, codings[c]);
+        m_data.insert(m_data.end(), payloads[c].begin(), payloads[c].end());
+    }
+    return true;
+}
+
+bool PcaImageEncoder::save(const std::string& filename) const
+{
+    std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        m_error = "cannot open " + filename;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(m_data.data()), std::streamsize(m_data.size()));
+    if (!file)
+    {
+        m_error = "cannot write " + filename;
+        return false;
+    }
+    return true;
+}
+
+PcaImageDecoder::PcaImageDecoder()
+    : m_width(0)
+    , m_height(0)
+    , m_componentCount(0)
+    , m_chunkRows(0)
+    , m_mean(Eigen::Vector3f::Zero())
+    , m_basis(Eigen::Matrix3f::Zero())
+{
+    for (int k = 0; k < 3; k++)
+    {
+        m_offset[k] = 0;
+        m_scale[k] = 1;
+    }
+}
+
+bool PcaImageDecoder::load(const std::string& filename)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+        m_error = "cannot open " + filename;
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<uint8_t> data(size > 0 ? size_t(size) : 0);
+    if (!data.empty())
+        file.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+    if (!file)
+    {
+        m_error = "cannot read " + filename;
+        return false;
+    }
+    return open(data);
+}
+
+bool PcaImageDecoder::open(std::vector<uint8_t>& data)
+{
+    m_data.swap(data);
+    data.clear();
+    m_error.clear();
+    m_chunks.clear();
+    m_width = 0;
+    m_height = 0;
+    if (!parse())
+    {
+        m_chunks.clear();
+        m_width = 0;
+        m_height = 0;
+        if (m_error.empty())
+            m_error = "not a valid .pcai file";
+        return false;
+    }
+    return true;
+}
+
+bool PcaImageDecoder::parse()
+{
+    Reader reader = {m_data.data(), m_data.data() + m_data.size()};
+    if (m_data.size() < 4 || std::memcmp(m_data.data(), Magic, 4) != 0)
+        return false;
+    reader.p += 4;
+
+    uint32_t version, width, height, components, chunkRows, chunkCount;
+    if (!reader.uint32(version) || !reader.uint32(width) || !reader.uint32(height)
+        || !reader.uint32(components) || !reader.uint32(chunkRows))
+        return false;
+    if (version != Version)
+    {
+        m_error = "unsupported .pcai version " + std::to_string(version);
+        return false;
+    }
+    if (width == 0 || height == 0 || width > 1u << 20 || height > 1u << 20
+        || components < 1 || components > 3 || chunkRows == 0 || chunkRows > height)
+        return false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!reader.float32(m_mean(i)))
+            return false;
+    }
+    m_basis.setZero();
+    for (uint32_t k = 0; k < components; k++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (!reader.float32(m_basis(i, k)))
+                return false;
+        }
+    }
+    for (uint32_t k = 0; k < components; k++)
+    {
+        if (!reader.float32(m_offset[k]))
+            return false;
+    }
+    for (uint32_t k = 0; k < components; k++)
+    {
+        if (!reader.float32(m_scale[k]))
+            return false;
+    }
+    if (!reader.uint32(chunkCount) || chunkCount != (uint64_t(height) + chunkRows - 1) / chunkRows)
+        return false;
+
+    m_chunks.resize(chunkCount);
+    for (uint32_t c = 0; c < chunkCount; c++)
+    {
+        Chunk& chunk = m_chunks[c];
+        if (!reader.uint64(chunk.offset) || !reader.uint32(chunk.size) || !reader.uint32(chunk.coding))
+            return false;
+        if (chunk.offset > m_data.size() || chunk.size > m_data.size() - chunk.offset
+            || chunk.coding > DeltaDeflateChunk)
+            return false;
+    }
+
+    m_width = int(width);
+    m_height = int(height);
+    m_componentCount = int(components);
+    m_chunkRows = int(chunkRows);
+    return true;
+}
+
+bool PcaImageDecoder::decodeChunk(int chunk, uint8_t* rgb, int stride) const
+{
+    if (chunk < 0 || chunk >= chunkCount())
+        return false;
+
+    const Chunk& entry = m_chunks[chunk];
+    const int top = chunk * m_chunkRows;
+    const int rows = std::min(m_chunkRows, m_height - top);
+    const size_t planeSize = size_t(rows) * m_width;
+    const size_t rawSize = planeSize * m_componentCount;
+    const uint8_t* source = m_data.data() + entry.offset;
+
+    std::vector<uint8_t> planes;
+    if (entry.coding == DeltaDeflateChunk)
+    {
+        planes.resize(rawSize);
+        uLongf size = uLongf(rawSize);
+        if (uncompress(planes.data(), &size, source, uLong(entry.size)) != Z_OK || size != rawSize)
+            return false;
+        for (size_t row = 0; row < rawSize; row += m_width)
+        {
+            uint8_t value = 0;
+            for (int j = 0; j < m_width; j++)
+            {
+                value = uint8_t(value + planes[row + j]);
+                planes[row + j] = value;
+            }
+        }
+        source = planes.data();
+    }
+    else if (entry.size != rawSize)
+    {
+        return false;
+    }
+
+    // Folds the mean, the offsets and the scales into one affine map from
+    // plane bytes to colours.
+    float weights[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    float bias[3];
+    for (int c = 0; c < 3; c++)
+    {
+        bias[c] = m_mean(c);
+        for (int k = 0; k < m_componentCount; k++)
+        {
+            weights[c * 3 + k] = m_basis(c, k) * m_scale[k];
+            bias[c] += m_basis(c, k) * m_offset[k];
+        }
+    }
+
+    const uint8_t* planeRows[3];
+    for (int i = 0; i < rows; i++)
+    {
+        for (int k = 0; k < m_componentCount; k++)
+            planeRows[k] = source + k * planeSize + size_t(i) * m_width;
+        reconstructRow(planeRows, m_componentCount, m_width, weights, bias, rgb + size_t(top + i) * stride);
+    }
+    return true;
+}
+
+bool PcaImageDecoder::decode(uint8_t* rgb, int stride) const
+{
+    if (m_chunks.empty())
+        return false;
+
+    std::vector<char> failed(m_chunks.size(), 0);
+    parallelFor(m_chunks.size(), [&](size_t begin, size_t end, int)
+    {
+        for (size_t c = begin; c < end; c++)
+            failed[c] = !decodeChunk(int(c), rgb, stride);
+    }, 1);
+
+    for (size_t c = 0; c < failed.size(); c++)
+    {
+        if (failed[c])
+        {
+            m_error = "corrupt chunk " + std::to_string(c);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef PCACODEC_H
+#define PCACODEC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+
+// Compact container for colour PCA encoded images (.pcai).
+//
+// An RGB image is stored as its colour mean, the top 1 - 3 principal axes of
+// the centred colour covariance and, per axis, an 8-bit plane of the pixel
+// coordinates along it with the offset and scale that map 0..255 back to
+// them. The planes are cut into chunks of rows that are coded independently,
+// so chunks decode in parallel. A chunk is optionally entropy coded: its
+// rows are delta coded and Huffman coded with zlib (deflate without string
+// matching, which buys little on photographic planes but costs most of the
+// time), and kept raw if that does not help.
+//
+// Layout, all little-endian:
+//   "PCAI", version, width, height, components, chunk rows
+//   mean[3], basis[3 x components] by axis, offset[components], scale[components]
+//   chunk count, then per chunk: file offset (u64), size, coding
+//   chunk data: the chunk's rows of plane 0, then of plane 1, ...
+class PcaImageEncoder
+{
+public:
+    enum Compression
+    {
+        NoCompression = 0,
+        Deflate
+    };
+
+    PcaImageEncoder();
+
+    // Principal axes kept, 1 - 3. Three keep everything but the quantization.
+    void setComponentCount(int count) { m_componentCount = count; }
+    int componentCount() const { return m_componentCount; }
+    void setChunkRows(int rows) { m_chunkRows = rows; }
+    void setCompression(Compression compression) { m_compression = compression; }
+
+    // stride is the row pitch in bytes; pixels are R, G, B.
+    bool encode(const uint8_t* rgb, int width, int height, int stride);
+    bool save(const std::string& filename) const;
+
+    const std::vector<uint8_t>& data() const { return m_data; }
+    const Eigen::Vector3f& mean() const { return m_mean; }
+    // Principal axes as columns, strongest first.
+    const Eigen::Matrix3f& basis() const { return m_basis; }
+    const std::string& errorString() const { return m_error; }
+
+private:
+    int m_componentCount;
+    int m_chunkRows;
+    Compression m_compression;
+
+    Eigen::Vector3f m_mean;
+    Eigen::Matrix3f m_basis;
+    std::vector<uint8_t> m_data;
+    mutable std::string m_error;
+};
+
+class PcaImageDecoder
+{
+public:
+    PcaImageDecoder();
+
+    bool load(const std::string& filename);
+    // Takes over the encoded bytes.
+    bool open(std::vector<uint8_t>& data);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int componentCount() const { return m_componentCount; }
+    int chunkRows() const { return m_chunkRows; }
+    int chunkCount() const { return int(m_chunks.size()); }
+    const Eigen::Vector3f& mean() const { return m_mean; }
+    const Eigen::Matrix3f& basis() const { return m_basis; }
+
+    // Writes the chunk's rows to rgb, which points at row 0 of a width x
+    // height image, stride bytes per row. Safe to call from several threads.
+    bool decodeChunk(int chunk, uint8_t* rgb, int stride) const;
+    // Decodes all chunks in parallel.
+    bool decode(uint8_t* rgb, int stride) const;
+
+    const std::string& errorString() const { return m_error; }
+
+private:
+    struct Chunk
+    {
+        uint64_t offset;
+        uint32_t size;
+        uint32_t coding;
+    };
+
+    bool parse();
+
+private:
+    std::vector<uint8_t> m_data;
+    int m_width;
+    int m_height;
+    int m_componentCount;
+    int m_chunkRows;
+    Eigen::Vector3f m_mean;
+    Eigen::Matrix3f m_basis;
+    float m_offset[3];
+    float m_scale[3];
+    std::vector<Chunk> m_chunks;
+    mutable std::string m_error;
+};
+
+#endif // PCACODEC_H
@@ -0,0 +1,236 @@
+#include "PngWriter.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+namespace
+{
+    // Raw bytes a slice should cover at least, so the per-slice overhead of
+    // a deflate stream and a sync marker stays negligible.
+    const size_t MinSliceBytes = 1 << 20;
+
+    void toRgb(const uint32_t* pixels, int width, unsigned char* rgb)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            uint32_t p = pixels[i];
+            rgb[0] = (unsigned char)(p >> 16);
+            rgb[1] = (unsigned char)(p >> 8);
+            rgb[2] = (unsigned char)p;
+            rgb += 3;
+        }
+    }
+
+    void putUint32(unsigned char* p, uint32_t value)
+    {
+        p[0] = (unsigned char)(value >> 24);
+        p[1] = (unsigned char)(value >> 16);
+        p[2] = (unsigned char)(value >> 8);
+        p[3] = (unsigned char)value;
+    }
+
+    // Runs deflate until all input is consumed and, for a flush, the output
+    // is complete, growing out as needed.
+    bool deflateInto(z_stream& stream, std::vector<unsigned char>& out, int flush)
+    {
+        do
+        {
+            if (stream.avail_out == 0)
+            {
+                size_t used = out.size();
+                out.resize(used * 2);
+                stream.next_out = out.data() + used;
+                stream.avail_out = uInt(out.size() - used);
+            }
+            if (deflate(&stream, flush) == Z_STREAM_ERROR)
+                return false;
+        } while (stream.avail_in > 0 || (flush != Z_NO_FLUSH && stream.avail_out == 0));
+        return true;
+    }
+}
+
+PngWriter::PngWriter()
+    : m_level(Z_DEFAULT_COMPRESSION)
+    , m_width(0)
+    , m_height(0)
+    , m_row(0)
+    , m_adler(0)
+    , m_bytes(0)
+{
+}
+
+PngWriter::~PngWriter()
+{
+    if (m_file.is_open())
+        m_file.close();
+}
+
+bool PngWriter::fail(const std::string& error)
+{
+    m_error = error;
+    if (m_file.is_open())
+        m_file.close();
+    return false;
+}
+
+bool PngWriter::open(const std::string& filename, int width, int height)
+{
+    if (m_file.is_open())
+        m_file.close();
+    m_error.clear();
+    m_filename = filename;
+    m_width = width;
+    m_height = height;
+    m_row = 0;
+    m_bytes = 0;
+    m_adler = adler32(0, Z_NULL, 0);
+    m_previous.assign(size_t(std::max(width, 0)) * 3, 0);
+    if (width <= 0 || height <= 0)
+        return fail("invalid image size");
+
+    m_file.open(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!m_file)
+        return fail("cannot open " + filename);
+
+    static const unsigned char Signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    m_file.write(reinterpret_cast<const char*>(Signature), sizeof(Signature));
+    m_bytes += sizeof(Signature);
+
+    // 8-bit truecolour, deflate, adaptive filtering, no interlace.
+    unsigned char header[13];
+    putUint32(header, uint32_t(width));
+    putUint32(header + 4, uint32_t(height));
+    header[8] = 8;
+    header[9] = 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    if (!writeChunk("IHDR", header, sizeof(header)))
+        return false;
+
+    // The zlib header opens the stream the slices are appended to.
+    static const unsigned char ZlibHeader[] = {0x78, 0x01};
+    return writeChunk("IDAT", ZlibHeader, sizeof(ZlibHeader));
+}
+
+bool PngWriter::writeRows(const unsigned char* data, size_t bytesPerLine, int count)
+{
+    if (!m_file.is_open())
+        return false;
+    count = std::min(count, m_height - m_row);
+    if (count <= 0)
+        return true;
+
+    const size_t rowBytes = size_t(m_width) * 3;
+    const size_t minChunk = std::max<size_t>(1, MinSliceBytes / (rowBytes + 1));
+    const int chunks = parallelChunks(size_t(count), minChunk);
+    std::vector<std::vector<unsigned char> > slices(chunks);
+    std::vector<unsigned long> adlers(chunks);
+    std::vector<size_t> lengths(chunks, 0);
+    std::vector<char> failed(chunks, 0);
+    const int width = m_width;
+    const int level = m_level;
+    const std::vector<unsigned char>& carried = m_previous;
+
+    parallelFor(size_t(count), [&](size_t begin, size_t stop, int chunk)
+    {
+        // Every row gets the Up filter: cheap, and effective on plots,
+        // which are mostly flat areas and vertical structure.
+        std::vector<unsigned char> line(rowBytes + 1);
+        std::vector<unsigned char> current(rowBytes);
+        std::vector<unsigned char> previous(rowBytes);
+        if (begin == 0)
+            previous = carried;
+        else
+            toRgb(reinterpret_cast<const uint32_t*>(data + (begin - 1) * bytesPerLine), width, previous.data());
+
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            failed[chunk] = 1;
+            return;
+        }
+
+        std::vector<unsigned char>& out = slices[chunk];
+        out.resize(deflateBound(&stream, uLong((stop - begin) * line.size())) + 64);
+        stream.next_out = out.data();
+        stream.avail_out = uInt(out.size());
+        unsigned long adler = adler32(0, Z_NULL, 0);
+        for (size_t i = begin; i < stop && !failed[chunk]; i++)
+        {
+            toRgb(reinterpret_cast<const uint32_t*>(data + i * bytesPerLine), width, current.data());
+            line[0] = 2;
+            for (size_t j = 0; j < rowBytes; j++)
+                line[j + 1] = (unsigned char)(current[j] - previous[j]);
+            adler = adler32(adler, line.data(), uInt(line.size()));
+
+            stream.next_in = line.data();
+            stream.avail_in = uInt(line.size());
+            if (!deflateInto(stream, out, i + 1 == stop ? Z_SYNC_FLUSH : Z_NO_FLUSH))
+                failed[chunk] = 1;
+            current.swap(previous);
+        }
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        adlers[chunk] = adler;
+        lengths[chunk] = (stop - begin) * line.size();
+    }, minChunk);
+
+    for (int i = 0; i < chunks; i++)
+    {
+        if (failed[i])
+            return fail("deflate failed");
+        m_adler = adler32_combine(m_adler, adlers[i], z_off_t(lengths[i]));
+        if (!slices[i].empty() && !writeChunk("IDAT", slices[i].data(), slices[i].size()))
+            return false;
+    }
+
+    toRgb(reinterpret_cast<const uint32_t*>(data + size_t(count - 1) * bytesPerLine), m_width, m_previous.data());
+    m_row += count;
+    return true;
+}
+
+bool PngWriter::close()
+{
+    if (!m_file.is_open())
+        return false;
+    if (m_row < m_height)
+        return fail("only " + std::to_string(m_row) + " of " + std::to_string(m_height) + " rows written");
+
+    // An empty final block with fixed codes ends the deflate stream, then
+    // comes the Adler-32 of all filtered rows.
+    unsigned char trailer[6] = {0x03, 0x00};
+    putUint32(trailer + 2, uint32_t(m_adler));
+    if (!writeChunk("IDAT", trailer, sizeof(trailer)) || !writeChunk("IEND", nullptr, 0))
+        return false;
+
+    m_file.close();
+    if (m_file.fail())
+        return fail("cannot write " + m_filename);
+    return true;
+}
+
+bool PngWriter::writeChunk(const char* type, const unsigned char* data, size_t size)
+{
+    unsigned char length[4];
+    putUint32(length, uint32_t(size));
+    unsigned long crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    if (size > 0)
+        crc = crc32(crc, data, uInt(size));
+    unsigned char checksum[4];
+    putUint32(checksum, uint32_t(crc));
+
+    m_file.write(reinterpret_cast<const char*>(length), 4);
+    m_file.write(type, 4);
+    if (size > 0)
+        m_file.write(reinterpret_cast<const char*>(data), std::streamsize(size));
+    m_file.write(reinterpret_cast<const char*>(checksum), 4);
+    if (!m_file)
+        return fail("cannot write " + m_filename);
+    m_bytes += size + 12;
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes an 8-bit RGB PNG row by row, so images far larger than memory can be
+// encoded while they are being produced.
+//
+// Each writeRows() call is split into slices deflated in parallel. A slice
+// ends on a byte-aligned sync flush and does not reference the data of the
+// others, so the slices simply concatenate into one zlib stream; their
+// Adler-32 checksums are combined in order. This costs a little compression
+// compared to a single deflate stream.
+class PngWriter
+{
+public:
+    PngWriter();
+    ~PngWriter();
+
+    // zlib compression level, 0 - 9.
+    void setLevel(int level) { m_level = level; }
+    int level() const { return m_level; }
+
+    bool open(const std::string& filename, int width, int height);
+    // Appends count rows of 32-bit 0xAARRGGBB pixels, as in QImage's RGB32
+    // format, bytesPerLine apart. Alpha is dropped.
+    bool writeRows(const unsigned char* data, size_t bytesPerLine, int count);
+    // Finishes the file; fails if fewer than height rows were written.
+    bool close();
+    bool isOpen() const { return m_file.is_open(); }
+
+    int rowsWritten() const { return m_row; }
+    unsigned long long bytesWritten() const { return m_bytes; }
+    const std::string& errorString() const { return m_error; }
+
+private:
+    bool writeChunk(const char* type, const unsigned char* data, size_t size);
+    bool fail(const std::string& error);
+
+private:
+    std::ofstream m_file;
+    std::string m_filename;
+    int m_level;
+    int m_width;
+    int m_height;
+    int m_row;
+    unsigned long m_adler;
+    unsigned long long m_bytes;
+    // Last row written, as RGB, for the Up filter of the next call.
+    std::vector<unsigned char> m_previous;
+    std::string m_error;
+};
+
+#endif // PNGWRITER_H
@@ -0,0 +1,318 @@
+#include "PointIndex.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+struct PointIndex::Tree
+{
+    // First point of the PointSet this tree covers.
+    size_t begin;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<uint32_t> ids;
+    // levels[0] holds the leaves, the last level the root.
+    std::vector<std::vector<Rect>> levels;
+    // Points covered by one node of each level.
+    std::vector<size_t> spans;
+};
+
+namespace
+{
+    // Spreads the low 16 bits of v over the even bits.
+    uint32_t interleave(uint32_t v)
+    {
+        v &= 0xffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    PointIndex::Rect emptyRect()
+    {
+        PointIndex::Rect rect;
+        rect.left = rect.bottom = std::numeric_limits<float>::max();
+        rect.right = rect.top = -std::numeric_limits<float>::max();
+        return rect;
+    }
+
+    void unite(PointIndex::Rect& a, const PointIndex::Rect& b)
+    {
+        a.left = std::min(a.left, b.left);
+        a.bottom = std::min(a.bottom, b.bottom);
+        a.right = std::max(a.right, b.right);
+        a.top = std::max(a.top, b.top);
+    }
+
+    bool intersects(const PointIndex::Rect& a, const PointIndex::Rect& b)
+    {
+        return a.left <= b.right && b.left <= a.right && a.bottom <= b.top && b.bottom <= a.top;
+    }
+
+    bool contains(const PointIndex::Rect& outer, const PointIndex::Rect& inner)
+    {
+        return outer.left <= inner.left && inner.right <= outer.right
+            && outer.bottom <= inner.bottom && inner.top <= outer.top;
+    }
+
+    float distance2(const PointIndex::Rect& rect, float x, float y)
+    {
+        float dx = std::max(std::max(rect.left - x, x - rect.right), 0.0f);
+        float dy = std::max(std::max(rect.bottom - y, y - rect.top), 0.0f);
+        return dx * dx + dy * dy;
+    }
+
+    // Stable LSD radix sort on the upper 32 bits, one byte per pass.
+    void sortByKey(std::vector<uint64_t>& keys)
+    {
+        std::vector<uint64_t> buffer(keys.size());
+        for (int shift = 32; shift < 64; shift += 8)
+        {
+            size_t offsets[257] = {0};
+            for (size_t i = 0; i < keys.size(); i++)
+                offsets[((keys[i] >> shift) & 0xff) + 1]++;
+            if (offsets[((keys.empty() ? 0 : keys[0] >> shift) & 0xff) + 1] == keys.size())
+                continue;
+            for (int b = 0; b < 256; b++)
+                offsets[b + 1] += offsets[b];
+            for (size_t i = 0; i < keys.size(); i++)
+                buffer[offsets[(keys[i] >> shift) & 0xff]++] = keys[i];
+            keys.swap(buffer);
+        }
+    }
+}
+
+PointIndex::PointIndex()
+    : m_size(0)
+    , m_buildMs(0)
+{
+}
+
+void PointIndex::clear()
+{
+    m_trees.clear();
+    m_size = 0;
+}
+
+void PointIndex::build(const PointSet& points)
+{
+    clear();
+    update(points);
+}
+
+void PointIndex::update(const PointSet& points)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t end = points.size();
+    if (end < m_size)
+        clear();
+
+    if (end > m_size)
+    {
+        // Fold trees no more than twice the size of the new one into it.
+        size_t begin = m_size;
+        while (!m_trees.empty() && m_trees.back()->x.size() <= 2 * (end - begin))
+        {
+            begin = m_trees.back()->begin;
+            m_trees.pop_back();
+        }
+        m_trees.push_back(buildTree(points, begin, end));
+        m_size = end;
+    }
+    m_buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::shared_ptr<const PointIndex::Tree> PointIndex::buildTree(const PointSet& points, size_t begin, size_t end) const
+{
+    std::shared_ptr<Tree> tree(new Tree);
+    size_t count = end - begin;
+    const float* xs = points.x.data() + begin;
+    const float* ys = points.y.data() + begin;
+    tree->begin = begin;
+
+    std::vector<Rect> chunkBounds(parallelChunks(count), emptyRect());
+    parallelFor(count, [&](size_t first, size_t last, int chunk)
+    {
+        Rect bounds = emptyRect();
+        for (size_t i = first; i < last; i++)
+        {
+            bounds.left = std::min(bounds.left, xs[i]);
+            bounds.right = std::max(bounds.right, xs[i]);
+            bounds.bottom = std::min(bounds.bottom, ys[i]);
+            bounds.top = std::max(bounds.top, ys[i]);
+        }
+        chunkBounds[chunk] = bounds;
+    });
+    Rect bounds = emptyRect();
+    for (const Rect& rect : chunkBounds)
+        unite(bounds, rect);
+
+    // Morton code of the point quantized to 16 bits per axis in the upper
+    // half, its position in the lower half.
+    float sx = bounds.right > bounds.left ? 65535.0f / (bounds.right - bounds.left) : 0.0f;
+    float sy = bounds.top > bounds.bottom ? 65535.0f / (bounds.top - bounds.bottom) : 0.0f;
+    std::vector<uint64_t> keys(count);
+    parallelFor(count, [&](size_t first, size_t last, int)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            uint32_t qx = uint32_t((xs[i] - bounds.left) * sx);
+            uint32_t qy = uint32_t((ys[i] - bounds.bottom) * sy);
+            keys[i] = (uint64_t(interleave(qx) | (interleave(qy) << 1)) << 32) | uint64_t(i);
+        }
+    });
+    sortByKey(keys);
+
+    tree->x.resize(count);
+    tree->y.resize(count);
+    tree->ids.resize(count);
+    parallelFor(count, [&](size_t first, size_t last, int)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            uint32_t id = uint32_t(keys[i]);
+            tree->x[i] = xs[id];
+            tree->y[i] = ys[id];
+            tree->ids[i] = uint32_t(begin + id);
+        }
+    });
+
+    size_t leaves = (count + LeafSize - 1) / LeafSize;
+    tree->levels.push_back(std::vector<Rect>(leaves));
+    tree->spans.push_back(LeafSize);
+    parallelFor(leaves, [&](size_t first, size_t last, int)
+    {
+        for (size_t leaf = first; leaf < last; leaf++)
+        {
+            Rect rect = emptyRect();
+            size_t stop = std::min(count, (leaf + 1) * LeafSize);
+            for (size_t i = leaf * LeafSize; i < stop; i++)
+            {
+                rect.left = std::min(rect.left, tree->x[i]);
+                rect.right = std::max(rect.right, tree->x[i]);
+                rect.bottom = std::min(rect.bottom, tree->y[i]);
+                rect.top = std::max(rect.top, tree->y[i]);
+            }
+            tree->levels[0][leaf] = rect;
+        }
+    }, 1024);
+
+    while (tree->levels.back().size() > 1)
+    {
+        const std::vector<Rect>& children = tree->levels.back();
+        std::vector<Rect> nodes((children.size() + Fanout - 1) / Fanout, emptyRect());
+        for (size_t i = 0; i < children.size(); i++)
+            unite(nodes[i / Fanout], children[i]);
+        tree->spans.push_back(tree->spans.back() * Fanout);
+        tree->levels.push_back(nodes);
+    }
+    return tree;
+}
+
+void PointIndex::query(const Rect& rect, const Visitor& visit) const
+{
+    for (const std::shared_ptr<const Tree>& tree : m_trees)
+    {
+        // Adjacent nodes are merged into one run before visiting.
+        size_t runBegin = 0;
+        size_t runEnd = 0;
+        queryNode(*tree, int(tree->levels.size()) - 1, 0, rect, visit, runBegin, runEnd);
+        if (runEnd > runBegin)
+            visit(tree->x.data() + runBegin, tree->y.data() + runBegin, tree->ids.data() + runBegin, runEnd - runBegin);
+    }
+}
+
+void PointIndex::queryNode(const Tree& tree, int level, size_t node, const Rect& rect, const Visitor& visit,
+    size_t& runBegin, size_t& runEnd)
+{
+    const Rect& bounds = tree.levels[level][node];
+    if (!intersects(bounds, rect))
+        return;
+
+    if (level == 0 || contains(rect, bounds))
+    {
+        size_t begin = node * tree.spans[level];
+        size_t end = std::min(tree.x.size(), begin + tree.spans[level]);
+        if (begin != runEnd)
+        {
+            if (runEnd > runBegin)
+                visit(tree.x.data() + runBegin, tree.y.data() + runBegin, tree.ids.data() + runBegin, runEnd - runBegin);
+            runBegin = begin;
+        }
+        runEnd = end;
+        return;
+    }
+
+    size_t last = std::min(tree.levels[level - 1].size(), (node + 1) * Fanout);
+    for (size_t child = node * Fanout; child < last; child++)
+        queryNode(tree, level - 1, child, rect, visit, runBegin, runEnd);
+}
+
+size_t PointIndex::count(const Rect& rect) const
+{
+    size_t total = 0;
+    query(rect, [&](const float* x, const float* y, const uint32_t*, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (x[i] >= rect.left && x[i] <= rect.right && y[i] >= rect.bottom && y[i] <= rect.top)
+                total++;
+        }
+    });
+    return total;
+}
+
+long long PointIndex::nearest(float x, float y, float maxDistance) const
+{
+    float bestDistance = maxDistance * maxDistance;
+    long long best = -1;
+    for (const std::shared_ptr<const Tree>& tree : m_trees)
+    {
+        int top = int(tree->levels.size()) - 1;
+        if (distance2(tree->levels[top][0], x, y) < bestDistance)
+            nearestNode(*tree, top, 0, x, y, bestDistance, best);
+    }
+    return best;
+}
+
+void PointIndex::nearestNode(const Tree& tree, int level, size_t node, float x, float y,
+    float& bestDistance, long long& best)
+{
+    if (level == 0)
+    {
+        size_t end = std::min(tree.x.size(), (node + 1) * LeafSize);
+        for (size_t i = node * LeafSize; i < end; i++)
+        {
+            float dx = tree.x[i] - x;
+            float dy = tree.y[i] - y;
+            float d = dx * dx + dy * dy;
+            if (d < bestDistance)
+            {
+                bestDistance = d;
+                best = tree.ids[i];
+            }
+        }
+        return;
+    }
+
+    // Closest children first, so the bound tightens early.
+    std::pair<float, size_t> children[Fanout];
+    int count = 0;
+    size_t last = std::min(tree.levels[level - 1].size(), (node + 1) * Fanout);
+    for (size_t child = node * Fanout; child < last; child++)
+    {
+        float d = distance2(tree.levels[level - 1][child], x, y);
+        if (d < bestDistance)
+            children[count++] = std::make_pair(d, child);
+    }
+    std::sort(children, children + count);
+    for (int i = 0; i < count; i++)
+    {
+        if (children[i].first >= bestDistance)
+            break;
+        nearestNode(tree, level - 1, children[i].second, x, y, bestDistance, best);
+    }
+}
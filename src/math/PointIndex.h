@@ -0,0 +1,83 @@
+#ifndef POINTINDEX_H
+#define POINTINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "PointSet.h"
+
+// Packed R-tree over a PointSet, bulk loaded in Morton order.
+//
+// Points are sorted along a Z-order curve and cut into leaves of LeafSize.
+// Each level above groups Fanout consecutive nodes of the one below, so the
+// tree needs no child pointers and every node covers a contiguous run of the
+// sorted points. The tree keeps its own sorted copy of the coordinates, so a
+// run can be streamed without gathering.
+//
+// Appended points go into a new tree. Trees at most twice its size are merged
+// into it first, like a binary counter, so n points appended in any number of
+// batches are indexed in O(n log n) in total and a query visits O(log n)
+// trees. Copies share their trees.
+class PointIndex
+{
+public:
+    static const int LeafSize = 32;
+    static const int Fanout = 16;
+
+    struct Rect
+    {
+        float left;
+        float bottom;
+        float right;
+        float top;
+    };
+
+    // Called with runs of sorted coordinates; ids map them back to the
+    // PointSet.
+    typedef std::function<void(const float* x, const float* y, const uint32_t* ids, size_t count)> Visitor;
+
+    PointIndex();
+
+    // Indexes the whole set from scratch.
+    void build(const PointSet& points);
+    // Indexes points appended since the last build() or update(). The first
+    // size() points must be the ones already indexed.
+    void update(const PointSet& points);
+    void clear();
+
+    size_t size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    int treeCount() const { return int(m_trees.size()); }
+
+    // Visits the points of every leaf whose bounds intersect rect. Nodes that
+    // lie inside rect are passed as one run, so points of boundary leaves may
+    // fall outside it.
+    void query(const Rect& rect, const Visitor& visit) const;
+    size_t count(const Rect& rect) const;
+
+    // Index of the point nearest to (x, y) that lies within maxDistance, or
+    // -1 if there is none.
+    long long nearest(float x, float y, float maxDistance) const;
+
+    // Time taken by the last build() or update().
+    double buildMs() const { return m_buildMs; }
+
+private:
+    struct Tree;
+
+    std::shared_ptr<const Tree> buildTree(const PointSet& points, size_t begin, size_t end) const;
+    static void queryNode(const Tree& tree, int level, size_t node, const Rect& rect, const Visitor& visit,
+        size_t& runBegin, size_t& runEnd);
+    static void nearestNode(const Tree& tree, int level, size_t node, float x, float y,
+        float& bestDistance, long long& best);
+
+private:
+    std::vector<std::shared_ptr<const Tree>> m_trees;
+    size_t m_size;
+    double m_buildMs;
+};
+
+#endif // POINTINDEX_H
@@ -0,0 +1,21 @@
+#ifndef POINTSET_H
+#define POINTSET_H
+
+#include <cstddef>
+#include <vector>
+
+// Structure-of-arrays point storage. Kernels stream x and y as contiguous
+// float arrays, which keeps them vectorizable at tens of millions of points.
+struct PointSet
+{
+    std::vector<float> x;
+    std::vector<float> y;
+
+    size_t size() const { return x.size(); }
+    bool isEmpty() const { return x.empty(); }
+    void clear() { x.clear(); y.clear(); }
+    void reserve(size_t count) { x.reserve(count); y.reserve(count); }
+    void append(float px, float py) { x.push_back(px); y.push_back(py); }
+};
+
+#endif // POINTSET_H
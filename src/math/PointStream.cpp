@@ -0,0 +1,262 @@
+#include "PointStream.h"
+#include "NumberParser.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Ring slots; with the default batch size up to 4M points are queued.
+    const size_t RingBatches = 64;
+    const size_t ReadSize = 1 << 20;
+
+    bool isSeparator(char c)
+    {
+        return c == ',' || c == ';' || c == ' ' || c == '\t';
+    }
+
+    void sleepMs(int milliseconds)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+    }
+}
+
+PointStream::PointStream()
+    : m_ring(RingBatches)
+    , m_batchSize(65536)
+    , m_fd(-1)
+    , m_socket(false)
+    , m_stop(false)
+    , m_finished(false)
+    , m_received(0)
+    , m_stalls(0)
+{
+}
+
+PointStream::~PointStream()
+{
+    close();
+}
+
+bool PointStream::open(const std::string& source)
+{
+    close();
+    m_error.clear();
+    m_received = 0;
+    m_stalls = 0;
+    m_finished = false;
+    m_stop = false;
+
+#ifdef _WIN32
+    m_socket = false;
+    m_fd = ::_open(source.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    struct stat info;
+    if (::stat(source.c_str(), &info) != 0)
+    {
+        setError("cannot stat " + source + ": " + std::strerror(errno));
+        return false;
+    }
+
+    m_socket = S_ISSOCK(info.st_mode);
+    if (m_socket)
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (source.size() >= sizeof(address.sun_path))
+        {
+            setError("socket path too long: " + source);
+            return false;
+        }
+        std::strncpy(address.sun_path, source.c_str(), sizeof(address.sun_path) - 1);
+        m_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m_fd >= 0 && ::connect(m_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+    else
+    {
+        // Non-blocking, so opening a FIFO does not wait for its writer and a
+        // read never outlives close().
+        m_fd = ::open(source.c_str(), O_RDONLY | O_NONBLOCK);
+    }
+#endif
+    if (m_fd < 0)
+    {
+        setError("cannot open " + source + ": " + std::strerror(errno));
+        return false;
+    }
+
+    m_batch.clear();
+    m_batch.reserve(m_batchSize);
+    m_thread = std::thread(&PointStream::run, this);
+    return true;
+}
+
+void PointStream::close()
+{
+    if (m_thread.joinable())
+    {
+        m_stop = true;
+        m_thread.join();
+    }
+    if (m_fd >= 0)
+    {
+#ifdef _WIN32
+        ::_close(m_fd);
+#else
+        ::close(m_fd);
+#endif
+        m_fd = -1;
+    }
+
+    PointSet batch;
+    while (m_ring.pop(batch))
+    {
+    }
+}
+
+std::string PointStream::errorString() const
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_error;
+}
+
+void PointStream::setError(const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_error = error;
+}
+
+void PointStream::run()
+{
+    // Bytes of an incomplete last line are carried over to the next read.
+    std::vector<char> buffer(ReadSize);
+    size_t carried = 0;
+    while (!m_stop)
+    {
+        if (carried == buffer.size())
+        {
+            // A line longer than the buffer is no record.
+            carried = 0;
+        }
+
+#ifdef _WIN32
+        long long bytes = ::_read(m_fd, buffer.data() + carried, unsigned(buffer.size() - carried));
+#else
+        pollfd request;
+        request.fd = m_fd;
+        request.events = POLLIN;
+        request.revents = 0;
+        if (::poll(&request, 1, 50) == 0)
+        {
+            if (!flush())
+                break;
+            continue;
+        }
+        long long bytes = ::read(m_fd, buffer.data() + carried, buffer.size() - carried);
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            continue;
+#endif
+        if (bytes < 0)
+        {
+            setError(std::string("read failed: ") + std::strerror(errno));
+            break;
+        }
+        if (bytes == 0)
+        {
+            // End of the data for now. Files and FIFOs may still grow or get
+            // a new writer; a closed socket is done.
+            if (!flush() || m_socket)
+                break;
+            sleepMs(5);
+            continue;
+        }
+
+        size_t size = carried + size_t(bytes);
+        const char* data = buffer.data();
+        // Only complete lines are parsed.
+        size_t complete = 0;
+        for (size_t i = size; i > 0; i--)
+        {
+            if (data[i - 1] == '\n')
+            {
+                complete = i;
+                break;
+            }
+        }
+        parse(data, data + complete);
+        carried = size - complete;
+        std::memmove(buffer.data(), buffer.data() + complete, carried);
+    }
+
+    flush();
+    m_finished = true;
+}
+
+void PointStream::parse(const char* begin, const char* end)
+{
+    const char* p = begin;
+    while (p < end)
+    {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        if (!lineEnd)
+            lineEnd = end;
+
+        while (p < lineEnd && (*p == ' ' || *p == '\t'))
+            p++;
+        float x;
+        float y;
+        if (p < lineEnd && *p != '#' && parseNumber(p, lineEnd, x))
+        {
+            const char* q = p;
+            while (q < lineEnd && isSeparator(*q))
+                q++;
+            if (q > p && parseNumber(q, lineEnd, y))
+            {
+                m_batch.append(x, y);
+                if (m_batch.size() >= m_batchSize && !flush())
+                    return;
+            }
+        }
+        p = lineEnd + 1;
+    }
+}
+
+bool PointStream::flush()
+{
+    if (m_batch.isEmpty())
+        return !m_stop;
+
+    size_t count = m_batch.size();
+    while (!m_ring.push(std::move(m_batch)))
+    {
+        if (m_stop)
+            return false;
+        m_stalls++;
+        sleepMs(1);
+    }
+    m_received += count;
+    m_batch = PointSet();
+    m_batch.reserve(m_batchSize);
+    return !m_stop;
+}
@@ -0,0 +1,74 @@
+#ifndef POINTSTREAM_H
+#define POINTSTREAM_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "PointSet.h"
+#include "SpscRing.h"
+
+// Live feed of x,y records read on a background thread.
+//
+// The source is a regular file, a FIFO or a UNIX domain socket, with one
+// record per line and the two values separated by a comma, semicolon, tab or
+// spaces. Blank lines, lines starting with '#' and lines that do not start
+// with two numbers (e.g. a CSV header) are skipped. Regular files and FIFOs
+// are followed: reading waits for more data at the end instead of stopping,
+// like tail -f. A socket ends when its peer closes it.
+//
+// Parsed points are handed to one consumer thread in batches through a
+// lock-free ring. When the consumer falls behind, the reader waits for free
+// slots rather than dropping points.
+class PointStream
+{
+public:
+    PointStream();
+    ~PointStream();
+
+    // Points per batch; a batch is also handed over early whenever the source
+    // has no more data for the moment.
+    void setBatchSize(size_t size) { m_batchSize = size; }
+    size_t batchSize() const { return m_batchSize; }
+
+    bool open(const std::string& source);
+    void close();
+    bool isOpen() const { return m_thread.joinable(); }
+    // The source ended or failed; batches may still be queued.
+    bool isFinished() const { return m_finished; }
+
+    // Consumer side. Moves the oldest queued batch into batch.
+    bool takeBatch(PointSet& batch) { return m_ring.pop(batch); }
+
+    // Points parsed so far.
+    unsigned long long received() const { return m_received; }
+    // Times the reader had to wait for the consumer.
+    unsigned long long stalls() const { return m_stalls; }
+
+    std::string errorString() const;
+
+private:
+    void run();
+    void parse(const char* begin, const char* end);
+    bool flush();
+    void setError(const std::string& error);
+
+private:
+    SpscRing<PointSet> m_ring;
+    size_t m_batchSize;
+    PointSet m_batch;
+
+    int m_fd;
+    bool m_socket;
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_finished;
+    std::atomic<unsigned long long> m_received;
+    std::atomic<unsigned long long> m_stalls;
+
+    mutable std::mutex m_errorMutex;
+    std::string m_error;
+};
+
+#endif // POINTSTREAM_H
@@ -0,0 +1,46 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// x86 vector extensions beyond the baseline. The default build does not
+// target them (see MATHTOOLS_NATIVE_ARCH), so with GCC and Clang their
+// kernels are compiled for their own target with SIMD_AVX_TARGET or
+// SIMD_SSSE3_TARGET and only run when cpuHasAvx() or cpuHasSsse3() says the
+// CPU has the extension. Other compilers use them only when the build
+// targets AVX.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SIMD_AVX
+#define SIMD_SSSE3
+#define SIMD_AVX_TARGET __attribute__((target("avx")))
+#define SIMD_SSSE3_TARGET __attribute__((target("ssse3")))
+
+inline bool cpuHasAvx()
+{
+    static const bool supported = __builtin_cpu_supports("avx");
+    return supported;
+}
+
+inline bool cpuHasSsse3()
+{
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#if defined(__AVX__)
+#define SIMD_AVX
+#define SIMD_SSSE3
+#define SIMD_AVX_TARGET
+#define SIMD_SSSE3_TARGET
+
+inline bool cpuHasAvx() { return true; }
+inline bool cpuHasSsse3() { return true; }
+#endif
+#endif
+
+// Part of the x86-64 baseline.
+#if defined(__SSE2__) || defined(_M_X64)
+#define SIMD_SSE2
+#endif
+
+#endif // SIMD_H
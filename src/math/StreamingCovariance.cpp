@@ -0,0 +1,157 @@
+#include "StreamingCovariance.h"
+
+#include <algorithm>
+#include <cmath>
+
+StreamingCovariance::StreamingCovariance()
+    : m_weighting(Cumulative)
+    , m_window(100000)
+    , m_capacity(100000)
+    , m_decay(1)
+{
+    clear();
+}
+
+void StreamingCovariance::setWeighting(Weighting weighting, size_t window)
+{
+    m_weighting = weighting;
+    m_window = std::max<size_t>(window, 1);
+    m_decay = weighting == ExponentialDecay ? std::exp2(-1.0 / double(m_window)) : 1.0;
+    clear();
+}
+
+void StreamingCovariance::setCapacity(size_t capacity)
+{
+    capacity = std::max<size_t>(capacity, 1);
+    if (capacity == m_capacity)
+        return;
+
+    m_capacity = capacity;
+    if (m_weighting != SlidingWindow)
+    {
+        m_points.clear();
+        m_next = 0;
+    }
+}
+
+size_t StreamingCovariance::capacity() const
+{
+    return m_weighting == SlidingWindow ? m_window : m_capacity;
+}
+
+void StreamingCovariance::clear()
+{
+    m_points.clear();
+    m_next = 0;
+    m_total = 0;
+    m_removed = 0;
+    m_shifted = false;
+    m_shiftX = 0;
+    m_shiftY = 0;
+    m_weight = 0;
+    m_sumX = 0;
+    m_sumY = 0;
+    m_sumXX = 0;
+    m_sumXY = 0;
+    m_sumYY = 0;
+}
+
+void StreamingCovariance::add(double x, double y)
+{
+    m_weight += 1;
+    m_sumX += x;
+    m_sumY += y;
+    m_sumXX += x * x;
+    m_sumXY += x * y;
+    m_sumYY += y * y;
+}
+
+void StreamingCovariance::append(const PointSet& points)
+{
+    size_t count = points.size();
+    if (count == 0)
+        return;
+    if (!m_shifted)
+    {
+        m_shifted = true;
+        m_shiftX = points.x[0];
+        m_shiftY = points.y[0];
+    }
+
+    const size_t capacity = this->capacity();
+    for (size_t i = 0; i < count; i++)
+    {
+        float px = points.x[i];
+        float py = points.y[i];
+        if (m_points.size() < capacity)
+        {
+            m_points.append(px, py);
+        }
+        else
+        {
+            if (m_weighting == SlidingWindow)
+            {
+                // The oldest point leaves the window.
+                double x = m_points.x[m_next] - m_shiftX;
+                double y = m_points.y[m_next] - m_shiftY;
+                m_weight -= 1;
+                m_sumX -= x;
+                m_sumY -= y;
+                m_sumXX -= x * x;
+                m_sumXY -= x * y;
+                m_sumYY -= y * y;
+                m_removed++;
+            }
+            m_points.x[m_next] = px;
+            m_points.y[m_next] = py;
+        }
+        m_next = m_next + 1 == capacity ? 0 : m_next + 1;
+
+        if (m_weighting == ExponentialDecay)
+        {
+            m_weight *= m_decay;
+            m_sumX *= m_decay;
+            m_sumY *= m_decay;
+            m_sumXX *= m_decay;
+            m_sumXY *= m_decay;
+            m_sumYY *= m_decay;
+        }
+        add(px - m_shiftX, py - m_shiftY);
+    }
+    m_total += count;
+
+    // Subtracting lets rounding errors pile up; start over from the window
+    // once it has been replaced entirely, which keeps the cost O(1) per point.
+    if (m_weighting == SlidingWindow && m_removed >= m_window)
+        recompute();
+}
+
+void StreamingCovariance::recompute()
+{
+    m_weight = 0;
+    m_sumX = 0;
+    m_sumY = 0;
+    m_sumXX = 0;
+    m_sumXY = 0;
+    m_sumYY = 0;
+    for (size_t i = 0; i < m_points.size(); i++)
+        add(m_points.x[i] - m_shiftX, m_points.y[i] - m_shiftY);
+    m_removed = 0;
+}
+
+PointStatistics StreamingCovariance::statistics() const
+{
+    PointStatistics result;
+    result.mean.setZero();
+    result.covariance.setZero();
+    if (m_weight <= 0)
+        return result;
+
+    double mx = m_sumX / m_weight;
+    double my = m_sumY / m_weight;
+    double cxy = m_sumXY / m_weight - mx * my;
+    result.mean << float(m_shiftX + mx), float(m_shiftY + my);
+    result.covariance << float(m_sumXX / m_weight - mx * mx), float(cxy),
+        float(cxy), float(m_sumYY / m_weight - my * my);
+    return result;
+}
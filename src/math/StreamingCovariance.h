@@ -0,0 +1,77 @@
+#ifndef STREAMINGCOVARIANCE_H
+#define STREAMINGCOVARIANCE_H
+
+#include <cstddef>
+
+#include "Covariance.h"
+#include "PointSet.h"
+
+// Running mean and covariance of a point stream in O(1) per point, plus the
+// most recent points for display.
+//
+// Moments are summed in double relative to the first point, which keeps them
+// accurate for streams far from the origin.
+class StreamingCovariance
+{
+public:
+    enum Weighting
+    {
+        // Every point ever appended counts equally.
+        Cumulative = 0,
+        // Only the last window points count.
+        SlidingWindow,
+        // A point's weight halves every window points.
+        ExponentialDecay
+    };
+
+    StreamingCovariance();
+
+    // Resets the statistics.
+    void setWeighting(Weighting weighting, size_t window);
+    Weighting weighting() const { return m_weighting; }
+    size_t window() const { return m_window; }
+
+    // Points retained for display. The sliding window always retains the
+    // whole window, since its points have to leave the sums again.
+    void setCapacity(size_t capacity);
+    size_t capacity() const;
+
+    void append(const PointSet& points);
+    void clear();
+
+    // Retained points in ring order. The next point goes to slot next(), so
+    // the newest one is just before it.
+    const PointSet& points() const { return m_points; }
+    size_t next() const { return m_next; }
+    unsigned long long total() const { return m_total; }
+
+    PointStatistics statistics() const;
+
+private:
+    void add(double x, double y);
+    void recompute();
+
+private:
+    Weighting m_weighting;
+    size_t m_window;
+    size_t m_capacity;
+    double m_decay;
+
+    PointSet m_points;
+    size_t m_next;
+    unsigned long long m_total;
+    // Points removed from the window since the sums were last recomputed.
+    size_t m_removed;
+
+    bool m_shifted;
+    double m_shiftX;
+    double m_shiftY;
+    double m_weight;
+    double m_sumX;
+    double m_sumY;
+    double m_sumXX;
+    double m_sumXY;
+    double m_sumYY;
+};
+
+#endif // STREAMINGCOVARIANCE_H
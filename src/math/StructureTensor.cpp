@@ -0,0 +1,141 @@
+#include "StructureTensor.h"
+#include "EigenSolvers.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    float coherence(float major, float minor)
+    {
+        float trace = major + minor;
+        return trace > 1e-6f ? (major - minor) / trace : 0.0f;
+    }
+
+    uint8_t toByte(float value)
+    {
+        return uint8_t(std::min(255.0f, std::max(0.0f, value * 255.0f + 0.5f)));
+    }
+}
+
+StructureTensor::StructureTensor()
+    : m_sigma(2)
+    , m_smoothing(Gaussian)
+    , m_gradientMs(0)
+    , m_smoothingMs(0)
+    , m_eigenMs(0)
+{
+}
+
+void StructureTensor::compute(const uint8_t* rgb, int width, int height, int stride)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    cv::Mat image(height, width, CV_8UC3, const_cast<uint8_t*>(rgb), size_t(stride));
+    cv::Mat gray;
+    cv::cvtColor(image, gray, cv::COLOR_RGB2GRAY);
+
+    cv::Mat gx;
+    cv::Mat gy;
+    cv::Sobel(gray, gx, CV_32F, 1, 0, 3);
+    cv::Sobel(gray, gy, CV_32F, 0, 1, 3);
+
+    cv::Mat xx;
+    cv::Mat xy;
+    cv::Mat yy;
+    cv::multiply(gx, gx, xx);
+    cv::multiply(gx, gy, xy);
+    cv::multiply(gy, gy, yy);
+    m_gradientMs = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    if (m_smoothing == Box)
+    {
+        // A box of width w has standard deviation w / sqrt(12).
+        int size = 2 * int(std::round(m_sigma * 1.7320508f)) + 1;
+        cv::boxFilter(xx, xx, -1, cv::Size(size, size));
+        cv::boxFilter(xy, xy, -1, cv::Size(size, size));
+        cv::boxFilter(yy, yy, -1, cv::Size(size, size));
+    }
+    else
+    {
+        cv::GaussianBlur(xx, xx, cv::Size(0, 0), m_sigma);
+        cv::GaussianBlur(xy, xy, cv::Size(0, 0), m_sigma);
+        cv::GaussianBlur(yy, yy, cv::Size(0, 0), m_sigma);
+    }
+    m_smoothingMs = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    m_major.create(height, width, CV_32F);
+    m_minor.create(height, width, CV_32F);
+    m_cos2.create(height, width, CV_32F);
+    m_sin2.create(height, width, CV_32F);
+
+    // All planes are freshly allocated and therefore continuous.
+    const float* pxx = xx.ptr<float>();
+    const float* pxy = xy.ptr<float>();
+    const float* pyy = yy.ptr<float>();
+    float* major = m_major.ptr<float>();
+    float* minor = m_minor.ptr<float>();
+    float* cos2 = m_cos2.ptr<float>();
+    float* sin2 = m_sin2.ptr<float>();
+    parallelFor(size_t(width) * height, [&](size_t begin, size_t end, int)
+    {
+        symmetricEigen2Batch(pxx + begin, pxy + begin, pyy + begin, end - begin,
+            major + begin, minor + begin, cos2 + begin, sin2 + begin);
+    }, 65536);
+    m_eigenMs = millisecondsSince(start);
+}
+
+void StructureTensor::orientationImage(uint8_t* rgb, int stride) const
+{
+    // Colour wheel over the doubled angle: each channel is a cosine 120
+    // degrees apart, so it is linear in (cos 2t, sin 2t) and needs no atan2.
+    const float Sin120 = 0.8660254f;
+    int width = this->width();
+    parallelFor(height(), [&](size_t begin, size_t end, int)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const float* major = m_major.ptr<float>(int(i));
+            const float* minor = m_minor.ptr<float>(int(i));
+            const float* c = m_cos2.ptr<float>(int(i));
+            const float* s = m_sin2.ptr<float>(int(i));
+            uint8_t* p = rgb + i * stride;
+            for (int j = 0; j < width; j++, p += 3)
+            {
+                float value = 0.5f * coherence(major[j], minor[j]);
+                p[0] = toByte(value * (1.0f + c[j]));
+                p[1] = toByte(value * (1.0f - 0.5f * c[j] + Sin120 * s[j]));
+                p[2] = toByte(value * (1.0f - 0.5f * c[j] - Sin120 * s[j]));
+            }
+        }
+    }, 8);
+}
+
+void StructureTensor::anisotropyImage(uint8_t* rgb, int stride) const
+{
+    int width = this->width();
+    parallelFor(height(), [&](size_t begin, size_t end, int)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const float* major = m_major.ptr<float>(int(i));
+            const float* minor = m_minor.ptr<float>(int(i));
+            uint8_t* p = rgb + i * stride;
+            for (int j = 0; j < width; j++, p += 3)
+            {
+                float t = 3.0f * coherence(major[j], minor[j]);
+                p[0] = toByte(t);
+                p[1] = toByte(t - 1.0f);
+                p[2] = toByte(t - 2.0f);
+            }
+        }
+    }, 8);
+}
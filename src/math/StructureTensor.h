@@ -0,0 +1,68 @@
+#ifndef STRUCTURETENSOR_H
+#define STRUCTURETENSOR_H
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+// Per-pixel structure tensor J = K * (grad I grad I^T) of an 8-bit RGB image
+// and its eigen analysis.
+//
+// Sobel gradients of the grey image are multiplied and smoothed with a
+// Gaussian or box kernel K by OpenCV, then every tensor is decomposed with
+// symmetricEigen2Batch() across threads. The major eigenvector points along
+// the dominant gradient; coherence (l1 - l2) / (l1 + l2) measures how strongly
+// oriented the neighbourhood is.
+class StructureTensor
+{
+public:
+    enum Smoothing
+    {
+        Gaussian = 0,
+        Box
+    };
+
+    StructureTensor();
+
+    // Integration scale in pixels. Box smoothing uses the box with the same
+    // standard deviation.
+    void setSigma(float sigma) { m_sigma = sigma; }
+    float sigma() const { return m_sigma; }
+    void setSmoothing(Smoothing smoothing) { m_smoothing = smoothing; }
+    Smoothing smoothing() const { return m_smoothing; }
+
+    // stride is the row pitch in bytes; pixels are R, G, B.
+    void compute(const uint8_t* rgb, int width, int height, int stride);
+
+    int width() const { return m_major.cols; }
+    int height() const { return m_major.rows; }
+
+    // CV_32F planes: eigenvalues and the major eigenvector's doubled angle.
+    const cv::Mat& majorValues() const { return m_major; }
+    const cv::Mat& minorValues() const { return m_minor; }
+    const cv::Mat& cos2() const { return m_cos2; }
+    const cv::Mat& sin2() const { return m_sin2; }
+
+    // RGB image with hue from the orientation and brightness from coherence.
+    void orientationImage(uint8_t* rgb, int stride) const;
+    // RGB image of coherence on a black-red-yellow-white ramp.
+    void anisotropyImage(uint8_t* rgb, int stride) const;
+
+    double gradientMs() const { return m_gradientMs; }
+    double smoothingMs() const { return m_smoothingMs; }
+    double eigenMs() const { return m_eigenMs; }
+
+private:
+    float m_sigma;
+    Smoothing m_smoothing;
+
+    cv::Mat m_major;
+    cv::Mat m_minor;
+    cv::Mat m_cos2;
+    cv::Mat m_sin2;
+
+    double m_gradientMs;
+    double m_smoothingMs;
+    double m_eigenMs;
+};
+
+#endif // STRUCTURETENSOR_H
@@ -0,0 +1,213 @@
+#include "VideoPCA.h"
+#include "BoundedQueue.h"
+#include "EigenSolvers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+}
+
+VideoPCA::VideoPCA()
+    : m_basisMode(PerFrame)
+    , m_basisDecay(0.1f)
+    , m_queueCapacity(4)
+    , m_fourcc(cv::VideoWriter::fourcc('M', 'J', 'P', 'G'))
+    , m_frames(0)
+    , m_elapsedMs(0)
+    , m_axis(Eigen::Vector3f::Constant(0.57735027f))
+    , m_stop(false)
+{
+}
+
+std::string VideoPCA::errorString() const
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_error;
+}
+
+void VideoPCA::setError(const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    if (m_error.empty())
+        m_error = error;
+}
+
+bool VideoPCA::run(const std::string& source, const std::string& destination, const Progress& progress)
+{
+    m_frames = 0;
+    m_elapsedMs = 0;
+    for (int i = 0; i < StageCount; i++)
+        m_stages[i] = StageStatistics();
+    m_stop = false;
+    {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+        m_error.clear();
+    }
+
+    cv::VideoCapture capture(source);
+    if (!capture.isOpened())
+    {
+        setError("cannot open " + source);
+        return false;
+    }
+    double fps = capture.get(cv::CAP_PROP_FPS);
+    if (!(fps > 0))
+        fps = 25;
+    long long total = (long long)capture.get(cv::CAP_PROP_FRAME_COUNT);
+    if (total <= 0)
+        total = -1;
+
+    // Frames are moved through the queues; cv::Mat only shares its buffer,
+    // so no pixels are copied between stages.
+    const size_t capacity = size_t(std::max(1, m_queueCapacity));
+    BoundedQueue<cv::Mat> decoded(capacity);
+    BoundedQueue<cv::Mat> computed(capacity);
+    Clock::time_point start = Clock::now();
+
+    std::thread decoder([&]()
+    {
+        StageStatistics& statistics = m_stages[DecodeStage];
+        while (!m_stop)
+        {
+            cv::Mat frame;
+            Clock::time_point t = Clock::now();
+            bool read = capture.read(frame) && !frame.empty();
+            statistics.busyMs += millisecondsSince(t);
+            if (!read)
+                break;
+            if (frame.type() != CV_8UC3)
+            {
+                setError("unsupported frame format");
+                m_stop = true;
+                break;
+            }
+
+            t = Clock::now();
+            bool pushed = decoded.push(std::move(frame));
+            statistics.blockedMs += millisecondsSince(t);
+            if (!pushed)
+                break;
+        }
+        decoded.close();
+    });
+
+    std::thread encoder([&]()
+    {
+        StageStatistics& statistics = m_stages[EncodeStage];
+        cv::VideoWriter writer;
+        cv::Mat frame;
+        while (true)
+        {
+            Clock::time_point t = Clock::now();
+            bool popped = computed.pop(frame);
+            statistics.starvedMs += millisecondsSince(t);
+            if (!popped)
+                break;
+
+            t = Clock::now();
+            if (!writer.isOpened() && !writer.open(destination, m_fourcc, fps, frame.size(), true))
+            {
+                setError("cannot write " + destination);
+                m_stop = true;
+                decoded.close();
+                computed.close();
+                break;
+            }
+            writer.write(frame);
+            statistics.busyMs += millisecondsSince(t);
+        }
+        writer.release();
+    });
+
+    StageStatistics& statistics = m_stages[ComputeStage];
+    ImagePCA pca;
+    Eigen::Matrix3f scatter = Eigen::Matrix3f::Zero();
+    bool haveBasis = false;
+    int width = 0;
+    int height = 0;
+    std::vector<float> projection;
+    cv::Mat frame;
+    while (!m_stop)
+    {
+        Clock::time_point t = Clock::now();
+        bool popped = decoded.pop(frame);
+        statistics.starvedMs += millisecondsSince(t);
+        if (!popped)
+            break;
+
+        t = Clock::now();
+        if (haveBasis && (frame.cols != width || frame.rows != height))
+        {
+            setError("frame size changed");
+            m_stop = true;
+            break;
+        }
+        width = frame.cols;
+        height = frame.rows;
+        const uint8_t* pixels = frame.ptr<uint8_t>();
+        const int stride = int(frame.step);
+
+        // OpenCV frames are BGR. The projection does not depend on the
+        // channel order as long as encode and decode agree, so frames are
+        // processed as they come and only the reported axis is reordered.
+        if (m_basisMode == PerFrame || !haveBasis)
+        {
+            pca.computeBasis(pixels, width, height, stride);
+        }
+        else if (m_basisMode == Incremental)
+        {
+            pca.computeBasis(pixels, width, height, stride);
+            scatter = (1 - m_basisDecay) * scatter + m_basisDecay * (pca.scatter() / float(double(width) * height));
+            Eigen::Vector3f values;
+            Eigen::Matrix3f vectors;
+            symmetricEigen3(scatter, values, vectors);
+            pca.setAxis(vectors.col(0));
+        }
+        if (!haveBasis)
+            scatter = pca.scatter() / float(double(width) * height);
+        haveBasis = true;
+
+        projection.resize(size_t(width) * height);
+        pca.encode(pixels, width, height, stride, projection.data(), nullptr, 0);
+        cv::Mat result(height, width, CV_8UC3);
+        pca.decode(projection.data(), width, height, result.ptr<uint8_t>(), int(result.step));
+        m_axis = pca.axis().reverse();
+        statistics.busyMs += millisecondsSince(t);
+
+        t = Clock::now();
+        bool pushed = computed.push(std::move(result));
+        statistics.blockedMs += millisecondsSince(t);
+        if (!pushed)
+            break;
+
+        m_frames++;
+        if (progress && !progress(m_frames, total))
+        {
+            setError("cancelled");
+            m_stop = true;
+        }
+    }
+
+    // On a normal end the encoder still drains the frames queued for it.
+    decoded.close();
+    computed.close();
+    decoder.join();
+    encoder.join();
+    m_elapsedMs = millisecondsSince(start);
+
+    if (m_frames == 0 && errorString().empty())
+        setError("no frames in " + source);
+    return errorString().empty();
+}
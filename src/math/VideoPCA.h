@@ -0,0 +1,104 @@
+#ifndef VIDEOPCA_H
+#define VIDEOPCA_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <Eigen/Core>
+
+#include "ImagePCA.h"
+
+// Colour PCA encode/decode over every frame of a video file or an image
+// sequence (a printf pattern such as frame_%04d.png), written back out as a
+// video of the decoded frames.
+//
+// Three stages run concurrently, connected by bounded queues: an OpenCV
+// VideoCapture decodes frames, the calling thread runs ImagePCA on them
+// (itself spread over all cores), and a VideoWriter encodes the results.
+// Whichever stage is slowest sets the pace; the queues in front of it stay
+// full and the stages before it wait. Per-stage busy and waiting times show
+// which one that is.
+class VideoPCA
+{
+public:
+    enum BasisMode
+    {
+        // A fresh principal axis for every frame.
+        PerFrame = 0,
+        // The first frame's axis for the whole video; saves the scatter pass.
+        ReuseFirst,
+        // An exponentially weighted running scatter, so the axis follows the
+        // content without flickering from frame to frame.
+        Incremental
+    };
+
+    enum Stage
+    {
+        DecodeStage = 0,
+        ComputeStage,
+        EncodeStage,
+        StageCount
+    };
+
+    struct StageStatistics
+    {
+        StageStatistics() : busyMs(0), starvedMs(0), blockedMs(0) {}
+
+        // Working on frames.
+        double busyMs;
+        // Waiting for a frame from the stage before.
+        double starvedMs;
+        // Waiting for room in the queue to the stage after.
+        double blockedMs;
+    };
+
+    // Called on the compute thread after every frame with the frames done
+    // and the frame count of the source, or -1 if unknown. Returning false
+    // cancels the run.
+    typedef std::function<bool(long long frames, long long total)> Progress;
+
+    VideoPCA();
+
+    void setBasisMode(BasisMode mode) { m_basisMode = mode; }
+    BasisMode basisMode() const { return m_basisMode; }
+    // Weight of the newest frame in the incremental scatter, 0 - 1.
+    void setBasisDecay(float decay) { m_basisDecay = decay; }
+    // Frames each queue holds.
+    void setQueueCapacity(int frames) { m_queueCapacity = frames; }
+    // Codec of the output, as cv::VideoWriter::fourcc(); MJPG by default.
+    void setFourcc(int fourcc) { m_fourcc = fourcc; }
+
+    bool run(const std::string& source, const std::string& destination, const Progress& progress = Progress());
+
+    long long frames() const { return m_frames; }
+    double elapsedMs() const { return m_elapsedMs; }
+    double fps() const { return m_elapsedMs > 0 ? m_frames * 1000.0 / m_elapsedMs : 0; }
+    const StageStatistics& stageStatistics(Stage stage) const { return m_stages[stage]; }
+    // Fraction of the run the stage was busy.
+    double utilization(Stage stage) const { return m_elapsedMs > 0 ? m_stages[stage].busyMs / m_elapsedMs : 0; }
+    // Axis used for the last frame.
+    const Eigen::Vector3f& axis() const { return m_axis; }
+
+    std::string errorString() const;
+
+private:
+    void setError(const std::string& error);
+
+private:
+    BasisMode m_basisMode;
+    float m_basisDecay;
+    int m_queueCapacity;
+    int m_fourcc;
+
+    long long m_frames;
+    double m_elapsedMs;
+    StageStatistics m_stages[StageCount];
+    Eigen::Vector3f m_axis;
+
+    std::atomic<bool> m_stop;
+    mutable std::mutex m_errorMutex;
+    std::string m_error;
+};
+
+#endif // VIDEOPCA_H
@@ -0,0 +1,158 @@
+#include "CanvasExporter.h"
+#include "CanvasView.h"
+#include "math/Parallel.h"
+#include "math/PngWriter.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QTransform>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+CanvasExporter::Statistics::Statistics()
+    : tiles(0)
+    , renderMs(0)
+    , encodeMs(0)
+    , totalMs(0)
+    , bytes(0)
+    , rssBeforeKb(-1)
+    , peakRssKb(-1)
+{
+}
+
+CanvasExporter::CanvasExporter(CanvasView* view)
+    : m_view(view->frozenCopy())
+    , m_viewportSize(view->viewport()->size())
+    , m_background(view->viewport()->palette().color(view->viewport()->backgroundRole()))
+    , m_tileSize(512)
+{
+}
+
+CanvasExporter::~CanvasExporter()
+{
+    // The copy is a widget, so it is deleted on the GUI thread.
+    m_view->deleteLater();
+}
+
+long long CanvasExporter::currentRssKb()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return (long long)(counters.WorkingSetSize / 1024);
+#elif defined(__linux__)
+    // The second field of statm is the resident size in pages.
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    if (!file)
+        return -1;
+    long long size = 0;
+    long long resident = -1;
+    if (std::fscanf(file, "%lld %lld", &size, &resident) != 2)
+        resident = -1;
+    std::fclose(file);
+    return resident < 0 ? -1 : resident * (long long)sysconf(_SC_PAGESIZE) / 1024;
+#else
+    return -1;
+#endif
+}
+
+bool CanvasExporter::exportPng(const QString& filename, const QSize& size, const Progress& progress)
+{
+    QElapsedTimer total;
+    total.start();
+    m_statistics = Statistics();
+    m_statistics.rssBeforeKb = currentRssKb();
+    m_statistics.peakRssKb = m_statistics.rssBeforeKb;
+    m_error.clear();
+
+    const QSize viewportSize = m_viewportSize;
+    if (size.isEmpty() || viewportSize.isEmpty())
+    {
+        m_error = "invalid image size";
+        return false;
+    }
+
+    const int width = size.width();
+    const int height = size.height();
+    const int tileSize = qMax(16, m_tileSize);
+    const qreal scale = qMin(width / qreal(viewportSize.width()), height / qreal(viewportSize.height()));
+
+    PngWriter writer;
+    if (!writer.open(QFile::encodeName(filename).toStdString(), width, height))
+    {
+        m_error = QString::fromStdString(writer.errorString());
+        return false;
+    }
+
+    QImage band(width, tileSize, QImage::Format_RGB32);
+    if (band.isNull())
+    {
+        m_error = "out of memory";
+        return false;
+    }
+
+    const int columns = (width + tileSize - 1) / tileSize;
+    for (int top = 0; top < height; top += tileSize)
+    {
+        const int rows = qMin(tileSize, height - top);
+        QElapsedTimer timer;
+        timer.start();
+
+        band.fill(m_background);
+        uchar* bits = band.bits();
+        const int bytesPerLine = band.bytesPerLine();
+        parallelFor(size_t(columns), [&](size_t begin, size_t stop, int)
+        {
+            for (size_t column = begin; column < stop; column++)
+            {
+                int left = int(column) * tileSize;
+                // A window into the band, so tiles are painted in place.
+                QImage tile(bits + left * 4, qMin(tileSize, width - left), rows, bytesPerLine, QImage::Format_RGB32);
+                QTransform transform;
+                transform.translate(width / 2.0 - left, height / 2.0 - top);
+                transform.scale(scale, scale);
+                transform.translate(-viewportSize.width() / 2.0, -viewportSize.height() / 2.0);
+                m_view->renderTool(tile, transform);
+            }
+        }, 1);
+        m_statistics.tiles += columns;
+        m_statistics.renderMs += timer.restart();
+
+        if (!writer.writeRows(band.constBits(), size_t(bytesPerLine), rows))
+        {
+            m_error = QString::fromStdString(writer.errorString());
+            return false;
+        }
+        m_statistics.encodeMs += timer.elapsed();
+        m_statistics.peakRssKb = qMax(m_statistics.peakRssKb, currentRssKb());
+
+        if (progress && !progress(top + rows, height))
+        {
+            writer.close();
+            QFile::remove(filename);
+            m_error = "cancelled";
+            return false;
+        }
+    }
+
+    if (!writer.close())
+    {
+        m_error = QString::fromStdString(writer.errorString());
+        return false;
+    }
+
+    m_statistics.bytes = writer.bytesWritten();
+    m_statistics.totalMs = total.elapsed();
+    return true;
+}
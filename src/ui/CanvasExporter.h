@@ -0,0 +1,73 @@
+#ifndef CANVASEXPORTER_H
+#define CANVASEXPORTER_H
+
+#include <functional>
+#include <QColor>
+#include <QSize>
+#include <QString>
+
+class CanvasView;
+
+// Exports what a CanvasView shows to a PNG of arbitrary size, e.g. 32k x 32k
+// for a poster.
+//
+// The image is produced one band of tiles at a time: the tiles of a band are
+// painted in parallel by CanvasView::renderTool(), straight into the band,
+// and the band's rows are then encoded and appended to the file. Memory is
+// bounded by one band whatever the image size. The view is scaled uniformly
+// so the whole viewport fits and centred, so lines and points keep the
+// thickness they have on screen relative to the plot.
+//
+// The constructor runs on the GUI thread and takes a frozen copy of the view;
+// exportPng() then only reads that copy and may run on a worker thread while
+// the view keeps changing.
+class CanvasExporter
+{
+public:
+    // Called after every band; returning false cancels the export.
+    typedef std::function<bool(int rows, int height)> Progress;
+
+    struct Statistics
+    {
+        Statistics();
+
+        int tiles;
+        qint64 renderMs;
+        qint64 encodeMs;
+        qint64 totalMs;
+        unsigned long long bytes;
+        // Resident set size of the process before the export and the largest
+        // one sampled after each band, or -1 when unknown.
+        long long rssBeforeKb;
+        long long peakRssKb;
+    };
+
+    explicit CanvasExporter(CanvasView* view);
+    ~CanvasExporter();
+
+    // Edge length of the square tiles; a band holds tileSize rows.
+    void setTileSize(int size) { m_tileSize = size; }
+    int tileSize() const { return m_tileSize; }
+
+    // Removes the partial file if cancelled.
+    bool exportPng(const QString& filename, const QSize& size, const Progress& progress = Progress());
+
+    const Statistics& statistics() const { return m_statistics; }
+    const QString& errorString() const { return m_error; }
+
+    // Current resident set size of this process in KiB, or -1.
+    static long long currentRssKb();
+
+private:
+    CanvasExporter(const CanvasExporter&);
+    CanvasExporter& operator=(const CanvasExporter&);
+
+    CanvasView* m_view;
+    QSize m_viewportSize;
+    QColor m_background;
+    int m_tileSize;
+    Statistics m_statistics;
+    QString m_error;
+};
+
+#endif // CANVASEXPORTER_H
@@ -0,0 +1,134 @@
+#include "CanvasSnapshot.h"
+
+#include <QColor>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QtMath>
+
+QSharedPointer<const KdeSnapshot> buildKdeSnapshot(const PointSet& points, float bandwidth)
+{
+    QSharedPointer<KdeSnapshot> snapshot(new KdeSnapshot);
+    if (points.isEmpty())
+        return snapshot;
+
+    QElapsedTimer timer;
+    timer.start();
+    KernelDensity& kde = snapshot->kde;
+    kde.setBandwidth(bandwidth);
+    kde.estimate(points);
+    qint64 estimateMs = timer.elapsed();
+
+    // Heat map: hue runs from blue (low) to red (high), alpha follows density.
+    const cv::Mat& density = kde.density();
+    float scale = kde.maxDensity() > 0 ? 255.0f / kde.maxDensity() : 0.0f;
+    QRgb palette[256];
+    for (int i = 0; i < 256; i++)
+    {
+        QColor color;
+        color.setHsvF(0.66 * (1.0 - i / 255.0), 1, 1, qMin(1.0, i / 128.0) * 0.75);
+        palette[i] = color.rgba();
+    }
+    snapshot->image = QImage(density.cols, density.rows, QImage::Format_ARGB32);
+    for (int i = 0; i < density.rows; i++)
+    {
+        const float* src = density.ptr<float>(i);
+        QRgb* dst = reinterpret_cast<QRgb*>(snapshot->image.scanLine(i));
+        for (int j = 0; j < density.cols; j++)
+        {
+            dst[j] = palette[qBound(0, int(src[j] * scale), 255)];
+        }
+    }
+
+    for (int level = 1; level <= 9; level += 2)
+    {
+        std::vector<float> segments = kde.contour(kde.maxDensity() * level / 10.0f);
+        QVector<QLineF> lines;
+        lines.reserve(int(segments.size() / 4));
+        for (size_t i = 0; i + 3 < segments.size(); i += 4)
+        {
+            lines.append(QLineF(segments[i], segments[i + 1], segments[i + 2], segments[i + 3]));
+        }
+        snapshot->contours.append(lines);
+    }
+
+    qDebug() << "kde:" << points.size() << "points," << kde.gridSize() << "grid,"
+        << "bandwidth" << kde.bandwidthX() << kde.bandwidthY() << ","
+        << estimateMs << "ms estimate," << timer.elapsed() << "ms total";
+    return snapshot;
+}
+
+QSharedPointer<const PointsSnapshot> buildPointsSnapshot(const QSharedPointer<const PointSet>& points,
+    bool kde, float bandwidth, const QSharedPointer<const PointIndex>& baseIndex)
+{
+    QSharedPointer<PointsSnapshot> snapshot(new PointsSnapshot);
+    snapshot->points = points ? points : QSharedPointer<const PointSet>(new PointSet);
+    snapshot->statistics = computePointStatistics(*snapshot->points);
+
+    QSharedPointer<PointIndex> index(baseIndex ? new PointIndex(*baseIndex) : new PointIndex);
+    index->update(*snapshot->points);
+    snapshot->index = index;
+    if (!snapshot->points->isEmpty())
+        qDebug() << "index:" << index->size() << "points," << index->treeCount() << "trees,"
+            << index->buildMs() << "ms";
+    if (kde && !snapshot->points->isEmpty())
+        snapshot->kde = buildKdeSnapshot(*snapshot->points, bandwidth);
+    return snapshot;
+}
+
+QVector<QImage> buildImageLevels(const QImage& image)
+{
+    QVector<QImage> levels;
+    if (image.isNull())
+        return levels;
+
+    // Each level is halved from the previous one, which is cheaper than
+    // scaling the full image every time and filters just as well.
+    levels.append(image);
+    for (int i = 1; (image.width() >> i) > 0 && (image.height() >> i) > 0; i++)
+    {
+        levels.append(levels.last().scaled(image.width() >> i, image.height() >> i,
+            Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    }
+    return levels;
+}
+
+void appendRandomPoints(PointSet& points, int count, const QRectF& sceneRect, const QPointF& origin, qreal factor)
+{
+    QRandomGenerator* rand = QRandomGenerator::global();
+    points.reserve(points.size() + count);
+    for (int i = 0; i < count; i++)
+    {
+        int x = rand->bounded((int)sceneRect.left(), (int)sceneRect.right());
+        int y = rand->bounded((int)sceneRect.top(), (int)sceneRect.bottom());
+
+        QPointF point = QPointF(x, y) - origin;
+        point /= factor;
+        points.append(point.x(), point.y());
+    }
+}
+
+void appendRandomLinePoints(PointSet& points, int count, const QPointF& start, const QPointF& end, float radius, float outliers)
+{
+    QRandomGenerator* rand = QRandomGenerator::global();
+    QVector2D dir = QVector2D(end - start);
+    QVector2D dirN = dir.normalized();
+    QVector2D vertN(-dirN.y(), dirN.x());
+    // Outliers fill the square around the segment.
+    QPointF center = (start + end) / 2;
+    qreal side = qMax<qreal>(dir.length(), 2 * radius);
+    points.reserve(points.size() + count);
+    for (int i = 0; i < count; i++)
+    {
+        if (outliers > 0 && rand->generateDouble() < outliers)
+        {
+            points.append(float(center.x() + (rand->generateDouble() - 0.5) * side),
+                float(center.y() + (rand->generateDouble() - 0.5) * side));
+            continue;
+        }
+        QPointF point = start + (dir * rand->generateDouble()).toPointF();
+        double r = (rand->bounded(2.0) - 1.0) * radius;
+        point = (r * vertN).toPointF() + point;
+        points.append(point.x(), point.y());
+    }
+}
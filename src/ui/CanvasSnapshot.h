@@ -0,0 +1,77 @@
+#ifndef CANVASSNAPSHOT_H
+#define CANVASSNAPSHOT_H
+
+#include <QImage>
+#include <QLineF>
+#include <QList>
+#include <QPointF>
+#include <QRectF>
+#include <QSharedPointer>
+#include <QVector>
+#include <QVector2D>
+#include <QVector3D>
+#include <Eigen/Core>
+
+#include "math/Covariance.h"
+#include "math/KernelDensity.h"
+#include "math/PointIndex.h"
+#include "math/PointSet.h"
+
+// Immutable results handed from background tasks to CanvasView. A task fills
+// a fresh snapshot (the back buffer) while the view keeps painting the one it
+// holds (the front buffer). Publishing swaps a shared pointer, so a frame never
+// sees half an update and the swap costs the same whatever the data size.
+
+// KDE overlay: the density grid, its heat map and contour lines.
+struct KdeSnapshot
+{
+    KernelDensity kde;
+    QImage image;
+    QList<QVector<QLineF>> contours;
+};
+
+// Points of the covariance tool with the statistics drawn every frame, the
+// spatial index used for culling and picking, and an optional KDE overlay.
+// Snapshots that only differ in the overlay share the point set and index.
+struct PointsSnapshot
+{
+    QSharedPointer<const PointSet> points;
+    QSharedPointer<const PointIndex> index;
+    PointStatistics statistics;
+    QSharedPointer<const KdeSnapshot> kde;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Samples and moments of the probability tool.
+struct DistributionSnapshot
+{
+    DistributionSnapshot() : avg(0), var(0), std(0) {}
+
+    QList<QVector2D> samples;
+    QList<QVector3D> samples3D;
+    qreal avg;
+    qreal var;
+    qreal std;
+};
+
+// Bandwidth <= 0 selects Scott's rule per axis.
+QSharedPointer<const KdeSnapshot> buildKdeSnapshot(const PointSet& points, float bandwidth);
+// baseIndex, if given, must index a prefix of points; only the rest is
+// indexed then.
+QSharedPointer<const PointsSnapshot> buildPointsSnapshot(const QSharedPointer<const PointSet>& points,
+    bool kde, float bandwidth, const QSharedPointer<const PointIndex>& baseIndex = QSharedPointer<const PointIndex>());
+
+// Successive halvings of image down to one pixel, levels[0] being the image
+// itself. Built by background tasks, so painting only has to turn the level
+// it draws into a pixmap.
+QVector<QImage> buildImageLevels(const QImage& image);
+
+// Uniform points on the integer scene grid inside sceneRect, mapped to canvas
+// units around origin.
+void appendRandomPoints(PointSet& points, int count, const QRectF& sceneRect, const QPointF& origin, qreal factor);
+// Points scattered up to radius across the segment from start to end. The
+// given fraction of them is replaced by uniform outliers.
+void appendRandomLinePoints(PointSet& points, int count, const QPointF& start, const QPointF& end, float radius, float outliers = 0);
+
+#endif // CANVASSNAPSHOT_H
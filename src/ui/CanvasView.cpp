@@ -1,9 +1,11 @@
 #include "CanvasView.h"
+#include "math/EigenSolvers.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QEvent>
 #include <QPainter>
-#include <QRandomGenerator>
+#include <QTimer>
 #include <QtMath>
 #include <QWheelEvent>
 #include <iostream>
@@ -16,6 +18,17 @@ CanvasView::CanvasView(QWidget* parent)
     , m_factor(50)
     , m_origin(0, 0)
     , m_pressed(false)
+    , m_pointsSnapshot(buildPointsSnapshot(QSharedPointer<const PointSet>(), false, 0))
+    , m_hoverIndex(-1)
+    , m_hoverQueryNs(0)
+    , m_distribution(new DistributionSnapshot)
+    , m_kdeEnabled(false)
+    , m_kdeBandwidth(0)
+    , m_kdeMode(KM_Heat)
+    , m_streamTimer(nullptr)
+    , m_frozen(false)
+    , m_dataVarianceX(0)
+    , m_dataVarianceY(0)
 {
     qDebug() << "create canvas widget.";
 
@@ -23,12 +36,18 @@ CanvasView::CanvasView(QWidget* parent)
     setTransformationAnchor(AnchorUnderMouse);
     setViewportUpdateMode(FullViewportUpdate);
     setResizeAnchor(AnchorUnderMouse);
+    setMouseTracking(true);
     //scale(m_scaleFactor, m_scaleFactor);
 
     QRectF rect(0, 0, 1000, 1000);
     setSceneRect(rect);
     m_origin = QPointF(rect.width() / 2, rect.height() / 2);
 
+    // Frame clock while streaming; every frame drains the queued batches.
+    m_streamTimer = new QTimer(this);
+    m_streamTimer->setInterval(16);
+    connect(m_streamTimer, &QTimer::timeout, this, [=]() { scene()->update(); });
+
     m_matrix(0, 0) = 2;
     m_matrix(1, 0) = 2;
     m_matrix(0, 1) = 3;
@@ -40,61 +59,119 @@ CanvasView::~CanvasView()
 
 }
 
-void CanvasView::generateRandomPoints(int count, bool append)
+void CanvasView::setPoints(const PointSet& points)
 {
-    if (!append)
-        m_points.clear();
-
-    QRectF sRect = sceneRect();
-    QRandomGenerator* rand = QRandomGenerator::global();
+    publishPoints(buildPointsSnapshot(QSharedPointer<const PointSet>(new PointSet(points)),
+        m_kdeEnabled, m_kdeBandwidth));
+}
 
-    for (int i = 0; i < count; i++)
+void CanvasView::publishPoints(const QSharedPointer<const PointsSnapshot>& snapshot)
+{
+    if (snapshot->points != m_pointsSnapshot->points)
     {
-        int x = rand->bounded((int)sRect.left(), (int)sRect.right());
-        int y = rand->bounded((int)sRect.top(), (int)sRect.bottom());
+        m_mixture.clear();
+        m_clusters.clear();
+        m_line = FittedLine();
+        m_hoverIndex = -1;
+    }
+    m_pointsSnapshot = snapshot;
+    scene()->update();
+}
 
-        QPointF point = QPointF(x, y) - m_origin;
-        point /= m_factor;
-        m_points.append(point);
+void CanvasView::publishDistribution(const QSharedPointer<const DistributionSnapshot>& snapshot)
+{
+    m_distribution = snapshot;
+    scene()->update();
+}
+
+void CanvasView::setDataProjection(const QSharedPointer<const PointSet>& points, const QSharedPointer<const PointIndex>& index,
+    qreal varianceX, qreal varianceY)
+{
+    m_dataPoints = points;
+    m_dataIndex = index;
+    m_dataVarianceX = varianceX;
+    m_dataVarianceY = varianceY;
+    scene()->update();
+}
+
+void CanvasView::setKdeOptions(bool enabled, float bandwidth, KdeMode mode)
+{
+    bool changed = enabled != m_kdeEnabled || bandwidth != m_kdeBandwidth;
+    m_kdeEnabled = enabled;
+    m_kdeBandwidth = bandwidth;
+    m_kdeMode = mode;
+    if (changed)
+    {
+        QSharedPointer<PointsSnapshot> snapshot(new PointsSnapshot(*m_pointsSnapshot));
+        snapshot->kde.reset();
+        if (enabled && !snapshot->points->isEmpty())
+            snapshot->kde = buildKdeSnapshot(*snapshot->points, bandwidth);
+        m_pointsSnapshot = snapshot;
     }
+    scene()->update();
+}
 
+void CanvasView::setStream(const QSharedPointer<PointStream>& stream)
+{
+    m_stream = stream;
+    m_streamStatistics.clear();
+    if (m_stream)
+        m_streamTimer->start();
+    else
+        m_streamTimer->stop();
     scene()->update();
 }
 
-void CanvasView::generateRandomLinePoints(int count, const QPointF& start, const QPointF& end, float radius, bool append)
+void CanvasView::setStreamWeighting(StreamingCovariance::Weighting weighting, size_t window)
 {
-    if (!append)
-        m_points.clear();
+    m_streamStatistics.setWeighting(weighting, window);
+    m_streamStatistics.setCapacity(window);
+    scene()->update();
+}
 
-    QRandomGenerator* rand = QRandomGenerator::global();
-    QVector2D dir = QVector2D(end - start);
-    QVector2D dirN = dir.normalized();
-    QVector2D vertN(dirN.x(), -dirN.y());
-    for (int i = 0; i < count; i++)
+void CanvasView::drainStream()
+{
+    // Bounded per frame, so a backlog is worked off over several frames
+    // instead of stalling one.
+    const qint64 BudgetNs = 8000000;
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.nsecsElapsed() < BudgetNs && m_stream->takeBatch(m_streamBatch))
     {
-        QPointF point = start + (dir * rand->generateDouble()).toPointF();
-        double r = (rand->bounded(2.0) - 1.0) * radius;
-        point = (r * vertN).toPointF() + point;
-        m_points.append(point);
+        m_streamStatistics.append(m_streamBatch);
     }
+}
 
+void CanvasView::setKdeMode(KdeMode mode)
+{
+    m_kdeMode = mode;
     scene()->update();
 }
 
-QMatrix CanvasView::fromSceneMatrix() const
+QTransform CanvasView::viewTransform() const
 {
-    QPointF origin = mapFromScene(m_origin);
-    QTransform t(transform());
+    return m_frozen ? m_frozenTransform : transform();
+}
+
+QPoint CanvasView::sceneToViewport(const QPointF& point) const
+{
+    return m_frozen ? m_frozenViewportTransform.map(point).toPoint() : mapFromScene(point);
+}
+
+QMatrix CanvasView::fromSceneMatrix(const QPointF& sceneOrigin) const
+{
+    QPointF origin = sceneToViewport(sceneOrigin);
+    QTransform t(viewTransform());
     QMatrix m(m_factor, 0, 0, -m_factor, origin.x(), origin.y());
     m = t.toAffine() * m;
     return m;
 }
 
-QMatrix CanvasView::toSceneMatrix() const
+QMatrix CanvasView::toSceneMatrix(const QPointF& origin) const
 {
     QMatrix matrix;
     matrix.scale(1.0 / m_factor, -1.0 / m_factor);
-    matrix.translate(-m_origin.x(), -m_origin.y());
+    matrix.translate(-origin.x(), -origin.y());
     return matrix;
 }
 
@@ -112,19 +189,90 @@ void CanvasView::paintEvent(QPaintEvent * event)
 {
     QGraphicsView::paintEvent(event);
 
+    if (m_stream)
+        drainStream();
+
+    RenderTarget target;
+    target.device = viewport();
+    target.rect = QRectF(viewport()->rect());
+    target.screen = true;
+    drawTool(target);
+}
+
+void CanvasView::renderTool(QImage& image, const QTransform& transform)
+{
+    RenderTarget target;
+    target.device = &image;
+    target.transform = transform;
+    target.rect = transform.inverted().mapRect(QRectF(image.rect()));
+    target.screen = false;
+    drawTool(target);
+}
+
+CanvasView* CanvasView::frozenCopy() const
+{
+    CanvasView* copy = new CanvasView();
+    copy->setSceneRect(sceneRect());
+    copy->m_frozen = true;
+    copy->m_frozenTransform = viewTransform();
+    copy->m_frozenViewportTransform = m_frozen ? m_frozenViewportTransform : viewportTransform();
+
+    // Snapshots are immutable and images implicitly shared, so this is cheap.
+    copy->m_init = m_init;
+    copy->m_scaleFactor = m_scaleFactor;
+    copy->m_factor = m_factor;
+    copy->m_mousePoint = m_mousePoint;
+    copy->m_origin = m_origin;
+    copy->m_matrix = m_matrix;
+    copy->m_toolType = m_toolType;
+    copy->m_pointsSnapshot = m_pointsSnapshot;
+    copy->m_imageRaw = m_imageRaw;
+    copy->m_encodered = m_encodered;
+    copy->m_decodered = m_decodered;
+    copy->m_orientation = m_orientation;
+    copy->m_anisotropy = m_anisotropy;
+    copy->m_imageSize = m_imageSize;
+    copy->m_rawLevels = m_rawLevels;
+    copy->m_encoderedLevels = m_encoderedLevels;
+    copy->m_decoderedLevels = m_decoderedLevels;
+    copy->m_orientationLevels = m_orientationLevels;
+    copy->m_anisotropyLevels = m_anisotropyLevels;
+    copy->m_distributionType = m_distributionType;
+    copy->m_distribution = m_distribution;
+    copy->m_kdeEnabled = m_kdeEnabled;
+    copy->m_kdeBandwidth = m_kdeBandwidth;
+    copy->m_kdeMode = m_kdeMode;
+    copy->m_mixture = m_mixture;
+    copy->m_clusters = m_clusters;
+    copy->m_line = m_line;
+    // Only tested for being set; the copy never drains it.
+    copy->m_stream = m_stream;
+    copy->m_streamStatistics = m_streamStatistics;
+    copy->m_dataPoints = m_dataPoints;
+    copy->m_dataIndex = m_dataIndex;
+    copy->m_dataVarianceX = m_dataVarianceX;
+    copy->m_dataVarianceY = m_dataVarianceY;
+    return copy;
+}
+
+void CanvasView::drawTool(const RenderTarget& target)
+{
     switch (m_toolType)
     {
     case TT_EigenMatrix:
-        drawEigenMatrix();
+        drawEigenMatrix(target);
         break;
     case TT_CovMatrix:
-        drawCovMatrix();
+        drawCovMatrix(target);
         break;
     case TT_PCA:
-        drawPCA();
+        drawPCA(target);
         break;
     case TT_Probability:
-        drawProbability();
+        drawProbability(target);
+        break;
+    case TT_DataPCA:
+        drawDataPCA(target);
         break;
     }
 }
@@ -150,9 +298,33 @@ void CanvasView::mouseMoveEvent(QMouseEvent * event)
         m_mousePoint = (mapToScene(event->pos()) - m_origin) / m_factor;
         scene()->update();
     }
+    else if (m_toolType == TT_CovMatrix && !m_stream)
+    {
+        updateHover(event->pos());
+    }
     QGraphicsView::mouseMoveEvent(event);
 }
 
+void CanvasView::updateHover(const QPoint& pos)
+{
+    // Picks within HoverRadius pixels of the cursor.
+    const qreal HoverRadius = 8;
+    QSharedPointer<const PointsSnapshot> snapshot = m_pointsSnapshot;
+    QMatrix m = fromSceneMatrix();
+    QPointF point = m.inverted().map(QPointF(pos));
+
+    QElapsedTimer timer;
+    timer.start();
+    long long index = snapshot->index->nearest(float(point.x()), float(point.y()), float(HoverRadius / qAbs(m.m11())));
+    m_hoverQueryNs = timer.nsecsElapsed();
+
+    if (index != m_hoverIndex)
+    {
+        m_hoverIndex = index;
+        scene()->update();
+    }
+}
+
 void CanvasView::wheelEvent(QWheelEvent * event)
 {
     if (event->modifiers() & Qt::ControlModifier) {
@@ -193,13 +365,13 @@ void CanvasView::updateDistributionType(DistributionType distributionType)
     m_distributionType = distributionType;
 }
 
-void CanvasView::drawGrids()
+void CanvasView::drawGrids(const RenderTarget& target, const QPointF& origin)
 {
-    QPainter painter(viewport());
-    painter.setMatrix(fromSceneMatrix());
+    QPainter painter(target.device);
+    painter.setTransform(target.toDevice(fromSceneMatrix(origin)));
     painter.setPen(QPen(Qt::lightGray, lineWidth(), Qt::DashLine, Qt::RoundCap));
 
-    QRectF rect = toSceneMatrix().mapRect(sceneRect());
+    QRectF rect = toSceneMatrix(origin).mapRect(sceneRect());
     for (int i = std::round(rect.left()); i <= std::round(rect.right()); i++)
     {
         painter.drawLine(QPointF(i, rect.top()), QPointF(i, rect.bottom()));
@@ -210,49 +382,60 @@ void CanvasView::drawGrids()
     }
 }
 
-void CanvasView::drawAxes()
+void CanvasView::drawAxes(const RenderTarget& target, const QPointF& origin)
 {   
-    QPainter painter(viewport());
-    painter.setMatrix(fromSceneMatrix());
+    QPainter painter(target.device);
+    painter.setTransform(target.toDevice(fromSceneMatrix(origin)));
     painter.setPen(QPen(Qt::lightGray, lineWidth(2), Qt::SolidLine, Qt::PenCapStyle::RoundCap));
 
-    QRectF rect = toSceneMatrix().mapRect(sceneRect());
+    QRectF rect = toSceneMatrix(origin).mapRect(sceneRect());
     
     painter.drawRect(rect);
     painter.drawLine(QPointF(rect.left(), 0), QPointF(rect.right(), 0));
     painter.drawLine(QPointF(0, rect.top()), QPointF(0, rect.bottom()));
 }
 
-void CanvasView::drawEigenMatrix()
+void CanvasView::drawEigenMatrix(const RenderTarget& target)
 {
-    drawGrids();
-    drawAxes();
+    drawGrids(target, m_origin);
+    drawAxes(target, m_origin);
 
-    QPainter painter(viewport());
-    painter.setMatrix(fromSceneMatrix());
+    QPainter painter(target.device);
+    painter.setTransform(target.toDevice(fromSceneMatrix()));
 
     QRectF rect = toSceneMatrix().mapRect(sceneRect());
 
-    m_mousePoint.setY(-m_mousePoint.y());
+    // Flipped into y-up coordinates per frame rather than in place, so every
+    // frame and every export tile sees the same point.
+    QPointF mousePoint(m_mousePoint.x(), -m_mousePoint.y());
+
+    // Export tiles repaint the same frame many times over; only the
+    // viewport logs it.
+    const bool log = target.screen;
 
-    Eigen::Vector2f point(m_mousePoint.x(), m_mousePoint.y());
-    std::cout << "point:" << point.transpose() << std::endl;
+    Eigen::Vector2f point(mousePoint.x(), mousePoint.y());
+    if (log)
+        std::cout << "point:" << point.transpose() << std::endl;
 
     Eigen::Matrix2f m2f;
     m2f = Eigen::Matrix2f::Map(m_matrix.data());
-    std::cout << m2f << std::endl;
+    if (log)
+        std::cout << m2f << std::endl;
 
     Eigen::Vector2f result = m2f * point;
     
 
-    Eigen::EigenSolver<Eigen::Matrix2f> eigensolver(m2f);
-    Eigen::Matrix2f em = eigensolver.eigenvectors().real();
-    Eigen::Vector2f ev = eigensolver.eigenvalues().real();
+    Eigen::Matrix2f em;
+    Eigen::Vector2f ev;
+    eigen2(m2f, ev, em);
     Eigen::Vector2f e1 = em.col(0) * ev.x();
     Eigen::Vector2f e2 = em.col(1) * ev.y();
-    std::cout << "eigen vector 1:" << e1.transpose() << std::endl;
-    std::cout << "eigen vector 2:" << e2.transpose() << std::endl;
-    std::cout << "eigen values:" << ev.transpose() << std::endl;
+    if (log)
+    {
+        std::cout << "eigen vector 1:" << e1.transpose() << std::endl;
+        std::cout << "eigen vector 2:" << e2.transpose() << std::endl;
+        std::cout << "eigen values:" << ev.transpose() << std::endl;
+    }
 
     rect = QRectF(-10, -10, 20, 20);
     QPointF v1 = QPointF(m_matrix(0, 0), m_matrix(1, 0));
@@ -357,178 +540,439 @@ void CanvasView::drawEigenMatrix()
     painter.drawLine(QPointF(0, 0), QPointF(e2.x(), e2.y()));
 
     painter.setPen(QPen(Qt::darkRed, lineWidth(2), Qt::SolidLine));
-    painter.drawEllipse(m_mousePoint, lineWidth(2), lineWidth(2));
-    painter.drawLine(QPointF(0, 0), m_mousePoint);
-    qDebug() << m_mousePoint;
-    std::cout << "result:" << point.transpose() << std::endl;
+    painter.drawEllipse(mousePoint, lineWidth(2), lineWidth(2));
+    painter.drawLine(QPointF(0, 0), mousePoint);
+    if (log)
+    {
+        qDebug() << mousePoint;
+        std::cout << "result:" << point.transpose() << std::endl;
+    }
     painter.setPen(QPen(Qt::red, lineWidth(2), Qt::SolidLine));
     painter.drawEllipse(QPointF(result.x(), result.y()), lineWidth(2), lineWidth(2));
     painter.drawLine(QPointF(0, 0), QPointF(result.x(), result.y()));
 }
 
-void CanvasView::drawCovMatrix()
+void CanvasView::drawCovMatrix(const RenderTarget& target)
 {
-    drawGrids();
-    drawAxes();
+    drawGrids(target, m_origin);
+    drawAxes(target, m_origin);
 
-    QPainter painter(viewport());
-    QRectF sRect = sceneRect();
-    QRectF rect = mapFromScene(sRect).boundingRect();
-    QPointF origin = mapFromScene(m_origin);
+    QPainter painter(target.device);
     qreal lineFactor = 1.0 / m_factor;
 
-    QTransform t(transform());
-    QMatrix m(m_factor, 0, 0, -m_factor, origin.x(), origin.y());
-    m = t.toAffine() * m;
-    painter.setMatrix(m);
+    QMatrix m = fromSceneMatrix();
+    painter.setTransform(target.toDevice(m));
 
-    if (m_points.isEmpty())
+    if (m_stream)
+    {
+        drawStream(painter);
+        return;
+    }
+
+    // Hold the snapshot for the whole frame; a publish cannot tear it.
+    QSharedPointer<const PointsSnapshot> snapshot = m_pointsSnapshot;
+    const PointSet& points = *snapshot->points;
+    if (points.isEmpty())
         return;
 
-    Eigen::Vector2f center(Eigen::Vector2f::Zero());
-    for (QPointF pt : m_points)
+    // Only the leaves that reach into the target are drawn.
+    qreal radius = 4 * lineFactor;
+    QRectF visible = m.inverted().mapRect(target.rect).adjusted(-radius, -radius, radius, radius);
+    PointIndex::Rect query;
+    query.left = float(visible.left());
+    query.bottom = float(visible.top());
+    query.right = float(visible.right());
+    query.top = float(visible.bottom());
+
+    painter.setPen(QPen(Qt::black, 2 * lineFactor, Qt::NoPen, Qt::PenCapStyle::RoundCap));
+    painter.setBrush(Qt::darkYellow);
+    if (m_line.valid)
+    {
+        // Inliers keep the usual colour, outliers are greyed out.
+        const Eigen::Vector2f normal = m_line.normal();
+        const float offset = m_line.offset();
+        bool inlier = true;
+        snapshot->index->query(query, [&](const float* x, const float* y, const uint32_t*, size_t count)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                bool inside = std::fabs(normal.x() * x[i] + normal.y() * y[i] - offset) <= m_line.threshold;
+                if (inside != inlier)
+                {
+                    inlier = inside;
+                    painter.setBrush(inlier ? Qt::darkYellow : Qt::lightGray);
+                }
+                painter.drawEllipse(QPointF(x[i], y[i]), radius, radius);
+            }
+        });
+    }
+    else
     {
-        painter.setPen(QPen(Qt::black, 2 * lineFactor, Qt::NoPen, Qt::PenCapStyle::RoundCap));
-        painter.setBrush(Qt::darkYellow);
+        snapshot->index->query(query, [&](const float* x, const float* y, const uint32_t*, size_t count)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                painter.drawEllipse(QPointF(x[i], y[i]), radius, radius);
+            }
+        });
+    }
 
-        center.x() += pt.x();
-        center.y() += pt.y();
+    if (snapshot->kde)
+        drawKde(painter, *snapshot->kde);
 
-        painter.drawEllipse(pt, 4 * lineFactor, 4 * lineFactor);
+    Eigen::Vector2f center = snapshot->statistics.mean;
+    Eigen::Matrix2f matrix = snapshot->statistics.covariance;
+    if (target.screen)
+    {
+        std::cout << "center:" << center.transpose() << std::endl;
+        std::cout << "matrix:" << std::endl;
+        std::cout << matrix << std::endl;
     }
-    center /= m_points.size();
-    std::cout << "center:" << center.transpose() << std::endl;
 
-    Eigen::Matrix2f matrix(Eigen::Matrix2f::Zero());
-    for (QPointF pt : m_points)
+    drawEigenAxes(painter, center, matrix, Qt::green);
+
+    drawComponents(painter, m_mixture);
+    drawComponents(painter, m_clusters);
+    drawFittedLine(painter, visible);
+    if (target.screen)
+        drawHover(painter, points);
+}
+
+void CanvasView::drawFittedLine(QPainter& painter, const QRectF& visible)
+{
+    if (!m_line.valid)
+        return;
+
+    // Long enough to cross the visible area from wherever it is.
+    QPointF center = visible.center();
+    Eigen::Vector2f point = m_line.point;
+    Eigen::Vector2f direction = m_line.direction;
+    Eigen::Vector2f normal = m_line.normal();
+    float along = direction.dot(Eigen::Vector2f(float(center.x()), float(center.y())) - point);
+    float reach = float(std::hypot(visible.width(), visible.height()));
+    Eigen::Vector2f a = point + direction * (along - reach);
+    Eigen::Vector2f b = point + direction * (along + reach);
+
+    painter.save();
+    painter.setBrush(Qt::NoBrush);
+    painter.setPen(QPen(Qt::blue, lineWidth(2)));
+    painter.drawLine(QPointF(a.x(), a.y()), QPointF(b.x(), b.y()));
+    painter.setPen(QPen(Qt::blue, lineWidth(1), Qt::DashLine));
+    for (int side = -1; side <= 1; side += 2)
+    {
+        Eigen::Vector2f shift = normal * (side * m_line.threshold);
+        painter.drawLine(QPointF(a.x() + shift.x(), a.y() + shift.y()), QPointF(b.x() + shift.x(), b.y() + shift.y()));
+    }
+    painter.restore();
+}
+
+void CanvasView::drawStream(QPainter& painter)
+{
+    // Only the newest points are drawn, which bounds the frame time whatever
+    // the window size.
+    const size_t MaxDrawPoints = 65536;
+    const PointSet& points = m_streamStatistics.points();
+    size_t size = points.size();
+    size_t count = qMin(size, MaxDrawPoints);
+    if (count == 0)
+        return;
+
+    QVector<QPointF> polygon(int(count));
+    size_t start = (m_streamStatistics.next() + size - count) % size;
+    for (size_t i = 0; i < count; i++)
     {
-        matrix.row(0).x() += (pt.x() - center.x()) * (pt.x() - center.x());
-        matrix.row(0).y() += (pt.x() - center.x()) * (pt.y() - center.y());
-        matrix.row(1).x() += (pt.x() - center.x()) * (pt.y() - center.y());
-        matrix.row(1).y() += (pt.y() - center.y()) * (pt.y() - center.y());
+        size_t j = (start + i) % size;
+        polygon[int(i)] = QPointF(points.x[j], points.y[j]);
     }
-    matrix /= m_points.size();
-    std::cout << "matrix:" << std::endl;
-    std::cout << matrix << std::endl;
+    painter.setPen(QPen(Qt::darkYellow, 8 * lineFactor(), Qt::SolidLine, Qt::RoundCap));
+    painter.drawPoints(polygon.constData(), polygon.size());
+
+    PointStatistics statistics = m_streamStatistics.statistics();
+    drawEigenAxes(painter, statistics.mean, statistics.covariance, Qt::green);
+}
 
+void CanvasView::drawHover(QPainter& painter, const PointSet& points)
+{
+    if (m_hoverIndex < 0 || size_t(m_hoverIndex) >= points.size())
+        return;
+
+    QPointF point(points.x[m_hoverIndex], points.y[m_hoverIndex]);
+    painter.save();
+    painter.setBrush(Qt::NoBrush);
+    painter.setPen(QPen(Qt::red, lineWidth(2)));
+    painter.drawEllipse(point, 6 * lineFactor(), 6 * lineFactor());
+
+    // The label is laid out in pixels next to the point.
+    QPointF anchor = painter.transform().map(point);
+    painter.resetTransform();
+    painter.setPen(Qt::black);
+    painter.drawText(anchor + QPointF(10, -10), QString("#%1 (%2, %3)  %4 us")
+        .arg(m_hoverIndex).arg(point.x(), 0, 'f', 3).arg(point.y(), 0, 'f', 3)
+        .arg(m_hoverQueryNs / 1000.0, 0, 'f', 1));
+    painter.restore();
+}
+
+void CanvasView::drawDataPCA(const RenderTarget& target)
+{
+    drawGrids(target, m_origin);
+    drawAxes(target, m_origin);
+
+    QPainter painter(target.device);
+    qreal lineFactor = 1.0 / m_factor;
+
+    QMatrix m = fromSceneMatrix();
+    painter.setTransform(target.toDevice(m));
+
+    if (!m_dataIndex || m_dataIndex->isEmpty())
+        return;
+
+    // Only the leaves that reach into the target are drawn, and at most
+    // MaxDrawPoints of their points: the index runs are in Morton order, so
+    // taking every stride-th point thins them out evenly across the view.
+    const size_t MaxDrawPoints = 65536;
+    qreal radius = 4 * lineFactor;
+    QRectF visible = m.inverted().mapRect(target.rect).adjusted(-radius, -radius, radius, radius);
+    PointIndex::Rect query;
+    query.left = float(visible.left());
+    query.bottom = float(visible.top());
+    query.right = float(visible.right());
+    query.top = float(visible.bottom());
+
+    size_t stride = (m_dataIndex->count(query) + MaxDrawPoints - 1) / MaxDrawPoints;
+    stride = qMax(stride, size_t(1));
+    QVector<QPointF> polygon;
+    size_t seen = 0;
+    size_t next = 0;
+    m_dataIndex->query(query, [&](const float* x, const float* y, const uint32_t*, size_t count)
+    {
+        for (; next < seen + count; next += stride)
+            polygon.append(QPointF(x[next - seen], y[next - seen]));
+        seen += count;
+    });
+    painter.setPen(QPen(Qt::darkCyan, 2 * radius, Qt::SolidLine, Qt::RoundCap));
+    painter.drawPoints(polygon.constData(), polygon.size());
+
+    // Principal components are uncorrelated, so the projected covariance is
+    // diagonal and centred on the origin.
+    Eigen::Matrix2f matrix;
+    matrix << float(m_dataVarianceX), 0, 0, float(m_dataVarianceY);
+    drawEigenAxes(painter, Eigen::Vector2f::Zero(), matrix, Qt::green);
+}
+
+void CanvasView::drawComponents(QPainter& painter, const GaussianComponents& components)
+{
+    for (size_t i = 0; i < components.size(); i++)
+    {
+        QColor color;
+        color.setHsvF(double(i) / components.size(), 1, 0.8);
+        drawEigenAxes(painter, components[i].mean, components[i].covariance, color);
+    }
+}
+
+void CanvasView::drawEigenAxes(QPainter& painter, const Eigen::Vector2f& center, const Eigen::Matrix2f& matrix, const QColor& centerColor)
+{
+    qreal lineFactor = 1.0 / m_factor;
     QPointF lineCenter = QPointF(center.x(), center.y());
 
-    painter.setPen(QPen(Qt::green, lineFactor));
-    painter.setBrush(Qt::green);
+    painter.setPen(QPen(centerColor, lineFactor));
+    painter.setBrush(centerColor);
     painter.drawEllipse(lineCenter, 6 * lineFactor, 6 * lineFactor);
 
-    Eigen::EigenSolver<Eigen::Matrix2f> eigensolver(matrix);
-    Eigen::Matrix2f em = eigensolver.eigenvectors().real();
-    Eigen::Vector2f ev = eigensolver.eigenvalues().real();
+    Eigen::Matrix2f em;
+    Eigen::Vector2f ev;
+    symmetricEigen2(matrix, ev, em);
     Eigen::Vector2f e1 = em.col(0) * ev.x();
     Eigen::Vector2f e2 = em.col(1) * ev.y();
-    std::cout << "eigen vector 1:" << e1.transpose() << std::endl;
-    std::cout << "eigen values:" << ev.transpose() << std::endl;
     painter.setPen(QPen(Qt::red, 3 * lineFactor, Qt::SolidLine));
     painter.drawLine(lineCenter, lineCenter + QPointF(e1.x(), e1.y()));
     painter.setPen(QPen(Qt::blue, 3 * lineFactor, Qt::SolidLine));
     painter.drawLine(lineCenter, lineCenter + QPointF(e2.x(), e2.y()));
 }
 
-void CanvasView::drawPCA()
+void CanvasView::drawKde(QPainter& painter, const KdeSnapshot& snapshot)
 {
-    QPainter painter(viewport());
-    QPoint origin(0, 0);
-    origin = mapFromScene(origin);
+    const KernelDensity& kde = snapshot.kde;
+    if (kde.isEmpty())
+        return;
 
-    painter.setTransform(transform());
-    painter.drawImage(origin, m_imageRaw);
-    painter.drawImage(origin + QPoint(m_imageRaw.width() + 5, 0), m_encodered);
-    painter.drawImage(origin + QPoint(0, m_imageRaw.height() + 5), m_decodered);
+    painter.save();
+    if (m_kdeMode == KM_Heat || m_kdeMode == KM_HeatContour)
+    {
+        // Grid nodes sit at pixel centres.
+        qreal w = kde.cellWidth();
+        qreal h = kde.cellHeight();
+        QRectF target(kde.left() - w / 2, kde.bottom() - h / 2,
+            snapshot.image.width() * w, snapshot.image.height() * h);
+        painter.drawImage(target, snapshot.image);
+    }
+    if (m_kdeMode == KM_Contour || m_kdeMode == KM_HeatContour)
+    {
+        painter.setBrush(Qt::NoBrush);
+        for (int i = 0; i < snapshot.contours.size(); i++)
+        {
+            QColor color;
+            color.setHsvF(0.66 * (1.0 - (i + 0.5) / snapshot.contours.size()), 1, 0.8);
+            painter.setPen(QPen(color, lineWidth(1.5)));
+            painter.drawLines(snapshot.contours[i]);
+        }
+    }
+    painter.restore();
 }
 
-void CanvasView::drawProbability()
+void CanvasView::drawPCA(const RenderTarget& target)
+{
+    QPainter painter(target.device);
+    QPoint origin = sceneToViewport(QPointF(0, 0));
+
+    QSize size = imageSize();
+
+    painter.setTransform(viewTransform() * target.transform);
+    drawImagePane(painter, target, QRect(origin, size), m_imageRaw, m_rawLevels, m_rawMipmaps);
+    drawImagePane(painter, target, QRect(origin + QPoint(size.width() + 5, 0), size),
+        m_encodered, m_encoderedLevels, m_encoderedMipmaps);
+    drawImagePane(painter, target, QRect(origin + QPoint(0, size.height() + 5), size),
+        m_decodered, m_decoderedLevels, m_decoderedMipmaps);
+    drawImagePane(painter, target, QRect(origin + QPoint(2 * (size.width() + 5), 0), size),
+        m_orientation, m_orientationLevels, m_orientationMipmaps);
+    drawImagePane(painter, target, QRect(origin + QPoint(2 * (size.width() + 5), size.height() + 5), size),
+        m_anisotropy, m_anisotropyLevels, m_anisotropyMipmaps);
+}
+
+void CanvasView::drawImagePane(QPainter& painter, const RenderTarget& target, const QRect& rect, const QImage& image,
+    const QVector<QImage>& levels, QVector<QPixmap>& mipmaps)
+{
+    if (image.isNull() || rect.isEmpty())
+        return;
+
+    // Cull panes that are entirely off-screen and only blit the visible part
+    // of the others.
+    QRectF visible = painter.transform().inverted().mapRect(QRectF(0, 0, target.device->width(), target.device->height())) & QRectF(rect);
+    if (visible.isEmpty())
+        return;
+
+    if (!target.screen)
+    {
+        // Pixmaps belong to the GUI thread; export tiles sample the image.
+        qreal sx = image.width() / qreal(rect.width());
+        qreal sy = image.height() / qreal(rect.height());
+        QRectF source((visible.left() - rect.left()) * sx, (visible.top() - rect.top()) * sy,
+            visible.width() * sx, visible.height() * sy);
+        painter.drawImage(visible, image, source);
+        return;
+    }
+
+    // Pick the finest level that is still no larger than one texel per
+    // device pixel. The levels are resampled off the GUI thread; here they
+    // are only converted to pixmaps.
+    qreal scale = qAbs(painter.transform().m11()) * rect.width() / image.width();
+    int level = 0;
+    while (scale < 0.5 && level + 1 < levels.size())
+    {
+        scale *= 2;
+        level++;
+    }
+
+    if (mipmaps.size() <= level)
+        mipmaps.resize(level + 1);
+    if (mipmaps[level].isNull())
+        mipmaps[level] = QPixmap::fromImage(level == 0 ? image : levels[level]);
+
+    const QPixmap& pixmap = mipmaps[level];
+    qreal sx = pixmap.width() / qreal(rect.width());
+    qreal sy = pixmap.height() / qreal(rect.height());
+    QRectF source((visible.left() - rect.left()) * sx, (visible.top() - rect.top()) * sy,
+        visible.width() * sx, visible.height() * sy);
+    painter.drawPixmap(visible, pixmap, source);
+}
+
+void CanvasView::drawProbability(const RenderTarget& target)
 {
     switch (m_distributionType)
     {
     case DT_BERNOULLI:
-        drawBernoulli();
+        drawBernoulli(target);
         break;
     case DT_MULTINOULLI:
         break;
     case DT_NORMAL:
-        drawNormal();
+        drawNormal(target);
         break;
     case DT_NORMAL2D:
-        drawNormal2D();
+        drawNormal2D(target);
         break;
     }
 
 }
 
-void CanvasView::drawBernoulli()
+void CanvasView::drawBernoulli(const RenderTarget& target)
 {
-    QPointF oldOrigin = m_origin;
+    // Anchored at the bottom left corner of the scene.
     QRectF rect = sceneRect();
-    m_origin = QPointF(0, rect.height());
-    drawGrids();
-    drawAxes();
+    QPointF origin(0, rect.height());
+    drawGrids(target, origin);
+    drawAxes(target, origin);
 
-    QPainter painter(viewport());
-    painter.setMatrix(fromSceneMatrix());
+    QPainter painter(target.device);
+    painter.setTransform(target.toDevice(fromSceneMatrix(origin)));
     painter.setPen(QPen(Qt::blue, lineWidth(1)));
 
-    for (int i = 0; i < m_samples.size(); i++)
+    const DistributionSnapshot& distribution = *m_distribution;
+    for (int i = 0; i < distribution.samples.size(); i++)
     {
-        QVector2D point = m_samples[i];
+        QVector2D point = distribution.samples[i];
         painter.drawLine(QPointF(point.x() / 10.0, 0), QPointF(point.x(), point.y() * 100));
     }
 
     painter.setPen(QPen(Qt::red, lineWidth(1)));
-    painter.drawLine(QPointF(rect.left(), m_avg * 100), QPointF(rect.right(), m_avg * 100));
+    painter.drawLine(QPointF(rect.left(), distribution.avg * 100), QPointF(rect.right(), distribution.avg * 100));
     painter.setPen(QPen(Qt::green, lineWidth(1)));
-    painter.drawLine(QPointF(rect.left(), m_var * 100), QPointF(rect.right(), m_var * 100));
+    painter.drawLine(QPointF(rect.left(), distribution.var * 100), QPointF(rect.right(), distribution.var * 100));
     painter.setPen(QPen(Qt::darkYellow, lineWidth(1)));
-    painter.drawLine(QPointF(rect.left(), m_std * 100), QPointF(rect.right(), m_std * 100));
-
-    m_origin = oldOrigin;
+    painter.drawLine(QPointF(rect.left(), distribution.std * 100), QPointF(rect.right(), distribution.std * 100));
 }
 
-void CanvasView::drawNormal()
+void CanvasView::drawNormal(const RenderTarget& target)
 {
     //QPointF oldOrigin = m_origin;
     //QRectF rect = sceneRect();
     //m_origin = QPointF(rect.width() / 2, rect.height());
-    drawGrids();
-    drawAxes();
+    drawGrids(target, m_origin);
+    drawAxes(target, m_origin);
 
-    QPainter painter(viewport());
-    painter.setMatrix(fromSceneMatrix());
+    QPainter painter(target.device);
+    painter.setTransform(target.toDevice(fromSceneMatrix()));
     painter.setPen(QPen(Qt::blue, lineWidth(1)));
 
-    for (int i = 0; i < m_samples.size(); i++)
+    const DistributionSnapshot& distribution = *m_distribution;
+    for (int i = 0; i < distribution.samples.size(); i++)
     {
-        QVector2D point = m_samples[i];
+        QVector2D point = distribution.samples[i];
         painter.drawLine(QPointF(point.x(), 0), QPointF(point.x(), point.y() * 10));
     }
 
     QRectF rect = toSceneMatrix().mapRect(sceneRect());
     painter.setPen(QPen(Qt::red, lineWidth(1)));
-    painter.drawLine(QPointF(rect.left(), m_avg * 10), QPointF(rect.right(), m_avg * 10));
+    painter.drawLine(QPointF(rect.left(), distribution.avg * 10), QPointF(rect.right(), distribution.avg * 10));
     painter.setPen(QPen(Qt::green, lineWidth(1)));
-    painter.drawLine(QPointF(rect.left(), m_var * 10), QPointF(rect.right(), m_var * 10));
+    painter.drawLine(QPointF(rect.left(), distribution.var * 10), QPointF(rect.right(), distribution.var * 10));
     painter.setPen(QPen(Qt::darkYellow, lineWidth(1)));
-    painter.drawLine(QPointF(rect.left(), m_std * 10), QPointF(rect.right(), m_std * 10));
+    painter.drawLine(QPointF(rect.left(), distribution.std * 10), QPointF(rect.right(), distribution.std * 10));
     //m_origin = oldOrigin;
 }
 
-void CanvasView::drawNormal2D()
+void CanvasView::drawNormal2D(const RenderTarget& target)
 {
-    drawGrids();
-    drawAxes();
+    drawGrids(target, m_origin);
+    drawAxes(target, m_origin);
 
-    QPainter painter(viewport());
-    painter.setMatrix(fromSceneMatrix());
+    QPainter painter(target.device);
+    painter.setTransform(target.toDevice(fromSceneMatrix()));
     painter.setPen(QPen(Qt::blue, lineWidth(1)));
 
-    for (int i = 0; i < m_samples3D.size(); i++)
+    const DistributionSnapshot& distribution = *m_distribution;
+    for (int i = 0; i < distribution.samples3D.size(); i++)
     {
-        QVector3D sample = m_samples3D[i];
+        QVector3D sample = distribution.samples3D[i];
         //qDebug() << sample;
         QColor color(QColor::Hsv);
         color.setHsvF(1 - sample.z() / 2, 1, 1);
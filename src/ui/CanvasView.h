@@ -3,12 +3,21 @@
 
 #include <QGraphicsView>
 #include <QGenericMatrix> 
+#include <QPixmap>
 #include <QVector2D>
 #include <QVector3D>
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
 #include "common.h"
+#include "CanvasSnapshot.h"
+#include "math/GaussianMixture.h"
+#include "math/LineFit.h"
+#include "math/PointSet.h"
+#include "math/PointStream.h"
+#include "math/StreamingCovariance.h"
+
+class QTimer;
 
 class CanvasView : public QGraphicsView
 {
@@ -20,24 +29,78 @@ public:
     void setMatrix(const QMatrix2x2& matrix) { m_matrix = matrix; }
     QMatrix2x2 matrix() const { return m_matrix; }
 
-    void generateRandomPoints(int count, bool append = false);
-    void generateRandomLinePoints(int count, const QPointF& start, const QPointF& end, float radius = 0.2f, bool append = false);
-    //void generateRandomCirclePoints(int count);
-
-    QMatrix fromSceneMatrix() const;
-    QMatrix toSceneMatrix() const;
+    QPointF origin() const { return m_origin; }
+    qreal factor() const { return m_factor; }
+
+    const PointSet& points() const { return *m_pointsSnapshot->points; }
+    QSharedPointer<const PointsSnapshot> pointsSnapshot() const { return m_pointsSnapshot; }
+    // Computes the snapshot on the calling thread, with the KDE overlay if
+    // enabled through setKdeOptions().
+    void setPoints(const PointSet& points);
+    // Swaps in a snapshot built elsewhere. Fits of the previous point set are
+    // dropped unless the points are shared with it.
+    void publishPoints(const QSharedPointer<const PointsSnapshot>& snapshot);
+
+    QMatrix fromSceneMatrix() const { return fromSceneMatrix(m_origin); }
+    QMatrix toSceneMatrix() const { return toSceneMatrix(m_origin); }
+    QMatrix fromSceneMatrix(const QPointF& origin) const;
+    QMatrix toSceneMatrix(const QPointF& origin) const;
     qreal lineFactor() const;
     qreal lineWidth(qreal width = 1.0f) const;
 
-    void setImageRaw(const QImage& image) { m_imageRaw = image; }
-    void setEncodered(const QImage& image) { m_encodered = image; }
-    void setDecodered(const QImage& image) { m_decodered = image; }
-
-    void setSamples(const QList<QVector2D>& samples) { m_samples = samples; }
-    void setAvg(qreal avg) { m_avg = avg; }
-    void setVar(qreal var) { m_var = var; }
-    void setStd(qreal std) { m_std = std; }
-    void setSamples3D(const QList<QVector3D>& samples) { m_samples3D = samples; }
+    // Levels come from buildImageLevels() on the thread that computed the
+    // image; a pane without them is always drawn from the full image.
+    void setImageRaw(const QImage& image, const QVector<QImage>& levels = QVector<QImage>())
+        { m_imageRaw = image; m_rawLevels = levels; m_rawMipmaps.clear(); }
+    void setEncodered(const QImage& image, const QVector<QImage>& levels = QVector<QImage>())
+        { m_encodered = image; m_encoderedLevels = levels; m_encoderedMipmaps.clear(); }
+    void setDecodered(const QImage& image, const QVector<QImage>& levels = QVector<QImage>())
+        { m_decodered = image; m_decoderedLevels = levels; m_decoderedMipmaps.clear(); }
+    // Structure tensor orientation and coherence, drawn as a third column.
+    void setOrientation(const QImage& image, const QVector<QImage>& levels = QVector<QImage>())
+        { m_orientation = image; m_orientationLevels = levels; m_orientationMipmaps.clear(); }
+    void setAnisotropy(const QImage& image, const QVector<QImage>& levels = QVector<QImage>())
+        { m_anisotropy = image; m_anisotropyLevels = levels; m_anisotropyMipmaps.clear(); }
+    const QImage& imageRaw() const { return m_imageRaw; }
+    // Size the PCA panes are laid out at. Lets a low resolution preview stand
+    // in for the full image until it is ready; invalid uses the raw image size.
+    void setImageSize(const QSize& size) { m_imageSize = size; }
+    QSize imageSize() const { return m_imageSize.isValid() ? m_imageSize : m_imageRaw.size(); }
+
+    void publishDistribution(const QSharedPointer<const DistributionSnapshot>& snapshot);
+
+    // Rebuilds the KDE overlay on the calling thread when enabled or the
+    // bandwidth changes.
+    void setKdeOptions(bool enabled, float bandwidth, KdeMode mode);
+    void setKdeMode(KdeMode mode);
+    // Rows of a high-dimensional data set projected onto two principal
+    // components, with the variance along each.
+    // index must cover points; it is built by the task that projects them.
+    void setDataProjection(const QSharedPointer<const PointSet>& points, const QSharedPointer<const PointIndex>& index,
+        qreal varianceX, qreal varianceY);
+    // Live points for the covariance tool, drained once per frame while set.
+    // Replaces the generated points until cleared with a null stream.
+    void setStream(const QSharedPointer<PointStream>& stream);
+    bool isStreaming() const { return !m_stream.isNull(); }
+    void setStreamWeighting(StreamingCovariance::Weighting weighting, size_t window);
+    const StreamingCovariance& streamStatistics() const { return m_streamStatistics; }
+    void setMixture(const GaussianComponents& components) { m_mixture = components; }
+    void setClusters(const GaussianComponents& clusters) { m_clusters = clusters; }
+    // Fitted line of the covariance tool; points are coloured by whether
+    // they lie within its threshold.
+    void setLine(const FittedLine& line) { m_line = line; }
+
+    // Paints the current tool view into image through the same routines as
+    // the viewport, with transform mapping viewport pixels to image pixels.
+    // Only reads the view, so tiles can be rendered on several threads at
+    // once as long as the GUI thread waits for them. Hover labels are left
+    // out and the background is not filled.
+    void renderTool(QImage& image, const QTransform& transform);
+    // Hidden copy of everything renderTool() reads, with the view's mapping
+    // frozen as it is now, so an export can render it in the background
+    // while this view keeps changing. Call on the GUI thread; the copy is
+    // never shown and the caller owns it.
+    CanvasView* frozenCopy() const;
 
 protected:
     virtual void paintEvent(QPaintEvent *event) override;
@@ -55,16 +118,48 @@ public slots:
     void updateDistributionType(DistributionType distributionType);
 
 private:
-    void drawGrids();
-    void drawAxes();
-    void drawEigenMatrix();
-    void drawCovMatrix();
-    void drawPCA();
-    void drawProbability();
-    void drawBernoulli();
-    void drawNormal();
-    void drawNormal2D();
-    
+    // Where a frame goes: the viewport, or an export tile.
+    struct RenderTarget
+    {
+        QPaintDevice* device;
+        // Maps viewport pixels to device pixels.
+        QTransform transform;
+        // Part of the viewport covered by the device, in viewport pixels.
+        QRectF rect;
+        // Hover labels and pixmap caches are for the viewport only.
+        bool screen;
+
+        QTransform toDevice(const QMatrix& matrix) const { return QTransform(matrix) * transform; }
+    };
+
+    // View transform and scene to viewport mapping, frozen in a copy.
+    QTransform viewTransform() const;
+    QPoint sceneToViewport(const QPointF& point) const;
+
+    void drawTool(const RenderTarget& target);
+    void drawGrids(const RenderTarget& target, const QPointF& origin);
+    void drawAxes(const RenderTarget& target, const QPointF& origin);
+    void drawEigenMatrix(const RenderTarget& target);
+    void drawCovMatrix(const RenderTarget& target);
+    void drawPCA(const RenderTarget& target);
+    void drawProbability(const RenderTarget& target);
+    void drawDataPCA(const RenderTarget& target);
+    void drawBernoulli(const RenderTarget& target);
+    void drawNormal(const RenderTarget& target);
+    void drawNormal2D(const RenderTarget& target);
+    void drawImagePane(QPainter& painter, const RenderTarget& target, const QRect& rect, const QImage& image,
+        const QVector<QImage>& levels, QVector<QPixmap>& mipmaps);
+    void drawKde(QPainter& painter, const KdeSnapshot& snapshot);
+    void drawComponents(QPainter& painter, const GaussianComponents& components);
+    void drawEigenAxes(QPainter& painter, const Eigen::Vector2f& center, const Eigen::Matrix2f& matrix, const QColor& centerColor);
+    void drawFittedLine(QPainter& painter, const QRectF& visible);
+    void drawHover(QPainter& painter, const PointSet& points);
+    void drawStream(QPainter& painter);
+
+    void drainStream();
+
+    void updateHover(const QPoint& pos);
+
 private:
     bool m_init;
     qreal m_scaleFactor;
@@ -78,19 +173,56 @@ private:
 
     ToolType m_toolType;
 
-    QList<QPointF> m_points;
+    QSharedPointer<const PointsSnapshot> m_pointsSnapshot;
+    // Point under the mouse in the current snapshot, or -1.
+    long long m_hoverIndex;
+    qint64 m_hoverQueryNs;
 
     QImage m_imageRaw;
     QImage m_encodered;
     QImage m_decodered;
+    QImage m_orientation;
+    QImage m_anisotropy;
+    QSize m_imageSize;
+    // Images at 1, 1/2, 1/4, ... of each PCA pane's resolution, so zooming
+    // out never resamples the full image per frame.
+    QVector<QImage> m_rawLevels;
+    QVector<QImage> m_encoderedLevels;
+    QVector<QImage> m_decoderedLevels;
+    QVector<QImage> m_orientationLevels;
+    QVector<QImage> m_anisotropyLevels;
+    // Pixmaps of the levels drawn so far.
+    QVector<QPixmap> m_rawMipmaps;
+    QVector<QPixmap> m_encoderedMipmaps;
+    QVector<QPixmap> m_decoderedMipmaps;
+    QVector<QPixmap> m_orientationMipmaps;
+    QVector<QPixmap> m_anisotropyMipmaps;
 
     DistributionType m_distributionType;
 
-    QList<QVector2D> m_samples;
-    qreal m_avg;
-    qreal m_var;
-    qreal m_std;
-    QList<QVector3D> m_samples3D;
+    QSharedPointer<const DistributionSnapshot> m_distribution;
+
+    bool m_kdeEnabled;
+    float m_kdeBandwidth;
+    KdeMode m_kdeMode;
+
+    GaussianComponents m_mixture;
+    GaussianComponents m_clusters;
+    FittedLine m_line;
+
+    QSharedPointer<PointStream> m_stream;
+    StreamingCovariance m_streamStatistics;
+    QTimer* m_streamTimer;
+    PointSet m_streamBatch;
+
+    bool m_frozen;
+    QTransform m_frozenTransform;
+    QTransform m_frozenViewportTransform;
+
+    QSharedPointer<const PointSet> m_dataPoints;
+    QSharedPointer<const PointIndex> m_dataIndex;
+    qreal m_dataVarianceX;
+    qreal m_dataVarianceY;
 };
 
 #endif // CANVASVIEW_H
@@ -0,0 +1,35 @@
+#include "ComputeThread.h"
+
+ComputeThread::ComputeThread(const Task& task, QObject* parent)
+    : QThread(parent)
+    , m_task(task)
+    , m_cancelled(false)
+{
+}
+
+ComputeThread::~ComputeThread()
+{
+    cancel();
+    wait();
+}
+
+void ComputeThread::reportProgress(int percent, const QString& message)
+{
+    emit progress(percent, message);
+}
+
+void ComputeThread::publishPartial(const std::function<void()>& publish)
+{
+    // The thread object lives on the GUI thread, so the call is queued there.
+    QMetaObject::invokeMethod(this, [this, publish]()
+    {
+        if (!isCancelled())
+            publish();
+    }, Qt::QueuedConnection);
+}
+
+void ComputeThread::run()
+{
+    if (m_task)
+        m_task(this);
+}
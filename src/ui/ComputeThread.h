@@ -0,0 +1,39 @@
+#ifndef COMPUTETHREAD_H
+#define COMPUTETHREAD_H
+
+#include <QThread>
+#include <atomic>
+#include <functional>
+
+// Runs one computation off the GUI thread. The task polls isCancelled() and
+// reports through reportProgress(), which arrives on the GUI thread as the
+// queued progress() signal.
+class ComputeThread : public QThread
+{
+    Q_OBJECT
+public:
+    typedef std::function<void(ComputeThread* thread)> Task;
+
+    explicit ComputeThread(const Task& task, QObject* parent = nullptr);
+    virtual ~ComputeThread();
+
+    void cancel() { m_cancelled = true; }
+    bool isCancelled() const { return m_cancelled; }
+
+    void reportProgress(int percent, const QString& message);
+    // Runs publish on the GUI thread unless the task has been cancelled by
+    // then. For results that are ready before the task ends, e.g. a preview.
+    void publishPartial(const std::function<void()>& publish);
+
+signals:
+    void progress(int percent, const QString& message);
+
+protected:
+    virtual void run() override;
+
+private:
+    Task m_task;
+    std::atomic<bool> m_cancelled;
+};
+
+#endif // COMPUTETHREAD_H
@@ -1,34 +1,227 @@
 #include "MainWindow.h"
 #include "ui/ui_MainWindow.h"
+#include "CanvasExporter.h"
 #include "CanvasView.h"
+#include "TaskScheduler.h"
+#include "math/DataPCA.h"
+#include "math/Distributions.h"
+#include "math/GaussianMixture.h"
+#include "math/ImagePCA.h"
+#include "math/KMeans.h"
+#include "math/LineFit.h"
+#include "math/MatrixReader.h"
+#include "math/PcaCodec.h"
+#include "math/PointStream.h"
+#include "math/StructureTensor.h"
+#include "math/VideoPCA.h"
 
 #include <QActionGroup>
+#include <QApplication>
+#include <QCheckBox>
+#include <QDebug>
+#include <QDoubleSpinBox>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFileDialog>
 #include <QGenericMatrix>
 #include <QImage>
+#include <QImageReader>
+#include <QInputDialog>
+#include <QProgressBar>
 #include <QPushButton>
+#include <QRegularExpression>
 #include <QSpinBox>
+#include <QTimer>
 #include <QtMath>
 #include <QVector3D>
 #include <QMatrix>
+#include <QSharedPointer>
 
-#include <opencv2/opencv.hpp>
+#include <iostream>
+
+namespace
+{
+    // Longest side of the pyramid level the first PCA preview is built from.
+    const int PcaPreviewSize = 512;
+
+    struct PcaImages
+    {
+        QImage raw;
+        QImage encodered;
+        QImage decodered;
+        QImage orientation;
+        QImage anisotropy;
+        // Pane levels for CanvasView, see buildImageLevels().
+        QVector<QImage> rawLevels;
+        QVector<QImage> encoderedLevels;
+        QVector<QImage> decoderedLevels;
+        QVector<QImage> orientationLevels;
+        QVector<QImage> anisotropyLevels;
+        Eigen::Matrix3f scatter;
+        Eigen::Vector3f axis;
+    };
+
+    // Structure tensor options; sigma <= 0 leaves the tensor panes empty.
+    struct TensorOptions
+    {
+        float sigma;
+        StructureTensor::Smoothing smoothing;
+    };
+
+    void computeStructureTensor(const QImage& rgb, const TensorOptions& options, QImage& orientation, QImage& anisotropy)
+    {
+        if (options.sigma <= 0)
+        {
+            orientation = QImage();
+            anisotropy = QImage();
+            return;
+        }
+
+        StructureTensor tensor;
+        tensor.setSigma(options.sigma);
+        tensor.setSmoothing(options.smoothing);
+        tensor.compute(rgb.constBits(), rgb.width(), rgb.height(), rgb.bytesPerLine());
+
+        orientation = QImage(rgb.width(), rgb.height(), QImage::Format_RGB888);
+        tensor.orientationImage(orientation.bits(), orientation.bytesPerLine());
+        anisotropy = QImage(rgb.width(), rgb.height(), QImage::Format_RGB888);
+        tensor.anisotropyImage(anisotropy.bits(), anisotropy.bytesPerLine());
+        qDebug() << "structure tensor" << rgb.size() << "gradients" << tensor.gradientMs() << "ms, smoothing"
+            << tensor.smoothingMs() << "ms, eigen" << tensor.eigenMs() << "ms";
+    }
+
+    struct KdeOptions
+    {
+        bool enabled;
+        float bandwidth;
+    };
+
+    KdeOptions readKdeOptions(const Ui::MainWindow* ui)
+    {
+        KdeOptions options;
+        options.enabled = ui->checkBoxKde->isChecked();
+        options.bandwidth = float(ui->doubleSpinBoxKdeBandwidth->value());
+        return options;
+    }
+
+    TensorOptions readTensorOptions(const Ui::MainWindow* ui)
+    {
+        TensorOptions options;
+        options.sigma = ui->checkBoxStructureTensor->isChecked() ? float(ui->doubleSpinBoxTensorSigma->value()) : 0.0f;
+        options.smoothing = static_cast<StructureTensor::Smoothing>(ui->comboBoxTensorSmoothing->currentData(Qt::UserRole).toInt());
+        return options;
+    }
+
+    PcaImages computePca(const QImage& image, const TensorOptions& tensorOptions)
+    {
+        PcaImages images;
+        images.raw = image.convertToFormat(QImage::Format_RGB888);
+        const QImage& rgb = images.raw;
+
+        ImagePCA pca;
+        pca.computeBasis(rgb.constBits(), rgb.width(), rgb.height(), rgb.bytesPerLine());
+        images.scatter = pca.scatter();
+        images.axis = pca.axis();
+
+        images.encodered = QImage(rgb.width(), rgb.height(), QImage::Format::Format_Grayscale8);
+        std::vector<float> projection(size_t(rgb.width()) * rgb.height());
+        pca.encode(rgb.constBits(), rgb.width(), rgb.height(), rgb.bytesPerLine(),
+            projection.data(), images.encodered.bits(), images.encodered.bytesPerLine());
+
+        images.decodered = QImage(rgb.width(), rgb.height(), QImage::Format::Format_RGB888);
+        pca.decode(projection.data(), rgb.width(), rgb.height(), images.decodered.bits(), images.decodered.bytesPerLine());
+
+        computeStructureTensor(rgb, tensorOptions, images.orientation, images.anisotropy);
+
+        images.rawLevels = buildImageLevels(images.raw);
+        images.encoderedLevels = buildImageLevels(images.encodered);
+        images.decoderedLevels = buildImageLevels(images.decodered);
+        images.orientationLevels = buildImageLevels(images.orientation);
+        images.anisotropyLevels = buildImageLevels(images.anisotropy);
+        return images;
+    }
+
+    // Turns the first image of a numbered sequence, e.g. frame_0001.png, into
+    // the printf pattern VideoCapture reads the sequence from.
+    QString sequencePattern(const QString& filename)
+    {
+        static const QStringList ImageSuffixes = QStringList() << "png" << "bmp" << "jpg" << "jpeg" << "tif" << "tiff";
+        QRegularExpressionMatch match = QRegularExpression("^(.*\\D|)(\\d+)\\.(\\w+)$").match(filename);
+        if (!match.hasMatch() || !ImageSuffixes.contains(match.captured(3).toLower()))
+            return filename;
+        return match.captured(1) + "%0" + QString::number(match.captured(2).size()) + "d." + match.captured(3);
+    }
+
+    // A PCA pass together with the resolution it stands for.
+    struct PcaResult
+    {
+        PcaResult() : elapsed(0) {}
+
+        PcaImages images;
+        QSize size;
+        TensorOptions tensorOptions;
+        qint64 elapsed;
+    };
+
+    bool operator!=(const TensorOptions& a, const TensorOptions& b)
+    {
+        return a.sigma != b.sigma || a.smoothing != b.smoothing;
+    }
+
+    void showPca(CanvasView* canvas, const PcaImages& images, const QSize& size)
+    {
+        const Eigen::Vector3f& d = images.axis;
+        std::cout << "M" << std::endl;
+        std::cout << images.scatter << std::endl;
+        std::cout << "d:" << d.transpose() << std::endl;
+        std::cout << "dT * d:" << (d.transpose() * d) << std::endl;
+
+        canvas->setImageSize(size);
+        canvas->setImageRaw(images.raw, images.rawLevels);
+        canvas->setEncodered(images.encodered, images.encoderedLevels);
+        canvas->setDecodered(images.decodered, images.decoderedLevels);
+        canvas->setOrientation(images.orientation, images.orientationLevels);
+        canvas->setAnisotropy(images.anisotropy, images.anisotropyLevels);
+        canvas->scene()->update();
+    }
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , m_streamReceived(0)
 {
     ui->setupUi(this);
 
+    m_progressBar = new QProgressBar(this);
+    m_progressBar->setMaximumWidth(200);
+    m_progressBar->setVisible(false);
+    ui->statusbar->addPermanentWidget(m_progressBar);
+
+    m_scheduler = new TaskScheduler(this);
+
+    m_streamStatusTimer = new QTimer(this);
+    m_streamStatusTimer->setInterval(1000);
+
     m_toolsGroup = new QActionGroup(this);
     m_toolsGroup->addAction(ui->actionEigenMatrixTool);
     m_toolsGroup->addAction(ui->actionCovMatrixTool);
     m_toolsGroup->addAction(ui->actionPCATool);
     m_toolsGroup->addAction(ui->actionProbabilityTool);
+    m_toolsGroup->addAction(ui->actionDataPCATool);
 
     ui->toolButtonGenerate->setDefaultAction(ui->actionGenerate);
     ui->toolButtonOpenImage->setDefaultAction(ui->actionOpenImage);
+    ui->toolButtonSaveEncoded->setDefaultAction(ui->actionSaveEncoded);
+    ui->toolButtonProcessVideo->setDefaultAction(ui->actionProcessVideo);
     ui->toolButtonShowDistribution->setDefaultAction(ui->actionShowDistribution);
+    ui->toolButtonFitMixture->setDefaultAction(ui->actionFitMixture);
+    ui->toolButtonCluster->setDefaultAction(ui->actionCluster);
+    ui->toolButtonFitLine->setDefaultAction(ui->actionFitLine);
+    ui->toolButtonCancelCompute->setDefaultAction(ui->actionCancelCompute);
+    ui->toolButtonOpenData->setDefaultAction(ui->actionOpenData);
+    ui->toolButtonOpenStream->setDefaultAction(ui->actionOpenStream);
+    ui->toolButtonStopStream->setDefaultAction(ui->actionStopStream);
 
     QMatrix2x2 matrix = ui->graphicsViewCanvas->matrix();
     ui->lineEdit00->setText(QString::number(matrix(0, 0)));
@@ -38,10 +231,33 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(ui->pushButtonApply, &QPushButton::clicked, this, &MainWindow::onApply);
     connect(m_toolsGroup, &QActionGroup::triggered, this, &MainWindow::onToolsGroupTriggered);
+    connect(m_scheduler, &TaskScheduler::progress, this, &MainWindow::onComputeProgress);
+    connect(m_scheduler, &TaskScheduler::busyChanged, this, &MainWindow::onComputeBusyChanged);
     connect(ui->actionGenerate, &QAction::triggered, this, &MainWindow::onActionGenerate);
     connect(ui->actionOpenImage, &QAction::triggered, this, &MainWindow::onActionOpenImage);
+    connect(ui->actionSaveEncoded, &QAction::triggered, this, &MainWindow::onActionSaveEncoded);
+    connect(ui->actionProcessVideo, &QAction::triggered, this, &MainWindow::onActionProcessVideo);
     connect(ui->actionShowDistribution, &QAction::triggered, this, &MainWindow::showDistribution);
+    connect(ui->actionFitMixture, &QAction::triggered, this, &MainWindow::onActionFitMixture);
+    connect(ui->actionCluster, &QAction::triggered, this, &MainWindow::onActionCluster);
+    connect(ui->actionFitLine, &QAction::triggered, this, &MainWindow::onActionFitLine);
+    connect(ui->actionCancelCompute, &QAction::triggered, this, &MainWindow::onActionCancelCompute);
+    connect(ui->actionOpenData, &QAction::triggered, this, &MainWindow::onActionOpenData);
     connect(ui->comboBoxDistributionType, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onComboBoxDistributionTypeChanged);
+    connect(ui->checkBoxKde, &QCheckBox::toggled, this, &MainWindow::onKdeOptionsChanged);
+    connect(ui->doubleSpinBoxKdeBandwidth, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::onKdeOptionsChanged);
+    connect(ui->comboBoxKdeMode, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onKdeModeChanged);
+    connect(ui->checkBoxStructureTensor, &QCheckBox::toggled, this, &MainWindow::onStructureTensorOptionsChanged);
+    connect(ui->doubleSpinBoxTensorSigma, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::onStructureTensorOptionsChanged);
+    connect(ui->comboBoxTensorSmoothing, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onStructureTensorOptionsChanged);
+    connect(ui->spinBoxDataAxisX, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::onDataAxesChanged);
+    connect(ui->spinBoxDataAxisY, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::onDataAxesChanged);
+    connect(ui->actionOpenStream, &QAction::triggered, this, &MainWindow::onActionOpenStream);
+    connect(ui->actionStopStream, &QAction::triggered, this, &MainWindow::onActionStopStream);
+    connect(ui->comboBoxStreamWeighting, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onStreamWeightingChanged);
+    connect(ui->spinBoxStreamWindow, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::onStreamWeightingChanged);
+    connect(m_streamStatusTimer, &QTimer::timeout, this, &MainWindow::onStreamStatus);
+    connect(ui->actionExportImage, &QAction::triggered, this, &MainWindow::onActionExportImage);
 
     ui->graphicsViewCanvas->updateToolType(TT_EigenMatrix);
 
@@ -50,11 +266,36 @@ MainWindow::MainWindow(QWidget *parent)
     ui->comboBoxDistributionType->addItem("Normal", DT_NORMAL);
     ui->comboBoxDistributionType->addItem("Normal2D", DT_NORMAL2D);
 
+    ui->comboBoxKdeMode->addItem("Heat", KM_Heat);
+    ui->comboBoxKdeMode->addItem("Contour", KM_Contour);
+    ui->comboBoxKdeMode->addItem("Heat + Contour", KM_HeatContour);
+
+    ui->comboBoxTensorSmoothing->addItem("Gaussian", StructureTensor::Gaussian);
+    ui->comboBoxTensorSmoothing->addItem("Box", StructureTensor::Box);
+
+    ui->comboBoxVideoBasis->addItem("Per Frame", VideoPCA::PerFrame);
+    ui->comboBoxVideoBasis->addItem("Reuse First", VideoPCA::ReuseFirst);
+    ui->comboBoxVideoBasis->addItem("Incremental", VideoPCA::Incremental);
+
+    ui->comboBoxKMeansAlgorithm->addItem("Lloyd", KMeans::Lloyd);
+    ui->comboBoxKMeansAlgorithm->addItem("Mini-batch", KMeans::MiniBatch);
+
+    ui->comboBoxLineFit->addItem("Total least squares", LF_TotalLeastSquares);
+    ui->comboBoxLineFit->addItem("RANSAC", LF_Ransac);
+    ui->comboBoxLineFit->setCurrentIndex(1);
+
+    ui->comboBoxStreamWeighting->addItem("Cumulative", StreamingCovariance::Cumulative);
+    ui->comboBoxStreamWeighting->addItem("Sliding window", StreamingCovariance::SlidingWindow);
+    ui->comboBoxStreamWeighting->addItem("Exponential decay", StreamingCovariance::ExponentialDecay);
+
     showDistribution();
 }
 
 MainWindow::~MainWindow()
 {
+    // Superseded tasks may still be winding down; stop them before the
+    // widgets their publish steps refer to go away.
+    delete m_scheduler;
     delete ui;
 }
 
@@ -77,247 +318,821 @@ void MainWindow::onToolsGroupTriggered(QAction * action)
     {
         ui->graphicsViewCanvas->updateToolType(TT_Probability);
     }
+    else if (action == ui->actionDataPCATool)
+    {
+        ui->graphicsViewCanvas->updateToolType(TT_DataPCA);
+    }
 }
 
 void MainWindow::onActionGenerate(bool checked)
 {
-    if (ui->radioButtonAllRandom->isChecked())
+    bool line = ui->radioButtonLineRandom->isChecked();
+    if (!line && !ui->radioButtonAllRandom->isChecked())
+        return;
+
+    // Fits and overlays of the points being replaced are of no use anymore.
+    m_scheduler->cancel(TC_Fit);
+    m_scheduler->cancel(TC_Kde);
+
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    int count = ui->spinBoxCount->value();
+    QSharedPointer<const PointSet> base;
+    QSharedPointer<const PointIndex> baseIndex;
+    if (ui->checkBoxAppend->isChecked())
     {
-        ui->graphicsViewCanvas->generateRandomPoints(ui->spinBoxCount->value(), ui->checkBoxAppend->isChecked());
+        base = canvas->pointsSnapshot()->points;
+        baseIndex = canvas->pointsSnapshot()->index;
     }
-    else if (ui->radioButtonLineRandom->isChecked())
+    QRectF sceneRect = canvas->sceneRect();
+    QPointF origin = canvas->origin();
+    qreal factor = canvas->factor();
+    QPointF start(ui->doubleSpinBoxStartX->value(), ui->doubleSpinBoxStartY->value());
+    QPointF end(ui->doubleSpinBoxEndX->value(), ui->doubleSpinBoxEndY->value());
+    float radius = ui->doubleSpinBoxRandRadius->value();
+    float outliers = ui->spinBoxOutliers->value() / 100.0f;
+    KdeOptions kde = readKdeOptions(ui);
+
+    QSharedPointer<PointsSnapshot> result(new PointsSnapshot);
+    m_scheduler->submit(TC_Points, [=](ComputeThread* self)
     {
-        QPointF start(ui->doubleSpinBoxStartX->value(), ui->doubleSpinBoxStartY->value());
-        QPointF end(ui->doubleSpinBoxEndX->value(), ui->doubleSpinBoxEndY->value());
-        float radius = ui->doubleSpinBoxRandRadius->value();
-        ui->graphicsViewCanvas->generateRandomLinePoints(ui->spinBoxCount->value(),
-            start, end, radius, ui->checkBoxAppend->isChecked());
-    }
+        QSharedPointer<PointSet> points(base ? new PointSet(*base) : new PointSet);
+        points->reserve(points->size() + count);
+
+        // Sliced so a superseded request stops early.
+        const int Slice = 1 << 20;
+        for (int done = 0; done < count; done += Slice)
+        {
+            if (self->isCancelled())
+                return;
+            int n = qMin(Slice, count - done);
+            if (line)
+                appendRandomLinePoints(*points, n, start, end, radius, outliers);
+            else
+                appendRandomPoints(*points, n, sceneRect, origin, factor);
+            self->reportProgress(int(80LL * (done + n) / count), QString("Generated %1 of %2 points").arg(done + n).arg(count));
+        }
+
+        // Appended points extend the index of the base set.
+        self->reportProgress(80, "Indexing points");
+        *result = *buildPointsSnapshot(points, kde.enabled, kde.bandwidth, baseIndex);
+    }, [=]()
+    {
+        canvas->publishPoints(result);
+
+        // Overlay options changed while generating.
+        KdeOptions current = readKdeOptions(ui);
+        if (current.enabled != kde.enabled || current.bandwidth != kde.bandwidth)
+            onKdeOptionsChanged();
+    });
 }
 
 void MainWindow::onActionOpenImage(bool checked)
 {
     QString filename = QFileDialog::getOpenFileName(this,
-        tr("Open Image"), tr("."), tr("Image (*.png *.bmp *.jpeg);;"));
+        tr("Open Image"), tr("."), tr("Image (*.png *.bmp *.jpg *.jpeg *.pcai);;"));
+    if (filename.isNull() || filename.isEmpty())
+        return;
+    if (filename.endsWith(".pcai", Qt::CaseInsensitive))
+    {
+        openEncodedImage(filename);
+        return;
+    }
+
+    TensorOptions tensorOptions = readTensorOptions(ui);
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    m_scheduler->cancel(TC_StructureTensor);
 
-    if (!filename.isNull() && !filename.isEmpty())
+    // A large image is shown first as a coarse preview, then refined at full
+    // resolution in the same task. Formats that decode scaled, such as JPEG,
+    // decode the preview directly so it comes up in the same time whatever
+    // the file size; the others are decoded once and scaled down.
+    QSharedPointer<PcaResult> result(new PcaResult);
+    m_scheduler->submit(TC_Image, [=](ComputeThread* self)
     {
-        QImage image(filename);
-        ui->graphicsViewCanvas->setImageRaw(image);
+        QElapsedTimer timer;
+        timer.start();
+        self->reportProgress(0, QString("Decoding %1").arg(filename));
+        QImageReader reader(filename);
+        QSize size = reader.size();
+        QImage image;
+        QImage small;
+        if (size.isValid() && qMax(size.width(), size.height()) > PcaPreviewSize
+            && reader.supportsOption(QImageIOHandler::ScaledSize))
+        {
+            reader.setScaledSize(size.scaled(PcaPreviewSize, PcaPreviewSize, Qt::KeepAspectRatio));
+            small = reader.read();
+        }
+        else
+        {
+            image = reader.read();
+            if (image.isNull())
+                return;
+            size = image.size();
+            if (qMax(size.width(), size.height()) > PcaPreviewSize)
+                small = image.scaled(PcaPreviewSize, PcaPreviewSize, Qt::KeepAspectRatio, Qt::FastTransformation);
+        }
+        if (self->isCancelled())
+            return;
 
-        int total = image.width() * image.height();
-        Eigen::MatrixXf X;
-        X.resize(3, total);
-        for (int i = 0; i < image.height(); i++)
+        if (!small.isNull())
         {
-            for (int j = 0; j < image.width(); j++)
+            QSharedPointer<PcaResult> preview(new PcaResult);
+            // The preview is smaller, so shrink the integration scale with it.
+            TensorOptions options = tensorOptions;
+            options.sigma = tensorOptions.sigma <= 0 ? 0
+                : qMax(0.5f, tensorOptions.sigma * small.width() / size.width());
+            self->reportProgress(10, "Computing PCA preview");
+            preview->images = computePca(small, options);
+            preview->size = size;
+            preview->tensorOptions = tensorOptions;
+            preview->elapsed = timer.elapsed();
+            if (self->isCancelled())
+                return;
+            self->publishPartial([=]()
             {
-                QRgb rgb = image.pixel(j, i);
-                Eigen::Vector3f x;
-                x.x() = qRed(rgb);
-                x.y() = qGreen(rgb);
-                x.z() = qBlue(rgb);
-                X.col(i * image.width() + j) = x;
-            }
+                showPca(canvas, preview->images, preview->size);
+                ui->statusbar->showMessage(QString("PCA preview %1x%2 in %3 ms")
+                    .arg(preview->images.raw.width()).arg(preview->images.raw.height()).arg(preview->elapsed));
+
+                // Options changed while computing.
+                if (readTensorOptions(ui) != preview->tensorOptions)
+                    onStructureTensorOptionsChanged();
+            });
         }
 
-        Eigen::Matrix3f M = X * X.transpose();
-        Eigen::EigenSolver<Eigen::Matrix3f> eigensolver(M);
-        Eigen::Matrix3f em = eigensolver.eigenvectors().real();
-        Eigen::Vector3f ev = eigensolver.eigenvalues().real();
-        Eigen::Vector3f e1 = em.col(0) * ev.x();
-        Eigen::Vector3f d = e1.normalized();
+        if (image.isNull())
+        {
+            self->reportProgress(30, QString("Decoding %1 at full resolution").arg(filename));
+            image = QImageReader(filename).read();
+            if (image.isNull() || self->isCancelled())
+                return;
+        }
 
-        std::cout << "M" << std::endl;
-        std::cout << M << std::endl;
-        std::cout << "eigen vector 1:" << e1.transpose() << std::endl;
-        std::cout << "d:" << d.transpose() << std::endl;
-        std::cout << "dT * d:" << (d.transpose() * d) << std::endl;
+        self->reportProgress(50, QString("Computing full resolution PCA %1x%2").arg(image.width()).arg(image.height()));
+        result->images = computePca(image, tensorOptions);
+        result->size = image.size();
+        result->tensorOptions = tensorOptions;
+        result->elapsed = timer.elapsed();
+    }, [=]()
+    {
+        if (result->images.raw.isNull())
+            return;
+        // Whatever still runs on the preview is superseded now.
+        m_scheduler->cancel(TC_StructureTensor);
+        showPca(canvas, result->images, result->size);
+        ui->statusbar->showMessage(QString("PCA %1x%2 in %3 ms")
+            .arg(result->size.width()).arg(result->size.height()).arg(result->elapsed));
 
-        Eigen::Vector3f white(255, 255, 255);
-        float max = white.transpose() * d;
-        float min = 0;
+        if (readTensorOptions(ui) != result->tensorOptions)
+            onStructureTensorOptionsChanged();
+    });
+}
 
-        QImage encodered(image.width(), image.height(), QImage::Format::Format_Grayscale8);
-        cv::Mat mat(image.height(), image.width(), CV_32F);
-        for (int i = 0; i < image.height(); i++)
+void MainWindow::openEncodedImage(const QString& filename)
+{
+    TensorOptions tensorOptions = readTensorOptions(ui);
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    m_scheduler->cancel(TC_StructureTensor);
+
+    // Small enough to decode at full resolution straight away; there is no
+    // preview pass.
+    QSharedPointer<PcaResult> result(new PcaResult);
+    QSharedPointer<QString> error(new QString);
+    m_scheduler->submit(TC_Image, [=](ComputeThread* self)
+    {
+        self->reportProgress(0, QString("Decoding %1").arg(filename));
+        PcaImageDecoder decoder;
+        if (!decoder.load(QFile::encodeName(filename).toStdString()))
         {
-            for (int j = 0; j < image.width(); j++)
-            {
-                QRgb rgb = image.pixel(j, i);
-                Eigen::Vector3f x;
-                x.x() = qRed(rgb);
-                x.y() = qGreen(rgb);
-                x.z() = qBlue(rgb);
-
-                float output = d.transpose() * x;
-                mat.ptr<float>(i)[j] = output;
-                int gray = output * 255 / max;
-                encodered.setPixelColor(j, i, QColor::fromRgb(gray, gray, gray));
-            }
+            *error = QString::fromStdString(decoder.errorString());
+            return;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        QImage image(decoder.width(), decoder.height(), QImage::Format_RGB888);
+        if (image.isNull() || !decoder.decode(image.bits(), image.bytesPerLine()))
+        {
+            *error = image.isNull() ? QString("out of memory") : QString::fromStdString(decoder.errorString());
+            return;
         }
+        result->elapsed = timer.elapsed();
+        if (self->isCancelled())
+            return;
+        result->images = computePca(image, tensorOptions);
+        result->size = image.size();
+        result->tensorOptions = tensorOptions;
+    }, [=]()
+    {
+        if (result->images.raw.isNull())
+        {
+            ui->statusbar->showMessage(QString("Cannot decode %1: %2").arg(filename).arg(*error));
+            return;
+        }
+        showPca(canvas, result->images, result->size);
+        ui->statusbar->showMessage(QString("Decoded %1x%2 in %3 ms")
+            .arg(result->size.width()).arg(result->size.height()).arg(result->elapsed));
 
-        ui->graphicsViewCanvas->setEncodered(encodered);
+        if (readTensorOptions(ui) != result->tensorOptions)
+            onStructureTensorOptionsChanged();
+    });
+}
 
-        //Eigen::Matrix3f dM = d * d.transpose();
-        QImage decodered(image.width(), image.height(), QImage::Format::Format_RGB888);
-        for (int i = 0; i < image.height(); i++)
+void MainWindow::onActionSaveEncoded(bool checked)
+{
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    QImage raw = canvas->imageRaw();
+    if (raw.isNull())
+    {
+        ui->statusbar->showMessage("Open an image first");
+        return;
+    }
+    // While an image is opening the raw pane may still hold the preview;
+    // encoding that would silently save a downscaled file.
+    if (raw.size() != canvas->imageSize())
+    {
+        ui->statusbar->showMessage("Wait for the full-resolution image before saving");
+        return;
+    }
+    QString filename = QFileDialog::getSaveFileName(this,
+        tr("Save Encoded"), tr("."), tr("PCA Image (*.pcai)"));
+    if (filename.isEmpty())
+        return;
+    if (!filename.endsWith(".pcai", Qt::CaseInsensitive))
+        filename += ".pcai";
+
+    int components = ui->spinBoxEncodedComponents->value();
+    QSharedPointer<PcaImageEncoder> encoder(new PcaImageEncoder);
+    encoder->setComponentCount(components);
+    QSharedPointer<qint64> elapsed(new qint64(-1));
+    m_scheduler->submit(TC_Encode, [=](ComputeThread* self)
+    {
+        self->reportProgress(0, QString("Encoding %1").arg(filename));
+        QElapsedTimer timer;
+        timer.start();
+        QImage rgb = raw.convertToFormat(QImage::Format_RGB888);
+        if (encoder->encode(rgb.constBits(), rgb.width(), rgb.height(), rgb.bytesPerLine())
+            && encoder->save(QFile::encodeName(filename).toStdString()))
+            *elapsed = timer.elapsed();
+    }, [=]()
+    {
+        if (*elapsed < 0)
         {
-            for (int j = 0; j < image.width(); j++)
-            {
-                float input = mat.ptr<float>(i)[j];
-                Eigen::Vector3f output = d * input;
+            ui->statusbar->showMessage(QString("Cannot save %1: %2").arg(filename)
+                .arg(QString::fromStdString(encoder->errorString())));
+            return;
+        }
+        size_t bytes = encoder->data().size();
+        ui->statusbar->showMessage(QString("Saved %1: %2 components, %3 bytes (%4 bits/pixel) in %5 ms")
+            .arg(filename).arg(components).arg(bytes)
+            .arg(bytes * 8.0 / (double(raw.width()) * raw.height()), 0, 'f', 2).arg(*elapsed));
+    });
+}
 
-                output.x() = qBound(0.f, output.x(), 255.f);
-                output.y() = qBound(0.f, output.y(), 255.f);
-                output.z() = qBound(0.f, output.z(), 255.f);
+void MainWindow::onActionProcessVideo(bool checked)
+{
+    QString source = QFileDialog::getOpenFileName(this, tr("Process Video"), tr("."),
+        tr("Video (*.mp4 *.avi *.mov *.mkv);;Image Sequence (*.png *.bmp *.jpg *.jpeg *.tif *.tiff)"));
+    if (source.isEmpty())
+        return;
+    source = sequencePattern(source);
 
-                decodered.setPixelColor(j, i, QColor::fromRgb(output.x(), output.y(), output.z()));
-            }
+    QString destination = QFileDialog::getSaveFileName(this, tr("Save Decoded Video"), tr("."), tr("Video (*.avi)"));
+    if (destination.isEmpty())
+        return;
+
+    VideoPCA::BasisMode mode = static_cast<VideoPCA::BasisMode>(
+        ui->comboBoxVideoBasis->currentData(Qt::UserRole).toInt());
+    QSharedPointer<VideoPCA> video(new VideoPCA);
+    video->setBasisMode(mode);
+    QSharedPointer<bool> done(new bool(false));
+    m_scheduler->submit(TC_Video, [=](ComputeThread* self)
+    {
+        self->reportProgress(0, QString("Processing %1").arg(source));
+        *done = video->run(QFile::encodeName(source).toStdString(), QFile::encodeName(destination).toStdString(),
+            [=](long long frames, long long total)
+        {
+            int percent = total > 0 ? int(qMin(100LL, frames * 100 / total)) : 0;
+            self->reportProgress(percent, QString("Video PCA: frame %1%2")
+                .arg(frames).arg(total > 0 ? QString(" of %1").arg(total) : QString()));
+            return !self->isCancelled();
+        });
+    }, [=]()
+    {
+        if (!*done)
+        {
+            ui->statusbar->showMessage(QString("Video PCA failed: %1").arg(QString::fromStdString(video->errorString())));
+            return;
         }
+        QString message = QString("Video PCA: %1 frames in %2 ms, %3 fps; utilization decode %4%, PCA %5%, encode %6%")
+            .arg(video->frames()).arg(video->elapsedMs(), 0, 'f', 0).arg(video->fps(), 0, 'f', 1)
+            .arg(video->utilization(VideoPCA::DecodeStage) * 100, 0, 'f', 0)
+            .arg(video->utilization(VideoPCA::ComputeStage) * 100, 0, 'f', 0)
+            .arg(video->utilization(VideoPCA::EncodeStage) * 100, 0, 'f', 0);
+        qDebug().noquote() << message;
+        ui->statusbar->showMessage(message);
+    });
+}
 
-        ui->graphicsViewCanvas->setDecodered(decodered);
-        ui->graphicsViewCanvas->scene()->update();
-    }
+void MainWindow::onStructureTensorOptionsChanged()
+{
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    QImage raw = canvas->imageRaw();
+    if (raw.isNull())
+        return;
+
+    // Recomputed on whatever resolution the raw pane currently holds.
+    TensorOptions options = readTensorOptions(ui);
+    if (options.sigma > 0 && !canvas->imageSize().isEmpty())
+        options.sigma = qMax(0.5f, options.sigma * raw.width() / canvas->imageSize().width());
+
+    QSharedPointer<PcaResult> result(new PcaResult);
+    m_scheduler->submit(TC_StructureTensor, [=](ComputeThread* self)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        self->reportProgress(0, "Computing structure tensor");
+        computeStructureTensor(raw.convertToFormat(QImage::Format_RGB888), options,
+            result->images.orientation, result->images.anisotropy);
+        result->images.orientationLevels = buildImageLevels(result->images.orientation);
+        result->images.anisotropyLevels = buildImageLevels(result->images.anisotropy);
+        result->elapsed = timer.elapsed();
+    }, [=]()
+    {
+        // The raw pane was replaced meanwhile; its publish rechecks the options.
+        if (canvas->imageRaw().cacheKey() != raw.cacheKey())
+            return;
+        canvas->setOrientation(result->images.orientation, result->images.orientationLevels);
+        canvas->setAnisotropy(result->images.anisotropy, result->images.anisotropyLevels);
+        canvas->scene()->update();
+        if (options.sigma > 0)
+            ui->statusbar->showMessage(QString("Structure tensor %1x%2 in %3 ms").arg(raw.width()).arg(raw.height()).arg(result->elapsed));
+    });
 }
 
 void MainWindow::showDistribution(bool ckecked)
 {
     DistributionType type = static_cast<DistributionType>(ui->comboBoxDistributionType->currentData(Qt::UserRole).toInt());
+    double probability = ui->doubleSpinBoxBernoulliProbability->value();
+    int count = ui->spinBoxBernoulliCount->value();
+    double u = ui->doubleSpinBoxNormalU->value();
+    double sigma = ui->doubleSpinBoxNormalSigma->value();
+    double delta = ui->doubleSpinBoxNormalDelta->value();
 
-    ui->graphicsViewCanvas->updateDistributionType(type);
-
-    qreal sum = 0;
-    qreal avg = 0;
-    qreal var = 0;
-    qreal std = 0;
-    QList<QVector2D> samples;
-    QList<QVector3D> samples3D;
-    if (type == DT_BERNOULLI)
+    QSharedPointer<DistributionSnapshot> snapshot(new DistributionSnapshot);
+    m_scheduler->submit(TC_Distribution, [=](ComputeThread* self)
     {
-        qreal probability = ui->doubleSpinBoxBernoulliProbability->value();
-        int count = ui->spinBoxBernoulliCount->value();
-        for (int i = 0; i <= count; i++)
+        if (type == DT_BERNOULLI || type == DT_NORMAL)
         {
-            qreal value = qPow(probability, i) * (qPow(1 - probability, count - i));
-            samples.append(QVector2D(i, value));
-            sum += value;
+            DistributionSamples result = type == DT_BERNOULLI
+                ? bernoulliSamples(probability, count)
+                : normalSamples(u, sigma, delta);
+            snapshot->samples.reserve(int(result.samples.size()));
+            for (size_t i = 0; i < result.samples.size(); i++)
+            {
+                snapshot->samples.append(QVector2D(result.samples[i].x(), result.samples[i].y()));
+            }
+            snapshot->avg = result.avg;
+            snapshot->var = result.var;
+            snapshot->std = result.std;
         }
-        avg = sum / samples.size();
-        for (int i = 0; i < samples.size(); i++)
+        else if (type == DT_NORMAL2D)
         {
-            var += (samples[i].y() - avg) * (samples[i].y() - avg);
+            std::vector<Eigen::Vector3f> grid = normal2DGrid(sigma, delta);
+            snapshot->samples3D.reserve(int(grid.size()));
+            for (size_t i = 0; i < grid.size(); i++)
+            {
+                snapshot->samples3D.append(QVector3D(grid[i].x(), grid[i].y(), grid[i].z()));
+            }
         }
-        var /= samples.size();
-        std = qSqrt(var);
+    }, [=]()
+    {
+        qDebug() << "avg =" << snapshot->avg;
+        qDebug() << "var =" << snapshot->var;
+        qDebug() << "std =" << snapshot->std;
+
+        // Type and samples switch in the same frame.
+        ui->graphicsViewCanvas->updateDistributionType(type);
+        ui->graphicsViewCanvas->publishDistribution(snapshot);
+    });
+}
+
+void MainWindow::onComboBoxDistributionTypeChanged(int index)
+{
+    DistributionType type = static_cast<DistributionType>(ui->comboBoxDistributionType->currentData(Qt::UserRole).toInt());
+
+    ui->groupBoxBernoulli->setVisible(false);
+    ui->groupBoxNormal->setVisible(false);
+    if (type == DT_BERNOULLI)
+    {
+        ui->groupBoxBernoulli->setVisible(true);
     }
     else if (type == DT_NORMAL)
     {
-        qreal u = ui->doubleSpinBoxNormalU->value();
-        qreal sigma = ui->doubleSpinBoxNormalSigma->value();
-        qreal delta = ui->doubleSpinBoxNormalDelta->value();
-        for (qreal i = -10; i <= 10; i += delta)
+        ui->groupBoxNormal->setVisible(true);
+    }
+    else if (type == DT_NORMAL2D)
+    {
+        ui->groupBoxNormal->setVisible(true);
+    }
+}
+
+void MainWindow::onKdeOptionsChanged()
+{
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    KdeOptions options = readKdeOptions(ui);
+    QSharedPointer<const PointsSnapshot> current = canvas->pointsSnapshot();
+
+    // The new snapshot shares the point set and statistics, only the overlay
+    // is rebuilt.
+    QSharedPointer<PointsSnapshot> result(new PointsSnapshot(*current));
+    result->kde.reset();
+    m_scheduler->submit(TC_Kde, [=](ComputeThread* self)
+    {
+        if (options.enabled && !result->points->isEmpty())
         {
-            qreal value = qSqrt(1 / (2 * M_PI * sigma * sigma)) * qExp(-1.0f / (2 * sigma * sigma) * (i - u) * (i - u));
-            samples.append(QVector2D(i, value));
-            sum += value;
+            self->reportProgress(0, "Estimating density");
+            result->kde = buildKdeSnapshot(*result->points, options.bandwidth);
         }
-        avg = sum / samples.size();
-        for (int i = 0; i < samples.size(); i++)
+    }, [=]()
+    {
+        // New points were published meanwhile; they carry their own overlay.
+        if (canvas->pointsSnapshot()->points != current->points)
+            return;
+        canvas->publishPoints(result);
+    });
+}
+
+void MainWindow::onKdeModeChanged(int index)
+{
+    ui->graphicsViewCanvas->setKdeMode(static_cast<KdeMode>(ui->comboBoxKdeMode->itemData(index, Qt::UserRole).toInt()));
+}
+
+void MainWindow::onActionFitMixture(bool checked)
+{
+    // Point sets are immutable once published, so the task reads the one the
+    // canvas shows without copying it.
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    QSharedPointer<const PointSet> points = canvas->pointsSnapshot()->points;
+    QSharedPointer<GaussianMixture> mixture(new GaussianMixture);
+    mixture->setComponentCount(ui->spinBoxMixtureComponents->value());
+    if (points->size() < size_t(mixture->componentCount()))
+        return;
+
+    QSharedPointer<qint64> elapsed(new qint64(0));
+    m_scheduler->submit(TC_Fit, [=](ComputeThread* self)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        mixture->fit(*points, [=](int iteration, double logLikelihood)
         {
-            var += (samples[i].y() - avg) * (samples[i].y() - avg);
-        }
-        var /= samples.size();
-        std = qSqrt(var);
-    }
-    else if (type == DT_NORMAL2D)
+            self->reportProgress(iteration * 100 / mixture->maxIterations(),
+                QString("EM iteration %1, log-likelihood %2").arg(iteration).arg(logLikelihood / points->size()));
+            return !self->isCancelled();
+        });
+        *elapsed = timer.elapsed();
+    }, [=]()
+    {
+        if (canvas->pointsSnapshot()->points != points)
+            return;
+        canvas->setMixture(mixture->components());
+        canvas->scene()->update();
+        ui->statusbar->showMessage(QString("GMM: %1 components, %2 iterations%3, %4 ms")
+            .arg(mixture->componentCount()).arg(mixture->iterations())
+            .arg(mixture->converged() ? ", converged" : "").arg(*elapsed));
+    });
+}
+
+void MainWindow::onActionCluster(bool checked)
+{
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    QSharedPointer<const PointSet> points = canvas->pointsSnapshot()->points;
+    QSharedPointer<KMeans> kmeans(new KMeans);
+    kmeans->setClusterCount(ui->spinBoxClusters->value());
+    kmeans->setAlgorithm(static_cast<KMeans::Algorithm>(ui->comboBoxKMeansAlgorithm->currentData(Qt::UserRole).toInt()));
+    if (points->size() < size_t(kmeans->clusterCount()))
+        return;
+
+    QSharedPointer<qint64> elapsed(new qint64(0));
+    m_scheduler->submit(TC_Fit, [=](ComputeThread* self)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        kmeans->fit(*points, [=](int iteration, double inertia, double milliseconds)
+        {
+            self->reportProgress(iteration * 100 / kmeans->maxIterations(),
+                QString("k-means iteration %1: %2 ms, inertia %3").arg(iteration).arg(milliseconds, 0, 'f', 2).arg(inertia));
+            return !self->isCancelled();
+        });
+        *elapsed = timer.elapsed();
+    }, [=]()
+    {
+        if (canvas->pointsSnapshot()->points != points)
+            return;
+        const std::vector<double>& times = kmeans->iterationTimes();
+        double average = 0;
+        for (size_t i = 0; i < times.size(); i++)
+            average += times[i];
+        average /= qMax<size_t>(times.size(), 1);
+        canvas->setClusters(kmeans->clusters());
+        canvas->scene()->update();
+        ui->statusbar->showMessage(QString("k-means: %1 clusters, %2 iterations%3, %4 ms/iteration, inertia %5, %6 ms total")
+            .arg(kmeans->clusterCount()).arg(kmeans->iterations())
+            .arg(kmeans->converged() ? ", converged" : ", not converged")
+            .arg(average, 0, 'f', 2).arg(kmeans->inertia()).arg(*elapsed));
+    });
+}
+
+void MainWindow::onActionFitLine(bool checked)
+{
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    QSharedPointer<const PointsSnapshot> snapshot = canvas->pointsSnapshot();
+    QSharedPointer<const PointSet> points = snapshot->points;
+    if (points->size() < 2)
+        return;
+
+    LineFitMethod method = static_cast<LineFitMethod>(ui->comboBoxLineFit->currentData(Qt::UserRole).toInt());
+    float threshold = float(ui->doubleSpinBoxLineThreshold->value());
+    QSharedPointer<LineRansac> ransac(new LineRansac);
+    ransac->setThreshold(threshold);
+    QSharedPointer<FittedLine> line(new FittedLine);
+    QSharedPointer<qint64> elapsed(new qint64(0));
+    m_scheduler->submit(TC_Fit, [=](ComputeThread* self)
     {
-        qreal delta = ui->doubleSpinBoxNormalDelta->value();
-        qreal sigma = ui->doubleSpinBoxNormalSigma->value();
-        QList<Eigen::Vector2f> points2D;
-        Eigen::Vector2f avg(Eigen::Vector2f::Zero());
-        for (qreal i = -10; i <= 10; i += delta)
+        QElapsedTimer timer;
+        timer.start();
+        if (method == LF_Ransac)
         {
-            for (qreal j = -10; j <= 10; j += delta)
+            bool fitted = ransac->fit(*points, [=](int hypotheses, size_t inliers)
             {
-                Eigen::Vector2f point(i / 10, j / 10);
-                points2D.append(point);
-                avg += point;
-            }
+                self->reportProgress(qMin(99, hypotheses * 100 / ransac->maxHypotheses()),
+                    QString("RANSAC: %1 hypotheses, %2 inliers").arg(hypotheses).arg(inliers));
+                return !self->isCancelled();
+            });
+            if (fitted)
+                *line = ransac->line();
+        }
+        else
+        {
+            // The snapshot already holds the covariance of all points.
+            *line = fitLineTls(snapshot->statistics);
+            line->threshold = threshold;
+            line->inliers = countLineInliers(*points, *line);
         }
-        avg /= points2D.size();
-        Eigen::Matrix2f covM(Eigen::Matrix2f::Zero());
-        for (int i = 0; i < points2D.size(); i++)
+        *elapsed = timer.elapsed();
+    }, [=]()
+    {
+        if (canvas->pointsSnapshot()->points != points)
+            return;
+        canvas->setLine(*line);
+        canvas->scene()->update();
+        if (!line->valid)
         {
-            covM(0, 0) += (points2D[i].x() - avg.x()) * (points2D[i].x() - avg.x());
-            covM(0, 1) += (points2D[i].x() - avg.x()) * (points2D[i].y() - avg.y());
-            covM(1, 0) += (points2D[i].x() - avg.x()) * (points2D[i].y() - avg.y());
-            covM(1, 1) += (points2D[i].y() - avg.y()) * (points2D[i].y() - avg.y());
+            ui->statusbar->showMessage("Line fit failed");
+            return;
         }
-        //covM /= points2D.size() * sigma;
-        covM = Eigen::Matrix2f::Identity();
-        covM *= sigma;
-        //std::cout << covM << std::endl;
-        //covM = covM.cwiseSqrt();
-        Eigen::Matrix2f covMInv = covM.inverse();
-        std::cout << "avg:" << avg.transpose() << std::endl;
-        std::cout << covM << std::endl;
-        std::cout << covMInv << std::endl;
-        qreal det = covM.determinant();
-        qreal det_1 = 1.0 / det;
-        qreal pi_2 = 0.5 / M_PI;
-
-        qreal min = 65535, max = 0;
-        for (int i = 0; i < points2D.size(); i++)
+        QString name = method == LF_Ransac ? QString("RANSAC, %1 hypotheses").arg(ransac->hypotheses()) : QString("TLS");
+        ui->statusbar->showMessage(QString("Line (%1): %2 of %3 points within %4 (%5%), rms %6, %7 ms")
+            .arg(name).arg(line->inliers).arg(points->size()).arg(threshold)
+            .arg(100.0 * line->inliers / points->size(), 0, 'f', 1).arg(line->rms).arg(*elapsed));
+    });
+}
+
+void MainWindow::onActionCancelCompute(bool checked)
+{
+    m_scheduler->cancelAll();
+}
+
+void MainWindow::onActionOpenData(bool checked)
+{
+    QString filename = QFileDialog::getOpenFileName(this,
+        tr("Open Data"), tr("."), tr("Data (*.npy *.csv *.tsv *.txt);;"));
+    if (filename.isNull() || filename.isEmpty())
+        return;
+
+    QSharedPointer<MatrixReader> reader(new MatrixReader);
+    if (!reader->open(filename.toStdString()))
+    {
+        ui->statusbar->showMessage(QString("Cannot read %1: %2").arg(filename).arg(QString::fromStdString(reader->errorString())));
+        return;
+    }
+
+    QSharedPointer<DataPCA> pca(new DataPCA);
+    pca->setComponentCount(qMin(ui->spinBoxDataComponents->value(), reader->columns()));
+    m_scheduler->submit(TC_DataPCA, [=](ComputeThread* self)
+    {
+        long long total = reader->rows();
+        pca->fit(*reader, [=](DataPCA::Stage stage, size_t rows)
+        {
+            // Covariance and projection each stream the file once.
+            int percent = stage == DataPCA::EigenStage ? 50 : 0;
+            if (total > 0)
+                percent = int((stage == DataPCA::ProjectionStage ? 50 : 0) + 50.0 * rows / total);
+            const char* name = stage == DataPCA::CovarianceStage ? "covariance"
+                : stage == DataPCA::EigenStage ? "eigenvectors" : "projection";
+            self->reportProgress(percent, QString("Data PCA %1: %2 rows").arg(name).arg(rows));
+            return !self->isCancelled();
+        });
+    }, [=]()
+    {
+        if (pca->projections().empty())
         {
-            Eigen::Vector2f x = points2D[i];
-            qreal v = x.transpose() * covM * x;
-            qreal value = pi_2 * qSqrt(det_1) * qExp(-0.5 * v);
-            if (value < min) min = value;
-            if (value > max) max = value;
-            QVector3D point(x.x(), x.y(), value);
-            samples3D.append(point);
+            QString error = QString::fromStdString(reader->errorString());
+            ui->statusbar->showMessage(QString("Data PCA failed%1").arg(error.isEmpty() ? QString() : ": " + error));
+            return;
         }
-        for (int i = 0; i < samples3D.size(); i++)
+
+        m_dataPca = pca;
+        int k = int(pca->eigenvalues().size());
+        ui->spinBoxDataAxisX->setMaximum(k);
+        ui->spinBoxDataAxisY->setMaximum(k);
+
+        QString summary;
+        double cumulative = 0;
+        for (int i = 0; i < k; i++)
         {
-            samples3D[i].setZ((samples3D[i].z() - min) / (max - min));
+            double ratio = pca->eigenvalues()(i) / pca->totalVariance();
+            cumulative += ratio;
+            summary += QString("PC%1: %2 (%3%, %4%)\n").arg(i + 1).arg(pca->eigenvalues()(i), 0, 'g', 4)
+                .arg(ratio * 100, 0, 'f', 2).arg(cumulative * 100, 0, 'f', 2);
         }
-    }
+        ui->plainTextEditDataSummary->setPlainText(summary);
+        onDataAxesChanged();
+
+        ui->statusbar->showMessage(QString("Data PCA: %1 x %2, covariance %3 ms, eigen %4 ms, projection %5 ms")
+            .arg(pca->rows()).arg(pca->columns()).arg(pca->covarianceMs(), 0, 'f', 0)
+            .arg(pca->eigenMs(), 0, 'f', 1).arg(pca->projectionMs(), 0, 'f', 0));
+    });
+}
+
+void MainWindow::onDataAxesChanged()
+{
+    if (m_dataPca.isNull())
+        return;
 
-    qDebug() << "avg =" << avg;
-    qDebug() << "var =" << var;
-    qDebug() << "std =" << std;
+    // Scaled so the leading component has unit standard deviation on the
+    // canvas; the aspect ratio between the two axes is preserved.
+    QSharedPointer<const DataPCA> pca = m_dataPca;
+    const Eigen::VectorXd& values = pca->eigenvalues();
+    int a = ui->spinBoxDataAxisX->value() - 1;
+    int b = ui->spinBoxDataAxisY->value() - 1;
+    double scale = values(0) > 0 ? 1.0 / qSqrt(values(0)) : 1.0;
+    qreal varianceX = values(a) * scale * scale;
+    qreal varianceY = values(b) * scale * scale;
 
-    ui->graphicsViewCanvas->setSamples(samples);
-    ui->graphicsViewCanvas->setSamples3D(samples3D);
-    ui->graphicsViewCanvas->setAvg(avg);
-    ui->graphicsViewCanvas->setVar(var);
-    ui->graphicsViewCanvas->setStd(std);
-    ui->graphicsViewCanvas->scene()->update();
+    QSharedPointer<PointSet> points(new PointSet);
+    QSharedPointer<PointIndex> index(new PointIndex);
+    m_scheduler->submit(TC_DataProjection, [=](ComputeThread* self)
+    {
+        *points = pca->projectedPair(a, b, float(scale));
+        // Painting culls and thins the rows through the index.
+        index->build(*points);
+    }, [=]()
+    {
+        if (m_dataPca != pca)
+            return;
+        ui->graphicsViewCanvas->setDataProjection(points, index, varianceX, varianceY);
+    });
 }
 
-void MainWindow::onComboBoxDistributionTypeChanged(int index)
+void MainWindow::onActionOpenStream(bool checked)
 {
-    DistributionType type = static_cast<DistributionType>(ui->comboBoxDistributionType->currentData(Qt::UserRole).toInt());
+    bool ok = false;
+    QString source = QInputDialog::getText(this, tr("Open Stream"),
+        tr("File, FIFO or UNIX socket with one x,y record per line:"), QLineEdit::Normal, m_streamSource, &ok);
+    if (!ok || source.isEmpty())
+        return;
 
-    ui->groupBoxBernoulli->setVisible(false);
-    ui->groupBoxNormal->setVisible(false);
-    if (type == DT_BERNOULLI)
+    QSharedPointer<PointStream> stream(new PointStream);
+    if (!stream->open(source.toStdString()))
     {
-        ui->groupBoxBernoulli->setVisible(true);
+        ui->statusbar->showMessage(QString("Cannot open stream: %1").arg(QString::fromStdString(stream->errorString())));
+        return;
     }
-    else if (type == DT_NORMAL)
+
+    m_streamSource = source;
+    m_stream = stream;
+    m_streamReceived = 0;
+    ui->graphicsViewCanvas->setStream(stream);
+    onStreamWeightingChanged();
+    ui->actionCovMatrixTool->trigger();
+    ui->actionStopStream->setEnabled(true);
+    m_streamStatusTimer->start();
+}
+
+void MainWindow::onActionStopStream(bool checked)
+{
+    if (m_stream.isNull())
+        return;
+
+    ui->graphicsViewCanvas->setStream(QSharedPointer<PointStream>());
+    ui->statusbar->showMessage(QString("Stream stopped after %1 points").arg(m_stream->received()));
+    // Joins the reader thread.
+    m_stream.clear();
+    m_streamStatusTimer->stop();
+    ui->actionStopStream->setEnabled(false);
+}
+
+void MainWindow::onStreamWeightingChanged()
+{
+    StreamingCovariance::Weighting weighting = static_cast<StreamingCovariance::Weighting>(
+        ui->comboBoxStreamWeighting->currentData(Qt::UserRole).toInt());
+    ui->graphicsViewCanvas->setStreamWeighting(weighting, size_t(ui->spinBoxStreamWindow->value()));
+}
+
+void MainWindow::onStreamStatus()
+{
+    if (m_stream.isNull())
+        return;
+
+    unsigned long long received = m_stream->received();
+    double rate = (received - m_streamReceived) * 1000.0 / m_streamStatusTimer->interval();
+    m_streamReceived = received;
+
+    QString message = QString("Stream: %1 points, %2 M points/s, %3 stalls")
+        .arg(received).arg(rate / 1e6, 0, 'f', 2).arg(m_stream->stalls());
+    if (m_stream->isFinished())
     {
-        ui->groupBoxNormal->setVisible(true);
+        QString error = QString::fromStdString(m_stream->errorString());
+        message += error.isEmpty() ? QString(", ended") : ", " + error;
     }
-    else if (type == DT_NORMAL2D)
+    ui->statusbar->showMessage(message);
+}
+
+void MainWindow::onActionExportImage(bool checked)
+{
+    QString filename = QFileDialog::getSaveFileName(this,
+        tr("Export Image"), tr("."), tr("PNG (*.png)"));
+    if (filename.isEmpty())
+        return;
+    if (!filename.endsWith(".png", Qt::CaseInsensitive))
+        filename += ".png";
+
+    // Defaults to four times the viewport; any size is fine, memory only
+    // grows with the width.
+    CanvasView* canvas = ui->graphicsViewCanvas;
+    QSize viewportSize = canvas->viewport()->size() * 4;
+    bool ok = false;
+    QString text = QInputDialog::getText(this, tr("Export Image"), tr("Size in pixels (width x height):"),
+        QLineEdit::Normal, QString("%1x%2").arg(viewportSize.width()).arg(viewportSize.height()), &ok);
+    if (!ok)
+        return;
+    QStringList parts = text.toLower().split('x');
+    int width = parts.size() == 2 ? parts[0].trimmed().toInt() : 0;
+    int height = parts.size() == 2 ? parts[1].trimmed().toInt() : 0;
+    if (width <= 0 || height <= 0)
     {
-        ui->groupBoxNormal->setVisible(true);
+        ui->statusbar->showMessage(QString("Invalid export size: %1").arg(text));
+        return;
     }
+
+    // The exporter freezes the view here; the tiles are then rendered from
+    // that copy in the background.
+    QSharedPointer<CanvasExporter> exporter(new CanvasExporter(canvas));
+    QSharedPointer<bool> exported(new bool(false));
+    m_scheduler->submit(TC_Export, [=](ComputeThread* self)
+    {
+        self->reportProgress(0, QString("Exporting %1").arg(filename));
+        *exported = exporter->exportPng(filename, QSize(width, height), [=](int rows, int total)
+        {
+            self->reportProgress(int(qint64(rows) * 100 / total), QString("Exported %1 of %2 rows").arg(rows).arg(total));
+            return !self->isCancelled();
+        });
+    }, [=]()
+    {
+        if (!*exported)
+        {
+            ui->statusbar->showMessage(QString("Export failed: %1").arg(exporter->errorString()));
+            return;
+        }
+
+        const CanvasExporter::Statistics& statistics = exporter->statistics();
+        QString message = QString("Exported %1x%2 in %3 ms (%4 tiles, render %5 ms, encode %6 ms), %7 MB, RSS %8 MB at most (%9 MB before)")
+            .arg(width).arg(height).arg(statistics.totalMs).arg(statistics.tiles)
+            .arg(statistics.renderMs).arg(statistics.encodeMs)
+            .arg(statistics.bytes / 1048576.0, 0, 'f', 1)
+            .arg(statistics.peakRssKb / 1024.0, 0, 'f', 1)
+            .arg(statistics.rssBeforeKb / 1024.0, 0, 'f', 1);
+        qDebug().noquote() << message;
+        ui->statusbar->showMessage(message);
+    });
+}
+
+void MainWindow::onComputeProgress(int channel, int percent, const QString& message)
+{
+    m_progressBar->setValue(percent);
+    ui->statusbar->showMessage(message);
+}
+
+void MainWindow::onComputeBusyChanged(bool busy)
+{
+    m_progressBar->setValue(0);
+    m_progressBar->setVisible(busy);
+    ui->actionCancelCompute->setEnabled(busy);
 }
 
 void MainWindow::onApply(bool checked)
 {
+    // Swapping the 2x2 matrix is O(1), so it stays on the GUI thread.
     QMatrix2x2 matrix;
     matrix(0, 0) = ui->lineEdit00->text().toInt();
     matrix(1, 0) = ui->lineEdit10->text().toInt();
@@ -2,12 +2,18 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QSharedPointer>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
 class QActionGroup;
+class QProgressBar;
+class QTimer;
+class DataPCA;
+class PointStream;
+class TaskScheduler;
 
 class MainWindow : public QMainWindow
 {
@@ -22,13 +28,61 @@ protected slots:
     void onToolsGroupTriggered(QAction* action);
     void onActionGenerate(bool checked = false);
     void onActionOpenImage(bool checked = false);
+    void onActionSaveEncoded(bool checked = false);
+    void onActionProcessVideo(bool checked = false);
+    void onStructureTensorOptionsChanged();
     void showDistribution(bool ckecked = false);
 
     void onComboBoxDistributionTypeChanged(int index);
+    void onKdeOptionsChanged();
+    void onKdeModeChanged(int index);
+    void onActionFitMixture(bool checked = false);
+    void onActionCluster(bool checked = false);
+    void onActionFitLine(bool checked = false);
+    void onActionCancelCompute(bool checked = false);
+    void onComputeProgress(int channel, int percent, const QString& message);
+    void onComputeBusyChanged(bool busy);
+    void onActionOpenData(bool checked = false);
+    void onDataAxesChanged();
+    void onActionOpenStream(bool checked = false);
+    void onActionStopStream(bool checked = false);
+    void onStreamWeightingChanged();
+    void onStreamStatus();
+    void onActionExportImage(bool checked = false);
+
+private:
+    // Scheduler channels. A submission supersedes the work in flight on the
+    // same channel only.
+    enum TaskChannel
+    {
+        TC_Points = 0,
+        TC_Kde,
+        TC_Fit,
+        TC_Distribution,
+        TC_Image,
+        TC_StructureTensor,
+        TC_DataPCA,
+        TC_DataProjection,
+        TC_Video,
+        TC_Encode,
+        TC_Export
+    };
+
+    void openEncodedImage(const QString& filename);
 
 private:
     Ui::MainWindow *ui;
 
     QActionGroup* m_toolsGroup;
+    QProgressBar* m_progressBar;
+
+    TaskScheduler* m_scheduler;
+
+    QSharedPointer<DataPCA> m_dataPca;
+
+    QSharedPointer<PointStream> m_stream;
+    QString m_streamSource;
+    QTimer* m_streamStatusTimer;
+    unsigned long long m_streamReceived;
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,113 @@
+#include "TaskScheduler.h"
+
+TaskScheduler::TaskScheduler(QObject* parent)
+    : QObject(parent)
+    , m_busy(false)
+{
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    // Stop everything before the state the tasks write into goes away.
+    for (ComputeThread* thread : findChildren<ComputeThread*>())
+    {
+        thread->cancel();
+        thread->wait();
+    }
+}
+
+quint64 TaskScheduler::submit(int channel, const Task& task, const Publish& publish)
+{
+    Channel& c = m_channels[channel];
+    c.generation++;
+    c.hasPending = true;
+    c.pendingTask = task;
+    c.pendingPublish = publish;
+
+    if (c.running)
+        c.running->cancel();
+    else
+        startPending(channel);
+    return c.generation;
+}
+
+void TaskScheduler::cancel(int channel)
+{
+    if (!m_channels.contains(channel))
+        return;
+
+    Channel& c = m_channels[channel];
+    c.generation++;
+    c.hasPending = false;
+    c.pendingTask = Task();
+    c.pendingPublish = Publish();
+    if (c.running)
+        c.running->cancel();
+    updateBusy();
+}
+
+void TaskScheduler::cancelAll()
+{
+    for (int channel : m_channels.keys())
+        cancel(channel);
+}
+
+quint64 TaskScheduler::generation(int channel) const
+{
+    return m_channels.value(channel).generation;
+}
+
+bool TaskScheduler::isBusy() const
+{
+    for (const Channel& c : m_channels)
+    {
+        if (c.running || c.hasPending)
+            return true;
+    }
+    return false;
+}
+
+void TaskScheduler::startPending(int channel)
+{
+    Channel& c = m_channels[channel];
+    if (!c.hasPending)
+    {
+        updateBusy();
+        return;
+    }
+
+    quint64 generation = c.generation;
+    Publish publish = c.pendingPublish;
+    ComputeThread* thread = new ComputeThread(c.pendingTask, this);
+    c.hasPending = false;
+    c.pendingTask = Task();
+    c.pendingPublish = Publish();
+    c.running = thread;
+
+    connect(thread, &ComputeThread::progress, this, [=](int percent, const QString& message)
+    {
+        if (isCurrent(channel, generation))
+            emit progress(channel, percent, message);
+    });
+    connect(thread, &QThread::finished, this, [=]()
+    {
+        m_channels[channel].running = nullptr;
+        if (!thread->isCancelled() && isCurrent(channel, generation) && publish)
+            publish();
+        thread->deleteLater();
+        startPending(channel);
+    });
+
+    thread->start();
+    updateBusy();
+}
+
+void TaskScheduler::updateBusy()
+{
+    bool busy = isBusy();
+    if (busy != m_busy)
+    {
+        m_busy = busy;
+        emit busyChanged(busy);
+    }
+}
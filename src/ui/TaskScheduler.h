@@ -0,0 +1,62 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <QHash>
+#include <QObject>
+#include <functional>
+
+#include "ComputeThread.h"
+
+// Latest-wins scheduler for recomputation driven by UI parameters.
+//
+// Work is grouped into channels, e.g. one per tool. Submitting to a channel
+// bumps its generation and cancels the task in flight there. Only the newest
+// submission waits while a cancelled task winds down, so dragging a spin box
+// never queues up work. A task computes into state it owns; its publish step
+// runs on the GUI thread, and only if its generation is still the channel's
+// latest.
+class TaskScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    typedef ComputeThread::Task Task;
+    typedef std::function<void()> Publish;
+
+    explicit TaskScheduler(QObject* parent = nullptr);
+    virtual ~TaskScheduler();
+
+    // Returns the generation token of the new task.
+    quint64 submit(int channel, const Task& task, const Publish& publish);
+    // Drops the pending task and cancels the running one without publishing.
+    void cancel(int channel);
+    void cancelAll();
+
+    quint64 generation(int channel) const;
+    bool isCurrent(int channel, quint64 generation) const { return this->generation(channel) == generation; }
+    bool isBusy() const;
+
+signals:
+    void progress(int channel, int percent, const QString& message);
+    void busyChanged(bool busy);
+
+private:
+    struct Channel
+    {
+        Channel() : generation(0), running(nullptr), hasPending(false) {}
+
+        quint64 generation;
+        ComputeThread* running;
+        bool hasPending;
+        Task pendingTask;
+        Publish pendingPublish;
+    };
+
+    void startPending(int channel);
+    void updateBusy();
+
+private:
+    QHash<int, Channel> m_channels;
+    bool m_busy;
+};
+
+#endif // TASKSCHEDULER_H